@@ -0,0 +1,611 @@
+#include "pch.h"
+#include "BC6HEncoder.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <thread>
+#include <vector>
+
+//size of a BC6H block in bytes
+#define bc6hBlockBytes 16
+
+namespace
+{
+	//interpolation weights of the 4 bit indices, in 64ths
+	const int indexWeights[16] = {0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64};
+
+	//one region modes, 12 to 14 store the second endpoint as signed delta to the first one
+	struct BlockMode
+	{
+		unsigned int modeBits;
+		int endpointBits;
+		//0 stores the second endpoint with endpointBits as well
+		int deltaBits;
+	};
+
+	const BlockMode mode11 = {0x03, 10, 0};
+	const BlockMode oneRegionModes[] = {{0x03, 10, 0}, {0x07, 11, 9}, {0x0b, 12, 8}, {0x0f, 16, 4}};
+
+	struct Block
+	{
+		//target half floats as integers, the error is measured on them since they are close to logarithmic
+		int half[16][3];
+		//targets in the 16 bit domain the endpoints are interpolated in, before the final scale by 31/64
+		float unfinished[16][3];
+	};
+
+	struct Encoding
+	{
+		BlockMode mode;
+		int endpoints[2][3];
+		int indices[16];
+		long long error;
+	};
+
+	unsigned short floatToHalf(float value)
+	{
+		//also catches NaN
+		if (!(value > 0.0f))
+			return 0;
+		if (value >= 65504.0f)
+			return 0x7BFF;
+
+		unsigned int bits;
+		std::memcpy(&bits, &value, sizeof(bits));
+		int exponent = static_cast<int>(bits >> 23) - 127 + 15;
+		if (exponent <= 0)
+			return static_cast<unsigned short>(std::lround(value * 16777216.0f));
+
+		unsigned int mantissa = bits & 0x7FFFFF;
+		unsigned int half = (static_cast<unsigned int>(exponent) << 10) | (mantissa >> 13);
+		//round to nearest even, a carry into the exponent gives the right result
+		unsigned int rest = mantissa & 0x1FFF;
+		if (rest > 0x1000 || (rest == 0x1000 && (half & 1)))
+			++half;
+		return static_cast<unsigned short>(std::min(half, 0x7BFFu));
+	}
+
+	float halfToFloat(int half)
+	{
+		int exponent = (half >> 10) & 0x1F;
+		int mantissa = half & 0x3FF;
+		if (exponent == 0)
+			return std::ldexp(static_cast<float>(mantissa), -24);
+		return std::ldexp(static_cast<float>(mantissa | 0x400), exponent - 25);
+	}
+
+	//endpoint in the 16 bit interpolation domain, as the unsigned BC6H decoder expands it
+	int unquantize(int value, int bits)
+	{
+		if (bits >= 15)
+			return value;
+		if (value == 0)
+			return 0;
+		if (value == (1 << bits) - 1)
+			return 0xFFFF;
+		return ((value << 16) + 0x8000) >> bits;
+	}
+
+	//interpolated and finished half float of a texel
+	int interpolate(int first, int second, int weight)
+	{
+		int value = (first * (64 - weight) + second * weight + 32) >> 6;
+		return (value * 31) >> 6;
+	}
+
+	int quantize(float unfinished, int bits)
+	{
+		int maxValue = (1 << bits) - 1;
+		int guess = std::min(std::max(static_cast<int>(unfinished * (1 << bits) / 65536.0f), 0), maxValue);
+
+		int best = guess;
+		float bestError = std::numeric_limits<float>::max();
+		for (int value = std::max(guess - 1, 0); value <= std::min(guess + 1, maxValue); ++value)
+		{
+			float error = std::fabs(unquantize(value, bits) - unfinished);
+			if (error < bestError)
+			{
+				bestError = error;
+				best = value;
+			}
+		}
+		return best;
+	}
+
+	//keeps the second endpoint inside the signed delta range of the mode
+	void clampDelta(const BlockMode& mode, int endpoints[2][3])
+	{
+		if (!mode.deltaBits)
+			return;
+		int low = -(1 << (mode.deltaBits - 1));
+		int high = (1 << (mode.deltaBits - 1)) - 1;
+		int maxValue = (1 << mode.endpointBits) - 1;
+		for (int c = 0; c < 3; ++c)
+		{
+			endpoints[1][c] = std::min(std::max(endpoints[1][c], endpoints[0][c] + low), endpoints[0][c] + high);
+			endpoints[1][c] = std::min(std::max(endpoints[1][c], 0), maxValue);
+		}
+	}
+
+	//picks the closest palette entry for every texel, the anchor texel 0 may be limited to the lower half
+	long long assignIndices(const Block& block, const BlockMode& mode, const int endpoints[2][3], int* indices,
+	                        bool limitAnchor)
+	{
+		int palette[16][3];
+		for (int c = 0; c < 3; ++c)
+		{
+			int first = unquantize(endpoints[0][c], mode.endpointBits);
+			int second = unquantize(endpoints[1][c], mode.endpointBits);
+			for (int i = 0; i < 16; ++i)
+				palette[i][c] = interpolate(first, second, indexWeights[i]);
+		}
+
+		long long error = 0;
+		for (int p = 0; p < 16; ++p)
+		{
+			int count = p == 0 && limitAnchor ? 8 : 16;
+			long long bestError = std::numeric_limits<long long>::max();
+			for (int i = 0; i < count; ++i)
+			{
+				long long texelError = 0;
+				for (int c = 0; c < 3; ++c)
+				{
+					long long difference = palette[i][c] - block.half[p][c];
+					texelError += difference * difference;
+				}
+				if (texelError < bestError)
+				{
+					bestError = texelError;
+					indices[p] = i;
+				}
+			}
+			error += bestError;
+		}
+		return error;
+	}
+
+	//indices and error of quantized endpoints, swaps them if the anchor would need the implicit high bit
+	Encoding evaluate(const Block& block, const BlockMode& mode, const int endpoints[2][3])
+	{
+		Encoding encoding;
+		encoding.mode = mode;
+		std::memcpy(encoding.endpoints, endpoints, sizeof(encoding.endpoints));
+		clampDelta(mode, encoding.endpoints);
+		encoding.error = assignIndices(block, mode, encoding.endpoints, encoding.indices, false);
+
+		if (encoding.indices[0] >= 8)
+		{
+			for (int c = 0; c < 3; ++c)
+				std::swap(encoding.endpoints[0][c], encoding.endpoints[1][c]);
+			clampDelta(mode, encoding.endpoints);
+			encoding.error = assignIndices(block, mode, encoding.endpoints, encoding.indices, true);
+		}
+		return encoding;
+	}
+
+	Encoding evaluate(const Block& block, const BlockMode& mode, const float endpoints[2][3])
+	{
+		int quantized[2][3];
+		for (int e = 0; e < 2; ++e)
+		{
+			for (int c = 0; c < 3; ++c)
+				quantized[e][c] = quantize(endpoints[e][c], mode.endpointBits);
+		}
+		return evaluate(block, mode, quantized);
+	}
+
+	//per channel bounding box, oriented along the diagonal that follows the channel with the largest range
+	void boxEndpoints(const Block& block, float endpoints[2][3])
+	{
+		float mean[3] = {0.0f, 0.0f, 0.0f};
+		for (int c = 0; c < 3; ++c)
+		{
+			endpoints[0][c] = endpoints[1][c] = block.unfinished[0][c];
+			for (int p = 0; p < 16; ++p)
+			{
+				endpoints[0][c] = std::min(endpoints[0][c], block.unfinished[p][c]);
+				endpoints[1][c] = std::max(endpoints[1][c], block.unfinished[p][c]);
+				mean[c] += block.unfinished[p][c] / 16.0f;
+			}
+		}
+
+		int major = 0;
+		for (int c = 1; c < 3; ++c)
+		{
+			if (endpoints[1][c] - endpoints[0][c] > endpoints[1][major] - endpoints[0][major])
+				major = c;
+		}
+
+		for (int c = 0; c < 3; ++c)
+		{
+			float covariance = 0.0f;
+			for (int p = 0; p < 16; ++p)
+				covariance += (block.unfinished[p][c] - mean[c]) * (block.unfinished[p][major] - mean[major]);
+			if (covariance < 0.0f)
+				std::swap(endpoints[0][c], endpoints[1][c]);
+		}
+	}
+
+	//extent of the texels along their principal axis, found by power iteration on the covariance
+	void principalEndpoints(const Block& block, float endpoints[2][3])
+	{
+		float mean[3] = {0.0f, 0.0f, 0.0f};
+		for (int p = 0; p < 16; ++p)
+		{
+			for (int c = 0; c < 3; ++c)
+				mean[c] += block.unfinished[p][c] / 16.0f;
+		}
+
+		float covariance[3][3] = {};
+		for (int p = 0; p < 16; ++p)
+		{
+			for (int i = 0; i < 3; ++i)
+			{
+				for (int j = 0; j < 3; ++j)
+					covariance[i][j] += (block.unfinished[p][i] - mean[i]) * (block.unfinished[p][j] - mean[j]);
+			}
+		}
+
+		float axis[3] = {1.0f, 1.0f, 1.0f};
+		for (int iteration = 0; iteration < 8; ++iteration)
+		{
+			float next[3];
+			float length = 0.0f;
+			for (int i = 0; i < 3; ++i)
+			{
+				next[i] = covariance[i][0] * axis[0] + covariance[i][1] * axis[1] + covariance[i][2] * axis[2];
+				length = std::max(length, std::fabs(next[i]));
+			}
+			//flat blocks keep the gray axis
+			if (length <= 0.0f)
+				break;
+			for (int i = 0; i < 3; ++i)
+				axis[i] = next[i] / length;
+		}
+
+		float axisLength = std::sqrt(axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2]);
+		float low = std::numeric_limits<float>::max();
+		float high = -std::numeric_limits<float>::max();
+		for (int p = 0; p < 16; ++p)
+		{
+			float t = 0.0f;
+			for (int c = 0; c < 3; ++c)
+				t += (block.unfinished[p][c] - mean[c]) * axis[c] / axisLength;
+			low = std::min(low, t);
+			high = std::max(high, t);
+		}
+
+		for (int c = 0; c < 3; ++c)
+		{
+			endpoints[0][c] = std::min(std::max(mean[c] + axis[c] / axisLength * low, 0.0f), 65535.0f);
+			endpoints[1][c] = std::min(std::max(mean[c] + axis[c] / axisLength * high, 0.0f), 65535.0f);
+		}
+	}
+
+	//least squares endpoints for fixed indices, false if all texels use the same weight
+	bool refitEndpoints(const Block& block, const int* indices, float endpoints[2][3])
+	{
+		float aa = 0.0f, ab = 0.0f, bb = 0.0f;
+		float ax[3] = {}, bx[3] = {};
+		for (int p = 0; p < 16; ++p)
+		{
+			float t = indexWeights[indices[p]] / 64.0f;
+			aa += (1.0f - t) * (1.0f - t);
+			ab += (1.0f - t) * t;
+			bb += t * t;
+			for (int c = 0; c < 3; ++c)
+			{
+				ax[c] += (1.0f - t) * block.unfinished[p][c];
+				bx[c] += t * block.unfinished[p][c];
+			}
+		}
+
+		float determinant = aa * bb - ab * ab;
+		if (std::fabs(determinant) < 1e-6f)
+			return false;
+
+		for (int c = 0; c < 3; ++c)
+		{
+			endpoints[0][c] = std::min(std::max((ax[c] * bb - bx[c] * ab) / determinant, 0.0f), 65535.0f);
+			endpoints[1][c] = std::min(std::max((aa * bx[c] - ab * ax[c]) / determinant, 0.0f), 65535.0f);
+		}
+		return true;
+	}
+
+	//principal axis start, alternating refits and a final one step search around every quantized endpoint
+	Encoding encodeMode(const Block& block, const BlockMode& mode, const float start[2][3])
+	{
+		float endpoints[2][3];
+		std::memcpy(endpoints, start, sizeof(endpoints));
+
+		Encoding best = evaluate(block, mode, endpoints);
+		for (int iteration = 0; iteration < 2 && best.error > 0; ++iteration)
+		{
+			if (!refitEndpoints(block, best.indices, endpoints))
+				break;
+			Encoding refined = evaluate(block, mode, endpoints);
+			if (refined.error >= best.error)
+				break;
+			best = refined;
+		}
+
+		int maxValue = (1 << mode.endpointBits) - 1;
+		for (int e = 0; e < 2 && best.error > 0; ++e)
+		{
+			for (int c = 0; c < 3; ++c)
+			{
+				for (int step : {-1, 1})
+				{
+					int candidate[2][3];
+					std::memcpy(candidate, best.endpoints, sizeof(candidate));
+					candidate[e][c] += step;
+					if (candidate[e][c] < 0 || candidate[e][c] > maxValue)
+						continue;
+					Encoding perturbed = evaluate(block, mode, candidate);
+					if (perturbed.error < best.error)
+						best = perturbed;
+				}
+			}
+		}
+		return best;
+	}
+
+	//edge texels are repeated for blocks that reach over the image
+	void loadBlock(const float* rgb, int width, int height, int blockX, int blockY, Block& block)
+	{
+		for (int p = 0; p < 16; ++p)
+		{
+			int x = std::min(blockX * 4 + p % 4, width - 1);
+			int y = std::min(blockY * 4 + p / 4, height - 1);
+			const float* texel = rgb + (static_cast<size_t>(y) * width + x) * 3;
+			for (int c = 0; c < 3; ++c)
+			{
+				block.half[p][c] = floatToHalf(texel[c]);
+				block.unfinished[p][c] = block.half[p][c] * 64.0f / 31.0f;
+			}
+		}
+	}
+
+	struct BitWriter
+	{
+		unsigned char* data;
+		int position;
+
+		void write(unsigned int value, int count)
+		{
+			for (int i = 0; i < count; ++i, ++position)
+			{
+				if ((value >> i) & 1)
+					data[position >> 3] |= 1 << (position & 7);
+			}
+		}
+
+		//the high endpoint bits of modes 12 to 14 are stored with the most significant bit first
+		void writeReversed(unsigned int value, int count)
+		{
+			for (int i = count - 1; i >= 0; --i)
+				write(value >> i, 1);
+		}
+	};
+
+	struct BitReader
+	{
+		const unsigned char* data;
+		int position;
+
+		unsigned int read(int count)
+		{
+			unsigned int value = 0;
+			for (int i = 0; i < count; ++i, ++position)
+				value |= ((data[position >> 3] >> (position & 7)) & 1u) << i;
+			return value;
+		}
+
+		unsigned int readReversed(int count)
+		{
+			unsigned int value = 0;
+			for (int i = count - 1; i >= 0; --i)
+				value |= read(1) << i;
+			return value;
+		}
+	};
+
+	void packBlock(const Encoding& encoding, unsigned char* out)
+	{
+		std::memset(out, 0, bc6hBlockBytes);
+		BitWriter writer = {out, 0};
+		const BlockMode& mode = encoding.mode;
+
+		writer.write(mode.modeBits, 5);
+		for (int c = 0; c < 3; ++c)
+			writer.write(encoding.endpoints[0][c] & 0x3FF, 10);
+
+		if (!mode.deltaBits)
+		{
+			for (int c = 0; c < 3; ++c)
+				writer.write(encoding.endpoints[1][c], 10);
+		}
+		else
+		{
+			//rx, rw high bits, gx, gw high bits, bx, bw high bits
+			for (int c = 0; c < 3; ++c)
+			{
+				writer.write((encoding.endpoints[1][c] - encoding.endpoints[0][c]) & ((1 << mode.deltaBits) - 1),
+				             mode.deltaBits);
+				writer.writeReversed(encoding.endpoints[0][c] >> 10, mode.endpointBits - 10);
+			}
+		}
+
+		//the anchor index drops its high bit, which is always 0
+		writer.write(encoding.indices[0], 3);
+		for (int p = 1; p < 16; ++p)
+			writer.write(encoding.indices[p], 4);
+	}
+
+	void encodeBlock(const Block& block, BC6HQuality quality, unsigned char* out)
+	{
+		Encoding best;
+		if (quality == BC6HQuality::Fast)
+		{
+			float endpoints[2][3];
+			boxEndpoints(block, endpoints);
+			best = evaluate(block, mode11, endpoints);
+		}
+		else
+		{
+			float endpoints[2][3];
+			principalEndpoints(block, endpoints);
+			best = encodeMode(block, oneRegionModes[0], endpoints);
+			for (int m = 1; m < 4 && best.error > 0; ++m)
+			{
+				Encoding encoding = encodeMode(block, oneRegionModes[m], endpoints);
+				if (encoding.error < best.error)
+					best = encoding;
+			}
+		}
+		packBlock(best, out);
+	}
+
+	void decodeBlock(const unsigned char* in, float texels[16][3])
+	{
+		BitReader reader = {in, 0};
+		unsigned int modeBits = reader.read(5);
+
+		const BlockMode* mode = nullptr;
+		for (const BlockMode& candidate : oneRegionModes)
+		{
+			if (candidate.modeBits == modeBits)
+				mode = &candidate;
+		}
+		if (!mode)
+		{
+			std::memset(texels, 0, sizeof(float) * 16 * 3);
+			return;
+		}
+
+		int endpoints[2][3];
+		for (int c = 0; c < 3; ++c)
+			endpoints[0][c] = reader.read(10);
+
+		if (!mode->deltaBits)
+		{
+			for (int c = 0; c < 3; ++c)
+				endpoints[1][c] = reader.read(10);
+		}
+		else
+		{
+			int deltas[3];
+			for (int c = 0; c < 3; ++c)
+			{
+				deltas[c] = reader.read(mode->deltaBits);
+				endpoints[0][c] |= reader.readReversed(mode->endpointBits - 10) << 10;
+			}
+			int mask = (1 << mode->endpointBits) - 1;
+			int sign = 1 << (mode->deltaBits - 1);
+			for (int c = 0; c < 3; ++c)
+			{
+				int delta = (deltas[c] ^ sign) - sign;
+				endpoints[1][c] = (endpoints[0][c] + delta) & mask;
+			}
+		}
+
+		int indices[16];
+		indices[0] = reader.read(3);
+		for (int p = 1; p < 16; ++p)
+			indices[p] = reader.read(4);
+
+		for (int c = 0; c < 3; ++c)
+		{
+			int first = unquantize(endpoints[0][c], mode->endpointBits);
+			int second = unquantize(endpoints[1][c], mode->endpointBits);
+			for (int p = 0; p < 16; ++p)
+				texels[p][c] = halfToFloat(interpolate(first, second, indexWeights[indices[p]]));
+		}
+	}
+}
+
+const char* bc6hQualityName(BC6HQuality quality)
+{
+	return quality == BC6HQuality::Quality ? "quality" : "fast";
+}
+
+bool parseBC6HQuality(const std::string& name, BC6HQuality& quality)
+{
+	for (BC6HQuality candidate : {BC6HQuality::Fast, BC6HQuality::Quality})
+	{
+		if (name == bc6hQualityName(candidate))
+		{
+			quality = candidate;
+			return true;
+		}
+	}
+	return false;
+}
+
+size_t bc6hSize(int width, int height)
+{
+	return static_cast<size_t>((width + 3) / 4) * ((height + 3) / 4) * bc6hBlockBytes;
+}
+
+/*	Method compresses an image into unsigned BC6H blocks
+ *
+ *	rgb: width * height RGB floats
+ *	quality: fast only tries mode 11, quality all one region modes with refined endpoints
+ *	blocks: receives bc6hSize(width, height) bytes, block rows in the order of the image rows
+ *
+ *	Block rows are handed out to all hardware threads through an atomic counter
+ *	The two region modes are not used, they mostly pay off for sharp edges, which a prefiltered cubemap lacks
+ */
+void encodeBC6H(const float* rgb, int width, int height, BC6HQuality quality, unsigned char* blocks)
+{
+	const int blocksX = (width + 3) / 4;
+	const int blocksY = (height + 3) / 4;
+	std::atomic<int> nextRow(0);
+
+	auto worker = [&]()
+	{
+		Block block;
+		for (int y = nextRow++; y < blocksY; y = nextRow++)
+		{
+			for (int x = 0; x < blocksX; ++x)
+			{
+				loadBlock(rgb, width, height, x, y, block);
+				encodeBlock(block, quality, blocks + (static_cast<size_t>(y) * blocksX + x) * bc6hBlockBytes);
+			}
+		}
+	};
+
+	std::vector<std::thread> threads;
+	unsigned int threadCount = std::min(std::max(1u, std::thread::hardware_concurrency()),
+	                                    static_cast<unsigned int>(blocksY));
+	for (unsigned int t = 1; t < threadCount; ++t)
+		threads.emplace_back(worker);
+	worker();
+	for (std::thread& thread : threads)
+		thread.join();
+}
+
+void decodeBC6H(const unsigned char* blocks, int width, int height, float* rgb)
+{
+	const int blocksX = (width + 3) / 4;
+	const int blocksY = (height + 3) / 4;
+	float texels[16][3];
+
+	for (int y = 0; y < blocksY; ++y)
+	{
+		for (int x = 0; x < blocksX; ++x)
+		{
+			decodeBlock(blocks + (static_cast<size_t>(y) * blocksX + x) * bc6hBlockBytes, texels);
+			for (int p = 0; p < 16; ++p)
+			{
+				int texelX = x * 4 + p % 4;
+				int texelY = y * 4 + p / 4;
+				if (texelX >= width || texelY >= height)
+					continue;
+				std::memcpy(rgb + (static_cast<size_t>(texelY) * width + texelX) * 3, texels[p], sizeof(texels[p]));
+			}
+		}
+	}
+}
@@ -0,0 +1,28 @@
+#ifndef BC6H_ENCODER_H
+#define BC6H_ENCODER_H
+
+#include <cstddef>
+#include <string>
+
+//fast only uses the 10 bit one region mode with box endpoints
+//quality fits endpoints along the principal axis, refines them and tries every one region mode
+enum class BC6HQuality
+{
+	Fast,
+	Quality
+};
+
+const char* bc6hQualityName(BC6HQuality quality);
+bool parseBC6HQuality(const std::string& name, BC6HQuality& quality);
+
+//bytes of a width x height image as BC6H, every started 4x4 block takes 16 bytes
+size_t bc6hSize(int width, int height);
+
+//encodes RGB floats into unsigned BC6H blocks on all hardware threads, rows in upload order
+//negative values and NaN become 0, values above the half float range are clamped
+void encodeBC6H(const float* rgb, int width, int height, BC6HQuality quality, unsigned char* blocks);
+
+//decodes blocks written by encodeBC6H back into RGB floats, two region modes are not supported
+void decodeBC6H(const unsigned char* blocks, int width, int height, float* rgb);
+
+#endif
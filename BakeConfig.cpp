@@ -0,0 +1,334 @@
+#include "pch.h"
+#include "BakeConfig.h"
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+namespace
+{
+	std::string trim(const std::string& text)
+	{
+		size_t begin = text.find_first_not_of(" \t\r\n");
+		if (begin == std::string::npos)
+			return "";
+		size_t end = text.find_last_not_of(" \t\r\n");
+		return text.substr(begin, end - begin + 1);
+	}
+
+	bool parseInt(const std::string& value, int& result)
+	{
+		std::istringstream stream(value);
+		return static_cast<bool>(stream >> result) && stream.eof();
+	}
+
+	bool parseFloat(const std::string& value, float& result)
+	{
+		std::istringstream stream(value);
+		return static_cast<bool>(stream >> result) && stream.eof();
+	}
+
+	bool parseBool(const std::string& value, bool& result)
+	{
+		if (value == "1" || value == "true" || value == "yes" || value == "on")
+			result = true;
+		else if (value == "0" || value == "false" || value == "no" || value == "off")
+			result = false;
+		else
+			return false;
+		return true;
+	}
+
+	//comma separated list of positive integers
+	bool parseIntList(const std::string& value, std::vector<int>& result)
+	{
+		std::vector<int> list;
+		std::istringstream stream(value);
+		std::string item;
+		while (std::getline(stream, item, ','))
+		{
+			int number;
+			if (!parseInt(trim(item), number) || number <= 0)
+				return false;
+			list.push_back(number);
+		}
+		result = list;
+		return true;
+	}
+
+	//command line switches that do not take a value
+	bool applySwitch(BakeConfig& config, const std::string& name)
+	{
+		if (name == "no-rotation")
+			config.rotateSamples = false;
+		else if (name == "no-light-extraction")
+			config.extractLights = false;
+		else if (name == "heatmap")
+			config.sampleHeatmap = true;
+		else if (name == "dump-faces")
+			config.dumpFaces = true;
+		else if (name == "compare-sample-sets")
+			config.compareSampleSets = true;
+		else if (name == "no-specialize")
+			config.specializeShaders = false;
+		else if (name == "compare-variants")
+			config.compareVariants = true;
+		else if (name == "tune")
+			config.tune = true;
+		else if (name == "rebake")
+			config.rebake = true;
+		else if (name == "watch-shaders")
+			config.watchShaders = true;
+		else if (name == "benchmark-sphere")
+			config.benchmarkSphere = true;
+		else if (name == "impostor")
+			config.impostor = true;
+		else if (name == "no-compact-mesh")
+			config.compactMesh = false;
+		else
+			return false;
+		return true;
+	}
+}
+
+int BakeConfig::mipLevels() const
+{
+	int fullChain = 1;
+	while ((cubeMapSize >> fullChain) > 0)
+		++fullChain;
+
+	if (mipCount <= 0)
+		return fullChain;
+	return std::min(mipCount, fullChain);
+}
+
+int BakeConfig::mipResolution(int level) const
+{
+	return std::max(1, cubeMapSize >> level);
+}
+
+float BakeConfig::specularExponent(int level) const
+{
+	//the exponent falls from 2^15 at the base level to 1 at the last one
+	int lastLevel = mipLevels() - 1;
+	float exponent = lastLevel > 0 ? 1.0f - static_cast<float>(level) / lastLevel : 1.0f;
+	return std::pow(2.0f, 15.0f * exponent);
+}
+
+int BakeConfig::levelNumOfPoints(int level, int numOfPoints) const
+{
+	if (level < static_cast<int>(mipSamples.size()))
+		return mipSamples[level];
+	return numOfPoints;
+}
+
+std::string replaceExtension(const std::string& path, const std::string& extension)
+{
+	size_t slash = path.find_last_of("/\\");
+	size_t dot = path.find_last_of('.');
+	if (dot == std::string::npos || (slash != std::string::npos && dot < slash))
+		return path + extension;
+	return path.substr(0, dot) + extension;
+}
+
+const char* engineName(BakeEngine engine)
+{
+	switch (engine)
+	{
+	case BakeEngine::Compute: return "compute";
+	case BakeEngine::Cpu: return "cpu";
+	default: return "raster";
+	}
+}
+
+const char* formatName(StorageFormat format)
+{
+	switch (format)
+	{
+	case StorageFormat::RGBA16F: return "rgba16f";
+	case StorageFormat::BC6H: return "bc6h";
+	default: return "rgb32f";
+	}
+}
+
+bool applyBakeSetting(BakeConfig& config, const std::string& key, const std::string& value)
+{
+	if (key == "env")
+	{
+		config.environmentMap = value;
+		return !value.empty();
+	}
+	if (key == "size")
+		return parseInt(value, config.cubeMapSize) && config.cubeMapSize > 0;
+	if (key == "mips")
+		return parseInt(value, config.mipCount) && config.mipCount >= 0;
+	if (key == "samples")
+		return parseInt(value, config.numOfPoints) && config.numOfPoints > 0;
+	if (key == "residual-samples")
+		return parseInt(value, config.residualNumOfPoints) && config.residualNumOfPoints > 0;
+	if (key == "mip-samples")
+		return parseIntList(value, config.mipSamples);
+	if (key == "error-threshold")
+		return parseFloat(value, config.errorThreshold) && config.errorThreshold >= 0.0f;
+	if (key == "light-threshold")
+		return parseFloat(value, config.lightThreshold);
+	if (key == "rotation")
+		return parseBool(value, config.rotateSamples);
+	if (key == "extract-lights")
+		return parseBool(value, config.extractLights);
+	if (key == "heatmap")
+		return parseBool(value, config.sampleHeatmap);
+	if (key == "dump-faces")
+		return parseBool(value, config.dumpFaces);
+	if (key == "compare-sample-sets")
+		return parseBool(value, config.compareSampleSets);
+	if (key == "specialize")
+		return parseBool(value, config.specializeShaders);
+	if (key == "compare-variants")
+		return parseBool(value, config.compareVariants);
+	if (key == "benchmark-bakes")
+		return parseInt(value, config.benchmarkBakes) && config.benchmarkBakes >= 0;
+	if (key == "tune")
+		return parseBool(value, config.tune);
+	if (key == "baked-cubemap")
+	{
+		config.bakedCubemap = value;
+		return true;
+	}
+	if (key == "rebake")
+		return parseBool(value, config.rebake);
+	if (key == "publish")
+	{
+		config.publish = value;
+		return true;
+	}
+	if (key == "consume")
+	{
+		config.consume = value;
+		return !value.empty();
+	}
+	if (key == "shader-dir")
+	{
+		config.shaderDirectory = value;
+		return true;
+	}
+	if (key == "program-cache")
+	{
+		config.programCache = value;
+		return true;
+	}
+	if (key == "benchmark-sphere")
+		return parseBool(value, config.benchmarkSphere);
+	if (key == "impostor")
+		return parseBool(value, config.impostor);
+	if (key == "preview-grid")
+		return parseInt(value, config.previewGrid) && config.previewGrid >= 0;
+	if (key == "compact-mesh")
+		return parseBool(value, config.compactMesh);
+	if (key == "watch-shaders")
+		return parseBool(value, config.watchShaders);
+	if (key == "tune-psnr")
+		return parseFloat(value, config.tunePsnr);
+	if (key == "tune-delta-e")
+		return parseFloat(value, config.tuneDeltaE) && config.tuneDeltaE >= 0.0f;
+	if (key == "tune-reference-samples")
+		return parseInt(value, config.tuneReferenceSamples) && config.tuneReferenceSamples >= 0;
+	if (key == "bc6h-quality")
+		return parseBC6HQuality(value, config.bc6hQuality);
+	if (key == "sample-set")
+		return parseSampleSet(value, config.sampleSet);
+
+	if (key == "format")
+	{
+		for (StorageFormat format : {StorageFormat::RGB32F, StorageFormat::RGBA16F, StorageFormat::BC6H})
+		{
+			if (value == formatName(format))
+			{
+				config.format = format;
+				return true;
+			}
+		}
+		return false;
+	}
+
+	if (key == "engine")
+	{
+		for (BakeEngine engine : {BakeEngine::Raster, BakeEngine::Compute, BakeEngine::Cpu})
+		{
+			if (value == engineName(engine))
+			{
+				config.engine = engine;
+				return true;
+			}
+		}
+		return false;
+	}
+
+	return false;
+}
+
+bool loadBakeConfig(const std::string& path, BakeConfig& config)
+{
+	std::ifstream file(path);
+	if (!file)
+	{
+		std::cout << "Could not open bake config " << path << std::endl;
+		return false;
+	}
+
+	bool valid = true;
+	std::string line;
+	for (int lineNumber = 1; std::getline(file, line); ++lineNumber)
+	{
+		line = trim(line.substr(0, line.find('#')));
+		if (line.empty())
+			continue;
+
+		size_t separator = line.find('=');
+		std::string key = trim(line.substr(0, separator));
+		std::string value = separator == std::string::npos ? "" : trim(line.substr(separator + 1));
+
+		if (!applyBakeSetting(config, key, value))
+		{
+			std::cout << path << ":" << lineNumber << ": invalid setting " << line << std::endl;
+			valid = false;
+		}
+	}
+	return valid;
+}
+
+bool parseBakeArguments(int argc, char** argv, BakeConfig& config)
+{
+	bool valid = true;
+	for (int i = 1; i < argc; ++i)
+	{
+		std::string argument = argv[i];
+		if (argument.compare(0, 2, "--") != 0)
+		{
+			config.environmentMap = argument;
+			continue;
+		}
+
+		std::string name = argument.substr(2);
+		if (applySwitch(config, name))
+			continue;
+
+		if (i + 1 >= argc)
+		{
+			std::cout << "Missing value for " << argument << std::endl;
+			valid = false;
+			break;
+		}
+
+		std::string value = argv[++i];
+		if (name == "config")
+			valid = loadBakeConfig(value, config) && valid;
+		else if (!applyBakeSetting(config, name, value))
+		{
+			std::cout << "Invalid argument " << argument << " " << value << std::endl;
+			valid = false;
+		}
+	}
+	return valid;
+}
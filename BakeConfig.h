@@ -0,0 +1,129 @@
+#ifndef BAKE_CONFIG_H
+#define BAKE_CONFIG_H
+
+#include <string>
+#include <vector>
+#include "BC6HEncoder.h"
+#include "SampleSets.h"
+
+//where the prefilter runs
+enum class BakeEngine
+{
+	Raster,
+	Compute,
+	Cpu
+};
+
+//internal format of the baked cubemap
+enum class StorageFormat
+{
+	RGB32F,
+	RGBA16F,
+	//compressed on the CPU after the prefilter
+	BC6H
+};
+
+//everything that decides resolution, quality and cost of a bake, replaces the former compile time #defines
+//set from the command line, a config file or both, see applyBakeSetting for the keys
+struct BakeConfig
+{
+	std::string environmentMap = "cedar_bridge_1k1.hdr";
+
+	int cubeMapSize = 512;
+	//0 bakes the full chain down to 1x1
+	int mipCount = 0;
+
+	int numOfPoints = 2048;
+	//sample count for the residual once the dominant lights have been extracted
+	int residualNumOfPoints = 256;
+	//optional per level sample counts, usually written by the tuner, levels without an entry use the cap of the bake
+	std::vector<int> mipSamples;
+
+	StorageFormat format = StorageFormat::RGB32F;
+	BC6HQuality bc6hQuality = BC6HQuality::Fast;
+	BakeEngine engine = BakeEngine::Raster;
+
+	SampleSet sampleSet = SampleSet::Hammersley;
+	bool rotateSamples = true;
+	//adaptive sampling stops a texel once the relative error of its estimate drops below this value, 0 disables it
+	float errorThreshold = 0.01f;
+
+	//a region has to be lightThreshold times brighter than the average to count as a light
+	bool extractLights = true;
+	float lightThreshold = 50.0f;
+
+	//write a PNG per mip level showing how many samples every texel needed
+	bool sampleHeatmap = false;
+	//write every level as HDR strip of its six faces for debugging the prefilter
+	bool dumpFaces = false;
+	//print error and timing of every point set against a reference instead of opening the viewer
+	bool compareSampleSets = false;
+	//GPU engines run a program per level with its sample cap and specular exponent compiled in
+	bool specializeShaders = true;
+	//time every level with the generic and the specialized program instead of opening the viewer
+	bool compareVariants = false;
+	//bake the environment this many times through a CubemapBaker and print the setup time instead of opening the viewer
+	int benchmarkBakes = 0;
+
+	//time generateSphere against createSphereCoordinates on a 2048x1024 sphere instead of opening the viewer
+	bool benchmarkSphere = false;
+
+	//finished bakes are saved here and loaded instead of baking again while the settings match
+	//empty uses the environment map path with the extension .cubemap
+	std::string bakedCubemap;
+	//bake even if a matching baked cubemap exists
+	bool rebake = false;
+
+	//name of a shared memory segment every level is published into as soon as it is done, empty disables it
+	std::string publish;
+	//instead of opening the viewer, follow the segment of that name from another process and report the latency
+	std::string consume;
+
+	//draw the sphere from octahedral snorm16 normals and 16 bit indices instead of position and normal floats
+	bool compactMesh = true;
+
+	//trace the sphere per pixel on a single quad instead of drawing a mesh
+	bool impostor = false;
+	//draw this many spheres in one instanced call, a grid across roughness and exposure, 0 draws the single sphere
+	int previewGrid = 0;
+
+	//shader files in this directory replace the ones embedded in the executable, empty uses only the embedded ones
+	std::string shaderDirectory;
+	//linked program binaries are cached in this directory, empty uses the directory of the executable
+	std::string programCache;
+	//recompile shaders saved in the shader directory while the viewer runs, a changed bake shader also re-bakes
+	bool watchShaders = false;
+
+	//search the cheapest sampling settings that stay within tunePsnr and tuneDeltaE of a reference bake
+	bool tune = false;
+	float tunePsnr = 40.0f;
+	float tuneDeltaE = 1.0f;
+	//sample count of the reference, 0 uses 4 times the cap of the bake
+	int tuneReferenceSamples = 0;
+
+	//number of levels after resolving 0 and clamping to the resolution
+	int mipLevels() const;
+	int mipResolution(int level) const;
+	//specular exponent the prefilter uses for the given level, the last level is the roughest
+	float specularExponent(int level) const;
+	//sample cap of the given level, numOfPoints unless mipSamples has an entry for it
+	int levelNumOfPoints(int level, int numOfPoints) const;
+};
+
+//path with the part after the last dot of the file name replaced by extension, which includes the dot
+std::string replaceExtension(const std::string& path, const std::string& extension);
+
+const char* engineName(BakeEngine engine);
+const char* formatName(StorageFormat format);
+
+//sets one option by its key, returns false for unknown keys or malformed values
+bool applyBakeSetting(BakeConfig& config, const std::string& key, const std::string& value);
+
+//reads "key = value" lines, # starts a comment
+bool loadBakeConfig(const std::string& path, BakeConfig& config);
+
+//parses --key value pairs and switches in order, --config file loads a file at that position
+//a single argument without dashes is taken as the environment map
+bool parseBakeArguments(int argc, char** argv, BakeConfig& config);
+
+#endif
@@ -0,0 +1,350 @@
+#include "pch.h"
+#include "BakeTuner.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include "BakedCubemap.h"
+
+//smallest sample count the tuner tries per texel
+#define minTuneSamples 16
+
+namespace
+{
+	//sampling strategies the tuner compares, the rotation is always on since it only ever lowered the error
+	//blue noise is left out, it was worse than both low discrepancy sets in every measurement
+	struct Strategy
+	{
+		SampleSet set;
+		float errorThreshold;
+	};
+
+	const Strategy strategies[] = {
+		{SampleSet::Hammersley, 0.0f}, {SampleSet::Hammersley, 0.02f}, {SampleSet::Hammersley, 0.01f},
+		{SampleSet::OwenSobol, 0.0f}, {SampleSet::OwenSobol, 0.02f}, {SampleSet::OwenSobol, 0.01f}
+	};
+
+	float tonemap(float value)
+	{
+		return value / (1.0f + value);
+	}
+
+	//CIELAB of a linear sRGB color with D65 white
+	glm::vec3 toLab(glm::vec3 rgb)
+	{
+		float x = (0.4124f * rgb.x + 0.3576f * rgb.y + 0.1805f * rgb.z) / 0.95047f;
+		float y = 0.2126f * rgb.x + 0.7152f * rgb.y + 0.0722f * rgb.z;
+		float z = (0.0193f * rgb.x + 0.1192f * rgb.y + 0.9505f * rgb.z) / 1.08883f;
+
+		auto f = [](float t)
+		{
+			return t > 0.008856f ? std::cbrt(t) : 7.787f * t + 16.0f / 116.0f;
+		};
+		return glm::vec3(116.0f * f(y) - 16.0f, 500.0f * (f(x) - f(y)), 200.0f * (f(y) - f(z)));
+	}
+
+	//sample counts the search runs over, powers of two up to the cap and the cap itself
+	std::vector<int> sampleCounts(int numOfPoints)
+	{
+		std::vector<int> counts;
+		for (int count = minTuneSamples; count < numOfPoints; count *= 2)
+			counts.push_back(count);
+		counts.push_back(numOfPoints);
+		return counts;
+	}
+
+	struct LevelResult
+	{
+		int numOfPoints;
+		float averageSamples;
+		BakeQuality quality;
+		bool met;
+	};
+}
+
+BakeQuality measureBakeQuality(const float* result, const float* reference, size_t texels)
+{
+	double squared = 0.0;
+	double deltaE = 0.0;
+	for (size_t t = 0; t < texels; ++t)
+	{
+		glm::vec3 a(tonemap(result[t * 3]), tonemap(result[t * 3 + 1]), tonemap(result[t * 3 + 2]));
+		glm::vec3 b(tonemap(reference[t * 3]), tonemap(reference[t * 3 + 1]), tonemap(reference[t * 3 + 2]));
+		glm::vec3 difference = a - b;
+		squared += glm::dot(difference, difference);
+		deltaE += glm::length(toLab(a) - toLab(b));
+	}
+
+	double mse = squared / (texels * 3);
+	BakeQuality quality;
+	//tonemapped values peak at 1, identical bakes are reported with a finite 100 dB
+	quality.psnr = mse > 0.0 ? static_cast<float>(std::min(100.0, -10.0 * std::log10(mse))) : 100.0f;
+	quality.deltaE = static_cast<float>(deltaE / texels);
+	return quality;
+}
+
+/*	Method searches the cheapest sampling settings that reproduce a reference bake
+ *
+ *	config: resolution, mip count and engine of the bake as well as the quality target
+ *	resources: GL objects from createBakeResources with the same config
+ *	source: the environment as texture and as decoded data, after the light extraction if there was one
+ *	numOfPoints: sample cap per texel
+ *
+ *	The reference uses non rotated Hammersley points with config.tuneReferenceSamples, or 4 times the cap
+ *	Every strategy gets its own per level schedule, a binary search over the sample counts finds the smallest one
+ *	per level that meets the target, this assumes the error falls with the sample count
+ *	The cost of a schedule is the number of sample evaluations, so adaptive strategies count the samples actually taken
+ */
+BakeProfile tuneBake(const BakeConfig& config, BakeResources& resources, const BakeSource& source, int numOfPoints)
+{
+	auto start = std::chrono::steady_clock::now();
+	const BakeEngine engine = resolveEngine(config, resources, source);
+	const int mipLevels = config.mipLevels();
+
+	BakeProfile profile;
+	profile.referenceSamples = config.tuneReferenceSamples > 0 ? config.tuneReferenceSamples : 4 * numOfPoints;
+
+	//reference bake of every level
+	//-------------------------------------------------------------------------
+	//every trial has its own sample count, specializing each of them would cost more compiles than it saves
+	BakeConfig referenceConfig = config;
+	referenceConfig.specializeShaders = false;
+	referenceConfig.sampleSet = SampleSet::Hammersley;
+	referenceConfig.rotateSamples = false;
+	referenceConfig.errorThreshold = 0.0f;
+	uploadSamplePoints(referenceConfig, resources, profile.referenceSamples);
+
+	std::vector<std::vector<float>> reference(mipLevels);
+	double untunedCost = 0.0;
+	for (int mipLevel = 0; mipLevel < mipLevels; ++mipLevel)
+	{
+		int texels = 6 * config.mipResolution(mipLevel) * config.mipResolution(mipLevel);
+		reference[mipLevel].resize(texels * 3);
+		bakeLevel(referenceConfig, resources, source, engine, mipLevel, profile.referenceSamples,
+		          reference[mipLevel].data());
+		untunedCost += static_cast<double>(texels) * numOfPoints;
+	}
+
+	std::printf("Tuning for psnr >= %.1f dB and delta e <= %.2f against %d reference samples on the %s engine\n",
+	            config.tunePsnr, config.tuneDeltaE, profile.referenceSamples, engineName(engine));
+	std::printf("%-11s %-9s %8s  %s\n", "set", "threshold", "cost", "samples per level");
+
+	const std::vector<int> counts = sampleCounts(numOfPoints);
+	double bestCost = -1.0;
+
+	for (const Strategy& strategy : strategies)
+	{
+		BakeConfig candidate = config;
+		candidate.specializeShaders = false;
+		candidate.sampleSet = strategy.set;
+		candidate.errorThreshold = strategy.errorThreshold;
+		candidate.rotateSamples = true;
+		candidate.mipSamples.clear();
+		uploadSamplePoints(candidate, resources, numOfPoints);
+
+		std::vector<LevelResult> levels;
+		double cost = 0.0;
+		bool met = true;
+
+		for (int mipLevel = 0; mipLevel < mipLevels; ++mipLevel)
+		{
+			int texels = 6 * config.mipResolution(mipLevel) * config.mipResolution(mipLevel);
+			std::vector<float> faces(texels * 3);
+			std::vector<float> samplesTaken(texels);
+
+			//bakes and measures one sample count, every count is evaluated at most once
+			std::map<int, LevelResult> evaluated;
+			auto evaluate = [&](int index) -> const LevelResult&
+			{
+				auto found = evaluated.find(index);
+				if (found != evaluated.end())
+					return found->second;
+
+				LevelResult result;
+				result.numOfPoints = counts[index];
+				bool adaptive = strategy.errorThreshold > 0.0f;
+				bakeLevel(candidate, resources, source, engine, mipLevel, result.numOfPoints, faces.data(),
+				          adaptive ? samplesTaken.data() : nullptr);
+
+				result.averageSamples = static_cast<float>(result.numOfPoints);
+				if (adaptive)
+				{
+					double fraction = 0.0;
+					for (float taken : samplesTaken)
+						fraction += taken;
+					result.averageSamples = static_cast<float>(result.numOfPoints * fraction / texels);
+				}
+				result.quality = measureBakeQuality(faces.data(), reference[mipLevel].data(), texels);
+				result.met = result.quality.psnr >= config.tunePsnr && result.quality.deltaE <= config.tuneDeltaE;
+				return evaluated.emplace(index, result).first->second;
+			};
+
+			//smallest count that meets the target, the cap if none does
+			int low = 0;
+			int high = static_cast<int>(counts.size()) - 1;
+			while (low < high)
+			{
+				int middle = (low + high) / 2;
+				if (evaluate(middle).met)
+					high = middle;
+				else
+					low = middle + 1;
+			}
+
+			const LevelResult& chosen = evaluate(low);
+			met = met && chosen.met;
+			cost += static_cast<double>(texels) * chosen.averageSamples;
+			levels.push_back(chosen);
+		}
+
+		std::printf("%-11s %-9.3f %7.1f%%  ", sampleSetName(strategy.set), strategy.errorThreshold,
+		            100.0 * cost / untunedCost);
+		for (const LevelResult& level : levels)
+			std::printf("%d%s", level.numOfPoints, level.met ? " " : "! ");
+		std::printf("\n");
+
+		//a schedule that meets the target always beats one that does not
+		bool better = bestCost < 0.0 || (met && !profile.targetMet) || (met == profile.targetMet && cost < bestCost);
+		if (!better)
+			continue;
+
+		bestCost = cost;
+		profile.config = candidate;
+		profile.config.tune = false;
+		profile.config.specializeShaders = config.specializeShaders;
+		profile.quality.clear();
+		profile.averageSamples.clear();
+		for (const LevelResult& level : levels)
+		{
+			profile.config.mipSamples.push_back(level.numOfPoints);
+			profile.quality.push_back(level.quality);
+			profile.averageSamples.push_back(level.averageSamples);
+		}
+		profile.relativeCost = static_cast<float>(bestCost / untunedCost);
+		profile.targetMet = met;
+	}
+
+	double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	std::cout << "Chose " << sampleSetName(profile.config.sampleSet) << " with error threshold "
+		<< profile.config.errorThreshold << " at " << 100.0f * profile.relativeCost << "% of the untuned cost"
+		<< (profile.targetMet ? "" : ", some levels miss the target at the cap (marked !)") << ", tuning took "
+		<< milliseconds << " ms" << std::endl;
+	return profile;
+}
+
+/*	Method compares the generic prefilter program with the variants compiled per level
+ *
+ *	config: bake settings, the engine has to be raster or compute
+ *	resources: GL objects from createBakeResources with the same config
+ *	source: the environment as texture
+ *	numOfPoints: sample cap of the bake, levels with an entry in config.mipSamples use that count
+ *
+ *	Every program bakes each level once to compile and warm it up, then the best of a few timed runs is printed
+ *	The bakes read their levels back, so the time includes the GPU work
+ */
+void compareShaderVariants(const BakeConfig& config, BakeResources& resources, const BakeSource& source,
+                           int numOfPoints)
+{
+	const BakeEngine engine = resolveEngine(config, resources, source);
+	if (engine == BakeEngine::Cpu)
+	{
+		std::cout << "Shader variants only exist for the raster and compute engines" << std::endl;
+		return;
+	}
+
+	BakeConfig generic = config;
+	generic.specializeShaders = false;
+	BakeConfig specialized = config;
+	specialized.specializeShaders = true;
+
+	int maxNumOfPoints = 1;
+	for (int mipLevel = 0; mipLevel < config.mipLevels(); ++mipLevel)
+		maxNumOfPoints = std::max(maxNumOfPoints, config.levelNumOfPoints(mipLevel, numOfPoints));
+	uploadSamplePoints(config, resources, maxNumOfPoints);
+
+	const int runs = 3;
+	auto timeLevel = [&](const BakeConfig& variant, int mipLevel, int samples, float* faces)
+	{
+		bakeLevel(variant, resources, source, engine, mipLevel, samples, faces);
+		double best = -1.0;
+		for (int run = 0; run < runs; ++run)
+		{
+			glFinish();
+			auto start = std::chrono::steady_clock::now();
+			bakeLevel(variant, resources, source, engine, mipLevel, samples, faces);
+			double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+			best = best < 0.0 ? milliseconds : std::min(best, milliseconds);
+		}
+		return best;
+	};
+
+	std::printf("Shader variants on the %s engine, best of %d runs\n", engineName(engine), runs);
+	std::printf("%-5s %6s %8s %11s %15s %8s %9s\n", "level", "size", "samples", "generic ms", "specialized ms",
+	            "speedup", "psnr");
+
+	double genericTotal = 0.0;
+	double specializedTotal = 0.0;
+	for (int mipLevel = 0; mipLevel < config.mipLevels(); ++mipLevel)
+	{
+		const int size = config.mipResolution(mipLevel);
+		const int samples = config.levelNumOfPoints(mipLevel, numOfPoints);
+		std::vector<float> genericFaces(6 * size * size * 3);
+		std::vector<float> specializedFaces(genericFaces.size());
+
+		double genericMilliseconds = timeLevel(generic, mipLevel, samples, genericFaces.data());
+		double specializedMilliseconds = timeLevel(specialized, mipLevel, samples, specializedFaces.data());
+		genericTotal += genericMilliseconds;
+		specializedTotal += specializedMilliseconds;
+
+		//both compute the same sum, only reordered by the compiler
+		BakeQuality quality = measureBakeQuality(specializedFaces.data(), genericFaces.data(), 6 * size * size);
+		std::printf("%-5d %6d %8d %11.3f %15.3f %7.2fx %6.1f dB\n", mipLevel, size, samples, genericMilliseconds,
+		            specializedMilliseconds, genericMilliseconds / std::max(specializedMilliseconds, 1e-6),
+		            quality.psnr);
+	}
+	std::printf("total %25.3f %15.3f %7.2fx\n", genericTotal, specializedTotal,
+	            genericTotal / std::max(specializedTotal, 1e-6));
+}
+
+bool writeBakeProfile(const std::string& path, const BakeProfile& profile)
+{
+	std::ofstream file(path);
+	if (!file)
+	{
+		std::cout << "Could not write bake profile " << path << std::endl;
+		return false;
+	}
+
+	const BakeConfig& config = profile.config;
+	file << "# bake profile for " << config.environmentMap << ", load it with --config\n";
+	file << "# target psnr " << config.tunePsnr << " dB, delta e " << config.tuneDeltaE << ", reference "
+		<< profile.referenceSamples << " samples, cost " << 100.0f * profile.relativeCost << "% of the untuned bake"
+		<< (profile.targetMet ? "" : ", target not met on every level") << "\n";
+	file << "size = " << config.cubeMapSize << "\n";
+	file << "mips = " << config.mipLevels() << "\n";
+	file << "extract-lights = " << (config.extractLights ? "true" : "false") << "\n";
+	file << "sample-set = " << sampleSetName(config.sampleSet) << "\n";
+	file << "rotation = " << (config.rotateSamples ? "true" : "false") << "\n";
+	file << "error-threshold = " << config.errorThreshold << "\n";
+
+	file << "mip-samples = ";
+	for (size_t level = 0; level < config.mipSamples.size(); ++level)
+		file << (level ? "," : "") << config.mipSamples[level];
+	file << "\n";
+
+	file << "# mip, samples, average samples taken, psnr, delta e\n";
+	for (size_t level = 0; level < profile.quality.size(); ++level)
+	{
+		file << "# " << level << ", " << config.mipSamples[level] << ", " << profile.averageSamples[level] << ", "
+			<< profile.quality[level].psnr << ", " << profile.quality[level].deltaE << "\n";
+	}
+	return static_cast<bool>(file);
+}
+
+std::string bakeProfilePath(const BakeConfig& config)
+{
+	return replaceExtension(bakedCubemapPath(config), ".bakeprofile");
+}
@@ -0,0 +1,49 @@
+#ifndef BAKE_TUNER_H
+#define BAKE_TUNER_H
+
+#include <string>
+#include <vector>
+#include "Baker.h"
+
+//difference of a bake to the reference, both measured on Reinhard tonemapped values
+struct BakeQuality
+{
+	float psnr;
+	//mean CIE76 color difference, values below 1 are not noticeable side by side
+	float deltaE;
+};
+
+//outcome of tuneBake, config holds the chosen sample set, threshold and per level sample counts
+struct BakeProfile
+{
+	BakeConfig config;
+	std::vector<BakeQuality> quality;
+	//samples every texel of a level took on average, lower than the cap with adaptive sampling
+	std::vector<float> averageSamples;
+	int referenceSamples = 0;
+	//sample evaluations of the whole bake, relative to the untuned one with the cap on every level
+	float relativeCost = 1.0f;
+	//false if some level missed the target even at the cap
+	bool targetMet = false;
+};
+
+//compares texels RGB floats of a bake against the reference
+BakeQuality measureBakeQuality(const float* result, const float* reference, size_t texels);
+
+//bakes a reference once, then searches sample set, adaptive threshold and the sample count of every level
+//for the cheapest bake that stays within config.tunePsnr and config.tuneDeltaE of it
+//numOfPoints is the sample cap of the bake, no level is given more
+BakeProfile tuneBake(const BakeConfig& config, BakeResources& resources, const BakeSource& source, int numOfPoints);
+
+//bakes every level with the generic and the specialized program of the configured GPU engine and prints the time of
+//both and the PSNR between their results, numOfPoints is the sample cap of the bake
+void compareShaderVariants(const BakeConfig& config, BakeResources& resources, const BakeSource& source,
+                           int numOfPoints);
+
+//the profile is a bake config file, --config loads it again
+bool writeBakeProfile(const std::string& path, const BakeProfile& profile);
+
+//path of the baked cubemap of config with its extension replaced by .bakeprofile, so the profile sits next to the bake
+std::string bakeProfilePath(const BakeConfig& config);
+
+#endif
@@ -0,0 +1,405 @@
+#include "pch.h"
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+#include "BakedCubemap.h"
+#include <sys/stat.h>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <vector>
+#include "Baker.h"
+
+//bump whenever the layout below changes, older files are then baked again
+#define bakedCubemapVersion 2
+
+namespace
+{
+	//the file is this header followed by every level from the coarsest one on, each level holds the faces +X to -Z
+	//this is the order the levels are streamed in, so the file is still read front to back
+	//texels are stored in the format and type they are uploaded with, BC6H faces as blocks
+	struct BakedCubemapHeader
+	{
+		char magic[8];
+		unsigned int version;
+		unsigned int size;
+		unsigned int mipLevels;
+		unsigned int internalFormat;
+		//0 for compressed formats
+		unsigned int format;
+		unsigned int type;
+		unsigned long long settingsHash;
+		unsigned long long dataBytes;
+	};
+
+	const char bakedCubemapMagic[8] = {'C', 'U', 'B', 'E', 'M', 'A', 'P', '\0'};
+
+
+	size_t storedFaceBytes(const StoredLayout& layout, int size)
+	{
+		if (layout.bytesPerTexel == 0)
+			return bc6hSize(size, size);
+		return layout.bytesPerTexel * size * size;
+	}
+}
+
+//read only view of a whole file, the pages are only read when they are touched
+//declared in the header so a load stream can keep the file mapped between levels
+class MappedFile
+{
+public:
+	explicit MappedFile(const std::string& path)
+	{
+#ifdef _WIN32
+		file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+		                   FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+		LARGE_INTEGER fileSize;
+		if (file == INVALID_HANDLE_VALUE || !GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0)
+			return;
+		mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if (!mapping)
+			return;
+		view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+		if (view)
+			bytes = static_cast<size_t>(fileSize.QuadPart);
+#else
+		file = open(path.c_str(), O_RDONLY);
+		struct stat info;
+		if (file < 0 || fstat(file, &info) != 0 || info.st_size == 0)
+			return;
+		void* address = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+		if (address == MAP_FAILED)
+			return;
+		madvise(address, info.st_size, MADV_SEQUENTIAL);
+		view = address;
+		bytes = static_cast<size_t>(info.st_size);
+#endif
+	}
+
+	~MappedFile()
+	{
+#ifdef _WIN32
+		if (view)
+			UnmapViewOfFile(view);
+		if (mapping)
+			CloseHandle(mapping);
+		if (file != INVALID_HANDLE_VALUE)
+			CloseHandle(file);
+#else
+		if (view)
+			munmap(view, bytes);
+		if (file >= 0)
+			close(file);
+#endif
+	}
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	const unsigned char* data() const { return static_cast<const unsigned char*>(view); }
+	size_t size() const { return bytes; }
+
+private:
+#ifdef _WIN32
+	HANDLE file = INVALID_HANDLE_VALUE;
+	HANDLE mapping = nullptr;
+#else
+	int file = -1;
+#endif
+	void* view = nullptr;
+	size_t bytes = 0;
+};
+
+StoredLayout storedLayout(StorageFormat format)
+{
+	switch (format)
+	{
+	//halfs are stored as they are, the bake uploads floats that GL converts
+	case StorageFormat::RGBA16F: return {GL_RGBA, GL_HALF_FLOAT, 8};
+	case StorageFormat::BC6H: return {0, 0, 0};
+	default: return {GL_RGB, GL_FLOAT, 12};
+	}
+}
+
+size_t storedLevelBytes(const BakeConfig& config, int mipLevel)
+{
+	return 6 * storedFaceBytes(storedLayout(config.format), config.mipResolution(mipLevel));
+}
+
+size_t storedDataBytes(const BakeConfig& config)
+{
+	size_t bytes = 0;
+	for (int mipLevel = 0; mipLevel < config.mipLevels(); ++mipLevel)
+		bytes += storedLevelBytes(config, mipLevel);
+	return bytes;
+}
+
+void readStoredLevel(const BakeConfig& config, int mipLevel, unsigned int cubeMapTexture, unsigned char* faces)
+{
+	const StoredLayout layout = storedLayout(config.format);
+	const size_t faceBytes = storedFaceBytes(layout, config.mipResolution(mipLevel));
+	glBindTexture(GL_TEXTURE_CUBE_MAP, cubeMapTexture);
+	for (int i = 0; i < 6; ++i)
+	{
+		if (layout.bytesPerTexel == 0)
+			glGetCompressedTexImage(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, mipLevel, faces + i * faceBytes);
+		else
+			glGetTexImage(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, mipLevel, layout.format, layout.type, faces + i * faceBytes);
+	}
+}
+
+unsigned long long bakeSettingsHash(const BakeConfig& config, int numOfPoints)
+{
+	//a changed environment file is detected by its size and modification time
+	struct stat info = {};
+	stat(config.environmentMap.c_str(), &info);
+
+	std::ostringstream settings;
+	settings << bakedCubemapVersion << ' ' << config.environmentMap << ' ' << info.st_size << ' ' << info.st_mtime
+		<< ' ' << config.cubeMapSize << ' ' << config.mipLevels() << ' ' << formatName(config.format) << ' '
+		<< bc6hQualityName(config.bc6hQuality) << ' ' << engineName(config.engine) << ' '
+		<< sampleSetName(config.sampleSet) << ' ' << config.rotateSamples << ' ' << config.errorThreshold << ' '
+		<< config.extractLights << ' ' << config.lightThreshold << ' ' << config.specializeShaders;
+	for (int mipLevel = 0; mipLevel < config.mipLevels(); ++mipLevel)
+		settings << ' ' << config.levelNumOfPoints(mipLevel, numOfPoints);
+	//the GPU engines bake what their shaders compute, an edited shader is another bake
+	if (config.engine != BakeEngine::Cpu)
+		settings << ' ' << bakeProgramsHash();
+
+	//64 bit FNV-1a
+	unsigned long long hash = 14695981039346656037ull;
+	for (char c : settings.str())
+	{
+		hash ^= static_cast<unsigned char>(c);
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
+
+std::string bakedCubemapPath(const BakeConfig& config)
+{
+	if (!config.bakedCubemap.empty())
+		return config.bakedCubemap;
+	return replaceExtension(config.environmentMap, ".cubemap");
+}
+
+bool saveBakedCubemap(const std::string& path, const BakeConfig& config, unsigned long long settingsHash,
+                      unsigned int cubeMapTexture)
+{
+	const StoredLayout layout = storedLayout(config.format);
+
+	BakedCubemapHeader header;
+	std::memcpy(header.magic, bakedCubemapMagic, sizeof(header.magic));
+	header.version = bakedCubemapVersion;
+	header.size = config.cubeMapSize;
+	header.mipLevels = config.mipLevels();
+	header.internalFormat = storageInternalFormat(config.format);
+	header.format = layout.format;
+	header.type = layout.type;
+	header.settingsHash = settingsHash;
+	header.dataBytes = storedDataBytes(config);
+
+	std::vector<unsigned char> data(static_cast<size_t>(header.dataBytes));
+	size_t offset = 0;
+	for (int mipLevel = config.mipLevels() - 1; mipLevel >= 0; --mipLevel)
+	{
+		readStoredLevel(config, mipLevel, cubeMapTexture, data.data() + offset);
+		offset += storedLevelBytes(config, mipLevel);
+	}
+
+	std::ofstream file(path, std::ios::binary);
+	file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	file.write(reinterpret_cast<const char*>(data.data()), data.size());
+	if (!file)
+	{
+		std::cout << "Could not write baked cubemap " << path << std::endl;
+		return false;
+	}
+	std::cout << "Saved baked cubemap " << path << " (" << (sizeof(header) + data.size()) / 1024 << " KB)" << std::endl;
+	return true;
+}
+
+BakedCubemapStream::BakedCubemapStream() = default;
+
+BakedCubemapStream::~BakedCubemapStream()
+{
+	if (stagingBuffer)
+	{
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, stagingBuffer);
+		glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		glDeleteBuffers(1, &stagingBuffer);
+	}
+}
+
+/*	Method prepares streaming a saved bake into the cubemap without copying it through the heap
+ *
+ *	path: file written by saveBakedCubemap
+ *	config: the bake the viewer would run, resolution, mip count and format have to match the file
+ *	settingsHash: bakeSettingsHash of that bake, a file with another hash is stale
+ *	cubeMapTexture: texture without storage, receives immutable storage for every level
+ *	stream: receives the mapped file and the persistently mapped pixel unpack buffer the levels go through
+ *
+ *	Returns false without touching the texture if the file does not fit or the context lacks buffer storage
+ */
+bool beginBakedCubemapLoad(const std::string& path, const BakeConfig& config, unsigned long long settingsHash,
+                           unsigned int cubeMapTexture, BakedCubemapStream& stream)
+{
+	auto start = std::chrono::steady_clock::now();
+
+	std::unique_ptr<MappedFile> file(new MappedFile(path));
+	if (!file->data())
+		return false;
+
+	BakedCubemapHeader header;
+	if (file->size() < sizeof(header))
+		return false;
+	std::memcpy(&header, file->data(), sizeof(header));
+
+	const StoredLayout layout = storedLayout(config.format);
+	bool matches = std::memcmp(header.magic, bakedCubemapMagic, sizeof(header.magic)) == 0
+		&& header.version == bakedCubemapVersion && header.settingsHash == settingsHash
+		&& header.size == static_cast<unsigned int>(config.cubeMapSize)
+		&& header.mipLevels == static_cast<unsigned int>(config.mipLevels())
+		&& header.internalFormat == storageInternalFormat(config.format) && header.format == layout.format
+		&& header.type == layout.type && header.dataBytes == storedDataBytes(config)
+		&& file->size() >= sizeof(header) + header.dataBytes;
+	if (!matches)
+	{
+		std::cout << "Baked cubemap " << path << " was saved with other settings, baking again" << std::endl;
+		return false;
+	}
+
+	if (!hasBufferStorageSupport())
+	{
+		std::cout << "No buffer storage in this context, baking instead of loading " << path << std::endl;
+		return false;
+	}
+
+	//persistent and coherent, so copies need no flush and the uploads read the buffer while it stays mapped
+	const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+	const GLsizeiptr dataBytes = static_cast<GLsizeiptr>(header.dataBytes);
+
+	unsigned int stagingBuffer;
+	glGenBuffers(1, &stagingBuffer);
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, stagingBuffer);
+	glBufferStorage(GL_PIXEL_UNPACK_BUFFER, dataBytes, nullptr, flags);
+	void* staging = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, dataBytes, flags);
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	if (!staging)
+	{
+		std::cout << "Could not map the staging buffer for " << path << std::endl;
+		glDeleteBuffers(1, &stagingBuffer);
+		return false;
+	}
+
+	glBindTexture(GL_TEXTURE_CUBE_MAP, cubeMapTexture);
+	glTexStorage2D(GL_TEXTURE_CUBE_MAP, config.mipLevels(), header.internalFormat, config.cubeMapSize,
+	               config.cubeMapSize);
+	setCubemapSampling(cubeMapTexture, config.mipLevels());
+
+	stream.file = std::move(file);
+	stream.path = path;
+	stream.stagingBuffer = stagingBuffer;
+	stream.staging = static_cast<unsigned char*>(staging);
+	stream.cubeMapTexture = cubeMapTexture;
+	stream.internalFormat = header.internalFormat;
+	stream.format = layout.format;
+	stream.type = layout.type;
+	stream.size = config.cubeMapSize;
+	stream.nextLevel = config.mipLevels() - 1;
+	stream.offset = 0;
+	stream.dataBytes = static_cast<size_t>(header.dataBytes);
+	stream.milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	stream.readMilliseconds = 0.0;
+	return true;
+}
+
+/*	Method uploads stream.nextLevel
+ *
+ *	stream: load from beginBakedCubemapLoad
+ *
+ *	The six faces of the level are copied from the mapped file into the staging buffer, which is where the file
+ *	is actually read, and uploaded with glTexSubImage2D from offsets into that buffer
+ *	GL_TEXTURE_BASE_LEVEL is lowered to the new level, so the cubemap stays complete while the finer levels are missing
+ *	Returns true while levels are left, once the base level is uploaded the buffer and the file are released
+ */
+bool loadNextBakedLevel(BakedCubemapStream& stream)
+{
+	if (stream.nextLevel < 0)
+		return false;
+
+	auto start = std::chrono::steady_clock::now();
+	const int mipLevel = stream.nextLevel;
+	const int size = std::max(1, stream.size >> mipLevel);
+	const bool compressed = stream.format == 0;
+	const size_t faceBytes = compressed ? bc6hSize(size, size) : (stream.type == GL_FLOAT ? 12 : 8) * size * size;
+
+	//the levels lie in streaming order, so consecutive calls read the file front to back
+	auto readStart = std::chrono::steady_clock::now();
+	std::memcpy(stream.staging + stream.offset, stream.file->data() + sizeof(BakedCubemapHeader) + stream.offset,
+	            6 * faceBytes);
+	stream.readMilliseconds += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - readStart).
+		count();
+
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, stream.stagingBuffer);
+	glBindTexture(GL_TEXTURE_CUBE_MAP, stream.cubeMapTexture);
+	for (int i = 0; i < 6; ++i)
+	{
+		//with a bound unpack buffer the pointer argument is an offset into it
+		const void* source = reinterpret_cast<const void*>(stream.offset);
+		if (compressed)
+			glCompressedTexSubImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, mipLevel, 0, 0, size, size,
+			                          stream.internalFormat, static_cast<GLsizei>(faceBytes), source);
+		else
+			glTexSubImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, mipLevel, 0, 0, size, size, stream.format, stream.type,
+			                source);
+		stream.offset += faceBytes;
+	}
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+	//levels below the base level are ignored, so sampling only sees the levels that have been uploaded
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_BASE_LEVEL, mipLevel);
+
+	stream.milliseconds += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	--stream.nextLevel;
+	if (stream.nextLevel >= 0)
+		return true;
+
+	//the uploads that still read the buffer keep it alive after the delete
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, stream.stagingBuffer);
+	glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	glDeleteBuffers(1, &stream.stagingBuffer);
+	stream.stagingBuffer = 0;
+	stream.staging = nullptr;
+	stream.file.reset();
+
+	double megabytes = stream.dataBytes / (1024.0 * 1024.0);
+	std::cout << "Loaded baked cubemap " << stream.path << " (" << megabytes << " MB) in " << stream.milliseconds
+		<< " ms, mapped read " << stream.readMilliseconds << " ms ("
+		<< megabytes * 1000.0 / std::max(stream.readMilliseconds, 1e-3) << " MB/s)" << std::endl;
+	return false;
+}
+
+bool loadBakedCubemap(const std::string& path, const BakeConfig& config, unsigned long long settingsHash,
+                      unsigned int cubeMapTexture)
+{
+	BakedCubemapStream stream;
+	if (!beginBakedCubemapLoad(path, config, settingsHash, cubeMapTexture, stream))
+		return false;
+	while (loadNextBakedLevel(stream))
+	{
+	}
+	return true;
+}
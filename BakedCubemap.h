@@ -0,0 +1,84 @@
+#ifndef BAKED_CUBEMAP_H
+#define BAKED_CUBEMAP_H
+
+#include <memory>
+#include <string>
+#include "BakeConfig.h"
+
+//upload format, type and texel size of the texels as they are saved and published
+//format and type are 0 and bytesPerTexel is 0 for compressed formats, whose faces are stored as blocks
+struct StoredLayout
+{
+	unsigned int format;
+	unsigned int type;
+	size_t bytesPerTexel;
+};
+
+StoredLayout storedLayout(StorageFormat format);
+
+//bytes of the six faces of one level and of every level in the stored layout
+size_t storedLevelBytes(const BakeConfig& config, int mipLevel);
+size_t storedDataBytes(const BakeConfig& config);
+
+//reads the faces +X to -Z of one level of cubeMapTexture back in the stored layout
+void readStoredLevel(const BakeConfig& config, int mipLevel, unsigned int cubeMapTexture, unsigned char* faces);
+
+//hash of everything that changes the baked texels: the environment file, resolution, format, sampling settings
+//and the sources of the bake shaders
+//numOfPoints is the sample cap of the bake, it depends on whether dominant lights were extracted
+unsigned long long bakeSettingsHash(const BakeConfig& config, int numOfPoints);
+
+//config.bakedCubemap or the environment map path with the extension .cubemap
+std::string bakedCubemapPath(const BakeConfig& config);
+
+//reads every face and level of cubeMapTexture back and saves them in the format they are stored in on the GPU
+bool saveBakedCubemap(const std::string& path, const BakeConfig& config, unsigned long long settingsHash,
+                      unsigned int cubeMapTexture);
+
+class MappedFile;
+
+//a load that uploads one level per call, from the coarsest level to the base level
+//the file stays mapped and the staging buffer persistently mapped until the base level is uploaded
+struct BakedCubemapStream
+{
+	BakedCubemapStream();
+	~BakedCubemapStream();
+	BakedCubemapStream(const BakedCubemapStream&) = delete;
+	BakedCubemapStream& operator=(const BakedCubemapStream&) = delete;
+
+	std::unique_ptr<MappedFile> file;
+	std::string path;
+	unsigned int stagingBuffer = 0;
+	unsigned char* staging = nullptr;
+
+	unsigned int cubeMapTexture = 0;
+	unsigned int internalFormat = 0;
+	//0 for compressed formats
+	unsigned int format = 0;
+	unsigned int type = 0;
+	int size = 0;
+	//level the next call uploads, -1 once every level is done
+	int nextLevel = -1;
+	//bytes of the levels uploaded so far, the same offset in the file data and in the staging buffer
+	size_t offset = 0;
+	size_t dataBytes = 0;
+
+	//load time without the frames in between and the part of it spent reading the file
+	double milliseconds = 0.0;
+	double readMilliseconds = 0.0;
+};
+
+//maps a saved bake and allocates the immutable storage of the not yet allocated cubeMapTexture
+//returns false without touching the texture if the file is missing, was saved with other settings
+//or the context lacks buffer storage
+bool beginBakedCubemapLoad(const std::string& path, const BakeConfig& config, unsigned long long settingsHash,
+                           unsigned int cubeMapTexture, BakedCubemapStream& stream);
+
+//uploads stream.nextLevel and lowers the base level to it, returns true while levels are left
+bool loadNextBakedLevel(BakedCubemapStream& stream);
+
+//loads every level of a saved bake at once, see beginBakedCubemapLoad
+bool loadBakedCubemap(const std::string& path, const BakeConfig& config, unsigned long long settingsHash,
+                      unsigned int cubeMapTexture);
+
+#endif
@@ -0,0 +1,952 @@
+#include "pch.h"
+#include "Baker.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <sstream>
+#include <vector>
+#include "BakeTuner.h"
+#include "SampleSets.h"
+#include "stb_image_write.h"
+
+
+namespace
+{
+	//square that covers the whole screen for the cubemap face generation
+	const float squareCoordinates[] = {
+		//vertex coordinates   //normals
+		1.0f, 1.0f, 0.0f, 1.0f, 1.0f, 0.0f,
+		1.0f, -1.0f, 0.0f, 1.0f, 1.0f, 0.0f,
+		-1.0f, -1.0f, 0.0f, 1.0f, 1.0f, 0.0f,
+		-1.0f, 1.0f, 0.0f, 1.0f, 1.0f, 0.0f,
+	};
+
+	//cubemap coordinates for the front and back points in 3d space
+	/*orientation analog for front and back, numbers are the indices:
+	 * 3---0
+	 * |   |
+	 * |   |
+	 * 2---1
+	 */
+	const float cubeNormals[] = {
+		//front
+		1.0f, 1.0f, 1.0f,
+		1.0f, -1.0f, 1.0f,
+		-1.0f, -1.0f, 1.0f,
+		-1.0f, 1.0f, 1.0f,
+
+		//back
+		1.0f, 1.0f, -1.0f,
+		1.0f, -1.0f, -1.0f,
+		-1.0f, -1.0f, -1.0f,
+		-1.0f, 1.0f, -1.0f
+	};
+
+	//indices to assign the normals to the appropriate faces
+	const short cubeIndices[]
+	{
+		//right
+		5, 4, 0, 1,
+		//left
+		2, 3, 7, 6,
+
+		//top
+		0, 4, 7, 3,
+		//bottom
+		5, 1, 2, 6,
+
+		//back
+		1, 0, 3, 2,
+		//front
+		6, 7, 4, 5
+	};
+
+	//indices for drawing the square
+	const unsigned int squareIndices[] = {
+		0, 1, 3,
+		1, 2, 3
+	};
+
+	//writes the normals of the given face into the second half of every vertex of the square
+	void setFaceNormals(int face, float* coordinates)
+	{
+		for (int n = 0; n < 4; ++n)
+		{
+			//offset to iterate over the second batch of coordinates in our vertex buffer
+			//every line is 6 indeces big and 3 of them are the screen Coordinates
+			short offset = n * 6 + 3;
+
+			//compute the index of the next coordinate as cubeIndices holds all indices for all Cubemap faces
+			//every line of indices in cubeIndices is sorted by face index,
+			//the index of n-th point of the i-th face (multiplied by 4 since 4 indices are in every row and have to be jumped over
+			//This index is then mulitplied by 3 to jump over each pair of 3 coordinates in the actual cubeNormals array for index-times
+			short pos = cubeIndices[n + (4 * face)] * 3;
+
+			//since both offset and pos now point to the first coordinate of a coordinate triplet we can simply iterate over it
+			coordinates[offset++] = cubeNormals[pos++];
+			coordinates[offset++] = cubeNormals[pos++];
+			coordinates[offset] = cubeNormals[pos];
+		}
+	}
+
+	//streams the faces of one level into an HDR strip with +X on top, only one flipped face is held at a time
+	bool writeFaceStrip(const std::string& path, const float* faces, int size)
+	{
+		stbi_write_hdr_stream* stream = stbi_write_hdr_begin(path.c_str(), size, 6 * size, 3);
+		if (!stream)
+			return false;
+
+		const int rowFloats = size * 3;
+		std::vector<float> face(static_cast<size_t>(size) * rowFloats);
+		for (int i = 0; i < 6; ++i)
+		{
+			//GL rows start at the bottom, HDR rows at the top
+			const float* source = faces + static_cast<size_t>(i) * size * rowFloats;
+			for (int y = 0; y < size; ++y)
+				std::memcpy(&face[static_cast<size_t>(y) * rowFloats], source + static_cast<size_t>(size - 1 - y) * rowFloats,
+				            rowFloats * sizeof(float));
+			stbi_write_hdr_rows(stream, face.data(), size);
+		}
+		return stbi_write_hdr_end(stream) != 0;
+	}
+
+	//allocates every level of a 2D texture, used for the compute targets
+	void allocateLevels(unsigned int texture, GLenum internalFormat, GLenum format, const BakeConfig& config)
+	{
+		glBindTexture(GL_TEXTURE_2D, texture);
+		for (int mipLevel = 0; mipLevel < config.mipLevels(); ++mipLevel)
+		{
+			int size = config.mipResolution(mipLevel);
+			glTexImage2D(GL_TEXTURE_2D, mipLevel, internalFormat, size, size, 0, format, GL_FLOAT, nullptr);
+		}
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, config.mipLevels() - 1);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	}
+
+	//largest sample count of the schedule, every prefix of the point sets is usable so it serves all levels
+	int maxLevelNumOfPoints(const BakeConfig& config, int numOfPoints)
+	{
+		int maxNumOfPoints = 1;
+		for (int mipLevel = 0; mipLevel < config.mipLevels(); ++mipLevel)
+			maxNumOfPoints = std::max(maxNumOfPoints, config.levelNumOfPoints(mipLevel, numOfPoints));
+		return maxNumOfPoints;
+	}
+
+	float halfToFloat(unsigned short half)
+	{
+		unsigned int sign = static_cast<unsigned int>(half & 0x8000) << 16;
+		unsigned int exponent = (half >> 10) & 0x1F;
+		unsigned int mantissa = half & 0x3FF;
+		if (exponent == 0)
+			return (sign ? -1.0f : 1.0f) * std::ldexp(static_cast<float>(mantissa), -24);
+		if (exponent == 31)
+			return mantissa ? std::numeric_limits<float>::quiet_NaN()
+			                : (sign ? -1.0f : 1.0f) * std::numeric_limits<float>::infinity();
+
+		unsigned int bits = sign | ((exponent + 127 - 15) << 23) | (mantissa << 13);
+		float value;
+		std::memcpy(&value, &bits, sizeof(value));
+		return value;
+	}
+
+	/*	Method uploads an equirect from memory into the environment texture of resources
+	 *
+	 *	config: settings of the bake, decides whether lights are extracted and which engine needs the image
+	 *	resources: GL objects from createBakeResources, their targets are resized to config
+	 *	image: the caller's pixels, never written
+	 *	lights: optional, receives the extracted dominant lights
+	 *	source: receives the environment texture and, if the CPU engine needs it, the decoded floats
+	 *	numOfPoints: receives the sample cap of the bake, lower once dominant lights were extracted
+	 *
+	 *	The texture is only reallocated if the size changes, the image is uploaded as it is whenever possible
+	 *	A packed float copy is only made for the light extraction, which writes into the image, and for a CPU bake
+	 *	of half floats or padded rows, the copy reuses the memory of the previous one
+	 */
+	bool prepareEquirect(const BakeConfig& config, BakeResources& resources, const EquirectImage& image,
+	                     std::vector<DominantLight>* lights, BakeSource& source, int& numOfPoints)
+	{
+		if (!image.pixels || image.width <= 0 || image.height <= 0 || (image.channels != 3 && image.channels != 4))
+		{
+			std::cout << "Equirect has to be a non-empty RGB or RGBA image" << std::endl;
+			return false;
+		}
+
+		const size_t pixelBytes = (image.type == PixelType::Half ? 2 : 4) * static_cast<size_t>(image.channels);
+		const size_t packedRowBytes = pixelBytes * image.width;
+		const size_t rowStride = image.rowStride ? image.rowStride : packedRowBytes;
+		if (rowStride < packedRowBytes)
+		{
+			std::cout << "Equirect rows are shorter than its width" << std::endl;
+			return false;
+		}
+
+		//GL can only skip whole pixels between rows
+		const bool packedFloats = image.type == PixelType::Float && rowStride == packedRowBytes;
+		const bool copy = config.extractLights || rowStride % pixelBytes != 0 ||
+			(config.engine == BakeEngine::Cpu && !packedFloats);
+
+		const void* pixels = image.pixels;
+		GLenum type = image.type == PixelType::Half ? GL_HALF_FLOAT : GL_FLOAT;
+		int rowLength = static_cast<int>(rowStride / pixelBytes);
+		if (copy)
+		{
+			const size_t rowValues = static_cast<size_t>(image.width) * image.channels;
+			resources.environmentData.resize(rowValues * image.height);
+			for (int y = 0; y < image.height; ++y)
+			{
+				const unsigned char* row = static_cast<const unsigned char*>(image.pixels) + y * rowStride;
+				float* target = resources.environmentData.data() + y * rowValues;
+				if (image.type == PixelType::Float)
+				{
+					std::memcpy(target, row, packedRowBytes);
+					continue;
+				}
+				//rows are not necessarily aligned to 2 bytes
+				for (size_t i = 0; i < rowValues; ++i)
+				{
+					unsigned short half;
+					std::memcpy(&half, row + 2 * i, sizeof(half));
+					target[i] = halfToFloat(half);
+				}
+			}
+			pixels = resources.environmentData.data();
+			type = GL_FLOAT;
+			rowLength = image.width;
+		}
+
+		//cut the spikes out of the copy, the display shader adds them back analytically
+		std::vector<DominantLight> extracted;
+		if (config.extractLights)
+			extracted = extractDominantLights(resources.environmentData.data(), image.width, image.height,
+			                                  image.channels, maxDominantLights, config.lightThreshold);
+		if (lights)
+			*lights = extracted;
+		numOfPoints = extracted.empty() ? config.numOfPoints : config.residualNumOfPoints;
+
+		if (!resources.environmentTexture)
+			glGenTextures(1, &resources.environmentTexture);
+		glBindTexture(GL_TEXTURE_2D, resources.environmentTexture);
+
+		const GLenum format = image.channels == 4 ? GL_RGBA : GL_RGB;
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+		glPixelStorei(GL_UNPACK_ROW_LENGTH, rowLength);
+		if (resources.environmentWidth == image.width && resources.environmentHeight == image.height)
+			glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, image.width, image.height, format, type, pixels);
+		else
+		{
+			glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB32F, image.width, image.height, 0, format, type, pixels);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+			resources.environmentWidth = image.width;
+			resources.environmentHeight = image.height;
+		}
+		glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+		//without a copy the CPU engine can only read the caller's pixels if they are packed floats
+		source.envMap = resources.environmentTexture;
+		source.environment = {
+			copy || packedFloats ? static_cast<const float*>(pixels) : nullptr, image.width, image.height, image.channels
+		};
+
+		resizeBakeResources(config, resources);
+		return true;
+	}
+
+	//uniforms both GPU engines share, the programs include the same prefilter.glsl
+	//a specialized program has numOfPoints and specular compiled in, setting them is a no-op there
+	void setPrefilterUniforms(Shader& shader, const BakeConfig& config, int numOfPoints)
+	{
+		shader.use();
+		glUniform1ui(glGetUniformLocation(shader.ID, "numOfPoints"), static_cast<unsigned int>(numOfPoints));
+		glUniform1f(glGetUniformLocation(shader.ID, "errorThreshold"), config.errorThreshold);
+		glUniform1i(glGetUniformLocation(shader.ID, "envMap"), 0);
+		glUniform1i(glGetUniformLocation(shader.ID, "samplePoints"), 1);
+		glUniform1i(glGetUniformLocation(shader.ID, "sampleSet"), static_cast<int>(config.sampleSet));
+		glUniform1i(glGetUniformLocation(shader.ID, "rotateSamples"), config.rotateSamples);
+	}
+
+	void deleteProgram(Shader* shader)
+	{
+		if (shader)
+			shader->release();
+		delete shader;
+	}
+
+	//constants a specialized program of a level is compiled with
+	ShaderDefines variantDefines(const BakeConfig& config, int mipLevel, int numOfPoints)
+	{
+		//enough digits that the constant is the same float the generic program gets as uniform
+		std::ostringstream specular;
+		specular << std::setprecision(9) << std::showpoint << config.specularExponent(mipLevel);
+		return {
+			{"NUM_OF_POINTS", std::to_string(numOfPoints) + "u"},
+			{"SPECULAR", specular.str()}
+		};
+	}
+
+	std::string variantKey(BakeEngine engine, const ShaderDefines& defines)
+	{
+		return std::string(engineName(engine)) + " " + defines[0].second + " " + defines[1].second;
+	}
+
+	Shader* compileVariant(BakeEngine engine, const ShaderDefines& defines)
+	{
+		if (engine == BakeEngine::Compute)
+			return new Shader("cubeMapCompute.comp", defines);
+		return new Shader("cubeMapVert.vs", "cubeMapFrag.frag", defines);
+	}
+}
+
+bool createBakeResources(const BakeConfig& config, BakeResources& resources, const BakeResources* programs)
+{
+	if (programs)
+	{
+		resources.rasterShader = programs->rasterShader;
+		resources.computeShader = programs->computeShader;
+		resources.variants = programs->variants;
+		resources.ownsPrograms = false;
+	}
+	else
+	{
+		resources.rasterShader = new Shader("cubeMapVert.vs", "cubeMapFrag.frag");
+		if (hasComputeSupport())
+			resources.computeShader = new Shader("cubeMapCompute.comp");
+		resources.variants = std::make_shared<ShaderVariants>();
+	}
+
+	glGenTextures(1, &resources.colorTexture);
+	glGenTextures(1, &resources.samplesTexture);
+	if (resources.computeShader)
+	{
+		glGenTextures(1, &resources.computeTarget);
+		glGenTextures(1, &resources.computeSamplesTarget);
+	}
+	resizeBakeResources(config, resources);
+
+	//allocate framebuffer for the cubemap generation
+	//-------------------------------------------------------------------------
+	glGenFramebuffers(1, &resources.framebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, resources.framebuffer);
+
+	glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, resources.colorTexture, 0);
+
+	//second attachment receives the fraction of samples every texel needed, only used for the heatmap
+	glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, resources.samplesTexture, 0);
+
+	// Set the draw buffers, only one per pass is needed in this case since we only want to render one cubemap face
+	// bakeLevel adds the second one whenever the sample counts are read back
+	GLenum DrawBuffers[1] = {GL_COLOR_ATTACHMENT0};
+	glDrawBuffers(1, DrawBuffers);
+
+	bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	if (!complete)
+	{
+		std::cout << "Cubemap framebuffer is incomplete" << std::endl;
+		return false;
+	}
+
+	//usual buffer creation and binding
+	glGenVertexArrays(1, &resources.squareVAO);
+	glGenBuffers(1, &resources.squareBuffer);
+	glGenBuffers(1, &resources.squareIndexBuffer);
+
+	glBindVertexArray(resources.squareVAO);
+
+	glBindBuffer(GL_ARRAY_BUFFER, resources.squareBuffer);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(squareCoordinates), squareCoordinates, GL_STATIC_DRAW);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, resources.squareIndexBuffer);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(squareIndices), squareIndices, GL_STATIC_DRAW);
+
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), static_cast<void*>(nullptr));
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)(3 * sizeof(float)));
+	glEnableVertexAttribArray(1);
+	glBindVertexArray(0);
+
+	glGenTextures(1, &resources.samplePointsTexture);
+	return true;
+}
+
+void resizeBakeResources(const BakeConfig& config, BakeResources& resources)
+{
+	if (resources.targetSize == config.cubeMapSize && resources.targetLevels == config.mipLevels())
+		return;
+
+	//the textures stay attached to the framebuffer, respecifying them keeps the attachments
+	glBindTexture(GL_TEXTURE_2D, resources.colorTexture);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB32F, config.cubeMapSize, config.cubeMapSize, 0, GL_RGB, GL_FLOAT, nullptr);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+
+	glBindTexture(GL_TEXTURE_2D, resources.samplesTexture);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, config.cubeMapSize, config.cubeMapSize, 0, GL_RED, GL_FLOAT, nullptr);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+
+	if (resources.computeShader)
+	{
+		allocateLevels(resources.computeTarget, GL_RGBA32F, GL_RGBA, config);
+		allocateLevels(resources.computeSamplesTarget, GL_R32F, GL_RED, config);
+	}
+
+	resources.targetSize = config.cubeMapSize;
+	resources.targetLevels = config.mipLevels();
+}
+
+void destroyBakeResources(BakeResources& resources)
+{
+	unsigned int textures[] = {
+		resources.colorTexture, resources.samplesTexture, resources.computeTarget, resources.computeSamplesTarget,
+		resources.samplePointsTexture, resources.environmentTexture
+	};
+	glDeleteTextures(6, textures);
+	glDeleteFramebuffers(1, &resources.framebuffer);
+	glDeleteVertexArrays(1, &resources.squareVAO);
+	glDeleteBuffers(1, &resources.squareBuffer);
+	glDeleteBuffers(1, &resources.squareIndexBuffer);
+
+	if (resources.ownsPrograms)
+	{
+		deleteProgram(resources.rasterShader);
+		deleteProgram(resources.computeShader);
+	}
+
+	resources = BakeResources();
+}
+
+bool bakeProgramsRead(const std::string& file)
+{
+	for (const char* path : {"cubeMapVert.vs", "cubeMapFrag.frag", "cubeMapCompute.comp"})
+	{
+		std::vector<std::string> files = Shader::sourceFiles(path);
+		if (std::find(files.begin(), files.end(), file) != files.end())
+			return true;
+	}
+	return false;
+}
+
+//FNV-1a over the name and source of every file the bake programs read
+unsigned long long bakeProgramsHash()
+{
+	unsigned long long hash = 14695981039346656037ull;
+	for (const char* path : {"cubeMapVert.vs", "cubeMapFrag.frag", "cubeMapCompute.comp"})
+	{
+		for (const std::string& file : Shader::sourceFiles(path))
+		{
+			std::string source;
+			try
+			{
+				source = shaderFileSource(file);
+			}
+			catch (const std::ifstream::failure&)
+			{
+				//a missing file hashes as empty, the same missing file always gives the same hash
+			}
+			for (char c : file + '\0' + source + '\0')
+				hash = (hash ^ static_cast<unsigned char>(c)) * 1099511628211ull;
+		}
+	}
+	return hash;
+}
+
+/*	Method submits the programs of a bake from the current sources without waiting for the driver
+ *
+ *	config: the bake, with specializeShaders its variants are compiled
+ *	resources: the compute program is only reloaded if the resources have one
+ *	numOfPoints: sample cap per level like for beginBake
+ *	compileGeneric: recompile the generic programs as well
+ *	reload: a reload it still holds is dropped, receives the submitted programs
+ *
+ *	The variants are the ones beginBake would ask for, so the next bake finds all of them compiled
+ */
+void beginBakeProgramReload(const BakeConfig& config, const BakeResources& resources, int numOfPoints,
+                            bool compileGeneric, BakeProgramReload& reload)
+{
+	reload = BakeProgramReload();
+
+	if (compileGeneric)
+	{
+		reload.rasterShader.reset(new Shader("cubeMapVert.vs", "cubeMapFrag.frag"));
+		if (resources.computeShader)
+			reload.computeShader.reset(new Shader("cubeMapCompute.comp"));
+	}
+
+	if (config.specializeShaders)
+	{
+		BakeEngine engine = config.engine == BakeEngine::Compute && resources.computeShader
+			                    ? BakeEngine::Compute
+			                    : BakeEngine::Raster;
+		for (int mipLevel = config.mipLevels() - 1; mipLevel >= 0; --mipLevel)
+		{
+			ShaderDefines defines = variantDefines(config, mipLevel, config.levelNumOfPoints(mipLevel, numOfPoints));
+			std::unique_ptr<Shader, ProgramDeleter>& variant = reload.variants[variantKey(engine, defines)];
+			if (!variant)
+				variant.reset(compileVariant(engine, defines));
+		}
+	}
+}
+
+bool bakeProgramReloadReady(BakeProgramReload& reload)
+{
+	for (Shader* shader : {reload.rasterShader.get(), reload.computeShader.get()})
+	{
+		if (shader && !shader->ready())
+			return false;
+	}
+	for (auto& variant : reload.variants)
+	{
+		if (!variant.second->ready())
+			return false;
+	}
+	return true;
+}
+
+/*	Method replaces the bake programs of resources by the ones of a reload
+ *
+ *	resources: owns the programs, the borrowed programs of pooled resources are never reloaded
+ *	reload: from beginBakeProgramReload, is empty afterwards either way
+ *
+ *	The old variants were compiled from the old sources, they are all replaced by the ones of the reload
+ */
+bool finishBakeProgramReload(BakeResources& resources, BakeProgramReload& reload)
+{
+	bool linked = true;
+	for (Shader* shader : {reload.rasterShader.get(), reload.computeShader.get()})
+	{
+		if (shader)
+		{
+			shader->finish();
+			linked = linked && shader->linked;
+		}
+	}
+	for (auto& variant : reload.variants)
+	{
+		variant.second->finish();
+		linked = linked && variant.second->linked;
+	}
+	if (!linked || !resources.ownsPrograms)
+	{
+		reload = BakeProgramReload();
+		return false;
+	}
+
+	if (reload.rasterShader)
+	{
+		deleteProgram(resources.rasterShader);
+		resources.rasterShader = reload.rasterShader.release();
+	}
+	if (reload.computeShader)
+	{
+		deleteProgram(resources.computeShader);
+		resources.computeShader = reload.computeShader.release();
+	}
+	if (resources.variants)
+		*resources.variants = std::move(reload.variants);
+	reload = BakeProgramReload();
+	return true;
+}
+
+GLenum storageInternalFormat(StorageFormat format)
+{
+	switch (format)
+	{
+	case StorageFormat::RGBA16F: return GL_RGBA16F;
+	case StorageFormat::BC6H: return GL_COMPRESSED_RGB_BPTC_UNSIGNED_FLOAT;
+	default: return GL_RGB32F;
+	}
+}
+
+/*	Method returns the program of a GPU engine for one level
+ *
+ *	config: decides whether the program is specialized
+ *	resources: holds the generic programs and the variants
+ *	engine: raster or compute
+ *	mipLevel: level whose specular exponent is compiled in
+ *	numOfPoints: sample cap of the level, compiled in as well
+ *
+ *	The variant injects NUM_OF_POINTS and SPECULAR into prefilter.glsl, so the loop bound and every pow of the
+ *	exponent are constants the compiler can fold, the variant is submitted to the compiler on the first request
+ */
+Shader* bakeProgram(const BakeConfig& config, BakeResources& resources, BakeEngine engine, int mipLevel,
+                    int numOfPoints)
+{
+	Shader* generic = engine == BakeEngine::Compute ? resources.computeShader : resources.rasterShader;
+	if (!config.specializeShaders || !resources.variants || !generic)
+		return generic;
+
+	ShaderDefines defines = variantDefines(config, mipLevel, numOfPoints);
+	std::unique_ptr<Shader, ProgramDeleter>& variant = (*resources.variants)[variantKey(engine, defines)];
+	if (!variant)
+		variant.reset(compileVariant(engine, defines));
+	return variant.get();
+}
+
+BakeEngine resolveEngine(const BakeConfig& config, const BakeResources& resources, const BakeSource& source)
+{
+	if (config.engine == BakeEngine::Compute && !resources.computeShader)
+	{
+		std::cout << "Compute shaders are not supported by this context, falling back to the raster engine" << std::endl;
+		return BakeEngine::Raster;
+	}
+	if (config.engine == BakeEngine::Cpu && !source.environment.data)
+	{
+		std::cout << "No decoded environment for the CPU engine, falling back to the raster engine" << std::endl;
+		return BakeEngine::Raster;
+	}
+	return config.engine;
+}
+
+void uploadSamplePoints(const BakeConfig& config, BakeResources& resources, int count)
+{
+	//precomputed points live in a single row texture on unit 1, Hammersley points are computed in the shader
+	resources.samplePoints = generateSamplePoints(config.sampleSet, count);
+	glActiveTexture(GL_TEXTURE1);
+	glBindTexture(GL_TEXTURE_2D, resources.samplePointsTexture);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RG32F, count, 1, 0, GL_RG, GL_FLOAT, resources.samplePoints.data());
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glActiveTexture(GL_TEXTURE0);
+}
+
+void setCubemapSampling(unsigned int cubeMapTexture, int mipLevels)
+{
+	//set different parameters for filtering
+	glBindTexture(GL_TEXTURE_CUBE_MAP, cubeMapTexture);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAX_LEVEL, mipLevels - 1);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_CUBE_MAP_SEAMLESS, 1);
+}
+
+/*	Method prefilters the six faces of one mip level
+ *
+ *	config: sampling settings, the level decides resolution and specular exponent
+ *	resources: GL objects from createBakeResources, the sample points have to be uploaded already
+ *	source: the environment as texture and as decoded data
+ *	engine: engine from resolveEngine
+ *	mipLevel: level that is baked
+ *	numOfPoints: sample cap per texel, at most the count of the uploaded sample points
+ *	faces: receives the faces +X to -Z, size * size RGB floats each
+ *	samplesTaken: optional, receives the fraction of numOfPoints every texel needed in the same order
+ */
+void bakeLevel(const BakeConfig& config, BakeResources& resources, const BakeSource& source, BakeEngine engine,
+               int mipLevel, int numOfPoints, float* faces, float* samplesTaken)
+{
+	const int size = config.mipResolution(mipLevel);
+	const int texels = size * size;
+
+	//the higher the mip level the lower the specular exponent
+	const float specular = config.specularExponent(mipLevel);
+
+	if (engine == BakeEngine::Cpu)
+	{
+		PrefilterSettings settings = {
+			specular, numOfPoints, config.errorThreshold,
+			config.sampleSet == SampleSet::Hammersley ? nullptr : resources.samplePoints.data(), config.rotateSamples
+		};
+		for (int i = 0; i < 6; ++i)
+			prefilterFace(source.environment, i, size, settings, faces + i * texels * 3,
+			              samplesTaken ? samplesTaken + i * texels : nullptr);
+		return;
+	}
+
+	Shader* shader = bakeProgram(config, resources, engine, mipLevel, numOfPoints);
+	setPrefilterUniforms(*shader, config, numOfPoints);
+	glUniform1f(glGetUniformLocation(shader->ID, "specular"), specular);
+
+	//other resources may have bound their points since the upload
+	glActiveTexture(GL_TEXTURE1);
+	glBindTexture(GL_TEXTURE_2D, resources.samplePointsTexture);
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, source.envMap);
+
+	if (engine == BakeEngine::Compute)
+	{
+		glUniform1i(glGetUniformLocation(shader->ID, "writeSamples"), samplesTaken != nullptr);
+		glUniform1i(glGetUniformLocation(shader->ID, "faceSize"), size);
+		glBindImageTexture(0, resources.computeTarget, mipLevel, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA32F);
+		glBindImageTexture(1, resources.computeSamplesTarget, mipLevel, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+
+		for (int i = 0; i < 6; ++i)
+		{
+			glUniform1i(glGetUniformLocation(shader->ID, "face"), i);
+			glDispatchCompute((size + 7) / 8, (size + 7) / 8, 1);
+			glMemoryBarrier(GL_TEXTURE_UPDATE_BARRIER_BIT);
+
+			glBindTexture(GL_TEXTURE_2D, resources.computeTarget);
+			glGetTexImage(GL_TEXTURE_2D, mipLevel, GL_RGB, GL_FLOAT, faces + i * texels * 3);
+			if (samplesTaken)
+			{
+				glBindTexture(GL_TEXTURE_2D, resources.computeSamplesTarget);
+				glGetTexImage(GL_TEXTURE_2D, mipLevel, GL_RED, GL_FLOAT, samplesTaken + i * texels);
+			}
+		}
+		return;
+	}
+
+	//no depth test needed since the square covers the entire screen
+	glDisable(GL_DEPTH_TEST);
+	glBindFramebuffer(GL_FRAMEBUFFER, resources.framebuffer);
+	glBindVertexArray(resources.squareVAO);
+	glBindBuffer(GL_ARRAY_BUFFER, resources.squareBuffer);
+
+	//the sample count is only written into the second attachment if somebody reads it
+	GLenum DrawBuffers[2] = {GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1};
+	glDrawBuffers(samplesTaken ? 2 : 1, DrawBuffers);
+
+	//resize the viewport to fit the mipmap resolution
+	glViewport(0, 0, size, size);
+
+	float faceCoordinates[sizeof(squareCoordinates) / sizeof(float)];
+	std::memcpy(faceCoordinates, squareCoordinates, sizeof(squareCoordinates));
+
+	for (int i = 0; i < 6; ++i)
+	{
+		//change the normals for each face
+		setFaceNormals(i, faceCoordinates);
+		glBufferData(GL_ARRAY_BUFFER, sizeof(faceCoordinates), faceCoordinates, GL_STATIC_DRAW);
+
+		glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, nullptr);
+
+		glReadBuffer(GL_COLOR_ATTACHMENT0);
+		glReadPixels(0, 0, size, size, GL_RGB, GL_FLOAT, faces + i * texels * 3);
+
+		if (samplesTaken)
+		{
+			glReadBuffer(GL_COLOR_ATTACHMENT1);
+			glReadPixels(0, 0, size, size, GL_RED, GL_FLOAT, samplesTaken + i * texels);
+		}
+	}
+
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glBindVertexArray(0);
+}
+
+/*	Method prepares a bake that runs one level per bakeNextLevel call
+ *
+ *	config: resolution, mip count, engine, storage format and sampling settings
+ *	resources: GL objects from createBakeResources with the same config, has to outlive the bake
+ *	source: the environment as texture and as decoded data, has to outlive the bake
+ *	numOfPoints: sample cap per texel for levels without an entry in config.mipSamples
+ *	cubeMapTexture: receives the baked levels in the configured storage format
+ *	stream: receives the state of the bake
+ *
+ *	The levels are baked from the coarsest on, so a cubemap is visible after the cheapest level
+ */
+void beginBake(const BakeConfig& config, BakeResources& resources, const BakeSource& source, int numOfPoints,
+               unsigned int cubeMapTexture, BakeStream& stream)
+{
+	stream = BakeStream();
+	stream.config = config;
+	stream.resources = &resources;
+	stream.source = &source;
+	stream.engine = resolveEngine(config, resources, source);
+	stream.numOfPoints = numOfPoints;
+	stream.cubeMapTexture = cubeMapTexture;
+	stream.nextLevel = config.mipLevels() - 1;
+
+	uploadSamplePoints(config, resources, maxLevelNumOfPoints(config, numOfPoints));
+
+	//submit the variants of every level at once, the driver compiles them in parallel while the first levels bake
+	if (stream.engine != BakeEngine::Cpu)
+	{
+		for (int mipLevel = config.mipLevels() - 1; mipLevel >= 0; --mipLevel)
+			bakeProgram(config, resources, stream.engine, mipLevel, config.levelNumOfPoints(mipLevel, numOfPoints));
+	}
+
+	setCubemapSampling(cubeMapTexture, config.mipLevels());
+}
+
+/*	Method bakes and uploads stream.nextLevel
+ *
+ *	stream: bake from beginBake
+ *
+ *	Every engine produces one level as RGB floats, which is then uploaded into the cubemap
+ *	GL_TEXTURE_BASE_LEVEL is lowered to the new level, so the cubemap stays complete while the finer levels are missing
+ *	Returns true while levels are left, the summary is printed once the base level is done
+ */
+bool bakeNextLevel(BakeStream& stream)
+{
+	if (stream.nextLevel < 0)
+		return false;
+
+	auto start = std::chrono::steady_clock::now();
+	const BakeConfig& config = stream.config;
+	const int mipLevel = stream.nextLevel;
+	const GLenum internalFormat = storageInternalFormat(config.format);
+
+	int size = config.mipResolution(mipLevel);
+	int texels = size * size;
+
+	std::vector<float> faces(6 * texels * 3);
+	std::vector<float> samplesTaken(config.sampleHeatmap ? 6 * texels : 0);
+	bakeLevel(config, *stream.resources, *stream.source, stream.engine, mipLevel,
+	          config.levelNumOfPoints(mipLevel, stream.numOfPoints), faces.data(),
+	          config.sampleHeatmap ? samplesTaken.data() : nullptr);
+
+	//bind the cubemap after the offscreen rendering pass
+	glBindTexture(GL_TEXTURE_CUBE_MAP, stream.cubeMapTexture);
+	if (config.format == StorageFormat::BC6H)
+	{
+		const size_t faceBytes = bc6hSize(size, size);
+		std::vector<unsigned char> blocks(faceBytes);
+		std::vector<float> decoded(texels * 3);
+		for (int i = 0; i < 6; ++i)
+		{
+			const float* face = faces.data() + i * texels * 3;
+			auto encodeStart = std::chrono::steady_clock::now();
+			encodeBC6H(face, size, size, config.bc6hQuality, blocks.data());
+			stream.encodeMilliseconds += std::chrono::duration<double, std::milli>(
+				std::chrono::steady_clock::now() - encodeStart).count();
+
+			glCompressedTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, mipLevel, internalFormat, size, size, 0,
+			                       static_cast<GLsizei>(faceBytes), blocks.data());
+
+			//decode again to report the error the compression adds
+			decodeBC6H(blocks.data(), size, size, decoded.data());
+			BakeQuality quality = measureBakeQuality(decoded.data(), face, texels);
+			stream.squaredError += texels * 3 * std::pow(10.0, -quality.psnr / 10.0);
+			stream.deltaE += static_cast<double>(quality.deltaE) * texels;
+			stream.encodedTexels += texels;
+			stream.compressedBytes += faceBytes;
+		}
+	}
+	else
+	{
+		for (int i = 0; i < 6; ++i)
+		{
+			glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i,
+			             mipLevel,
+			             internalFormat,
+			             size, size, 0,
+			             GL_RGB, GL_FLOAT, faces.data() + i * texels * 3);
+		}
+	}
+	//levels below the base level are ignored, so sampling only sees the levels that exist
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_BASE_LEVEL, mipLevel);
+
+	if (config.dumpFaces)
+	{
+		const std::string stripPath = "faces_mip" + std::to_string(mipLevel) + ".hdr";
+		if (!writeFaceStrip(stripPath, faces.data(), size))
+			std::cout << "Could not write face strip " << stripPath << std::endl;
+	}
+
+	if (config.sampleHeatmap)
+	{
+		//faces are stacked with +X on top once the heatmap is flipped into PNG row order
+		std::vector<float> heatmap(6 * texels);
+		for (int i = 0; i < 6; ++i)
+			std::memcpy(heatmap.data() + (5 - i) * texels, samplesTaken.data() + i * texels, texels * sizeof(float));
+		writeSampleHeatmap("samples_mip" + std::to_string(mipLevel) + ".png", heatmap.data(), size, 6 * size);
+	}
+
+	stream.milliseconds += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	--stream.nextLevel;
+	if (stream.nextLevel >= 0)
+		return true;
+
+	std::cout << "Baked " << config.cubeMapSize << "x" << config.cubeMapSize << " cubemap with " << config.mipLevels()
+		<< " levels as " << formatName(config.format) << " on the " << engineName(stream.engine) << " engine in "
+		<< stream.milliseconds << " ms" << std::endl;
+
+	if (stream.encodedTexels > 0.0)
+	{
+		std::cout << "BC6H " << bc6hQualityName(config.bc6hQuality) << ": " << stream.compressedBytes / 1024
+			<< " KB, encoded " << stream.encodedTexels / 1e6 << " MTexel in " << stream.encodeMilliseconds << " ms ("
+			<< stream.encodedTexels / 1e3 / std::max(stream.encodeMilliseconds, 1e-3) << " MTexel/s), psnr "
+			<< -10.0 * std::log10(std::max(stream.squaredError / (stream.encodedTexels * 3), 1e-10)) << " dB, delta e "
+			<< stream.deltaE / stream.encodedTexels << std::endl;
+	}
+	return false;
+}
+
+bool bakeCubemap(const BakeConfig& config, BakeResources& resources, const BakeSource& source, int numOfPoints,
+                 unsigned int cubeMapTexture)
+{
+	BakeStream stream;
+	beginBake(config, resources, source, numOfPoints, cubeMapTexture, stream);
+	while (bakeNextLevel(stream))
+	{
+	}
+	return true;
+}
+
+size_t bakedFloatCount(const BakeConfig& config)
+{
+	size_t count = 0;
+	for (int mipLevel = 0; mipLevel < config.mipLevels(); ++mipLevel)
+	{
+		const size_t size = config.mipResolution(mipLevel);
+		count += 6 * size * size * 3;
+	}
+	return count;
+}
+
+bool beginEquirectBake(const BakeConfig& config, BakeResources& resources, const EquirectImage& image,
+                       unsigned int cubeMapTexture, BakeSource& source, BakeStream& stream,
+                       std::vector<DominantLight>* lights)
+{
+	int numOfPoints;
+	if (!prepareEquirect(config, resources, image, lights, source, numOfPoints))
+		return false;
+	beginBake(config, resources, source, numOfPoints, cubeMapTexture, stream);
+	return true;
+}
+
+bool bakeEquirectToTexture(const BakeConfig& config, BakeResources& resources, const EquirectImage& image,
+                           unsigned int cubeMapTexture, std::vector<DominantLight>* lights)
+{
+	BakeSource source;
+	BakeStream stream;
+	if (!beginEquirectBake(config, resources, image, cubeMapTexture, source, stream, lights))
+		return false;
+	while (bakeNextLevel(stream))
+	{
+	}
+	return true;
+}
+
+/*	Method bakes an equirect from memory into the caller's memory
+ *
+ *	config: resolution, mip count, engine and sampling settings, the storage format does not apply
+ *	resources: GL objects from createBakeResources, reused by every call
+ *	image: the caller's pixels, never written
+ *	levels: receives bakedFloatCount(config) floats, the base level first
+ *	lights: optional, receives the dominant lights cut out of the bake if config.extractLights is set
+ *
+ *	Every level is prefiltered straight into its place in levels, nothing is uploaded or encoded
+ */
+bool bakeEquirectToMemory(const BakeConfig& config, BakeResources& resources, const EquirectImage& image,
+                          float* levels, std::vector<DominantLight>* lights)
+{
+	BakeSource source;
+	int numOfPoints;
+	if (!prepareEquirect(config, resources, image, lights, source, numOfPoints))
+		return false;
+
+	const BakeEngine engine = resolveEngine(config, resources, source);
+	uploadSamplePoints(config, resources, maxLevelNumOfPoints(config, numOfPoints));
+
+	size_t offset = 0;
+	for (int mipLevel = 0; mipLevel < config.mipLevels(); ++mipLevel)
+	{
+		const size_t size = config.mipResolution(mipLevel);
+		bakeLevel(config, resources, source, engine, mipLevel, config.levelNumOfPoints(mipLevel, numOfPoints),
+		          levels + offset);
+		offset += 6 * size * size * 3;
+	}
+	return true;
+}
@@ -0,0 +1,203 @@
+#ifndef BAKER_H
+#define BAKER_H
+
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+#include "BakeConfig.h"
+#include "CpuPrefilter.h"
+#include "LightExtraction.h"
+#include "Shader.h"
+
+//deletes the GL program along with the Shader, pending stages included
+struct ProgramDeleter
+{
+	void operator()(Shader* shader) const
+	{
+		shader->release();
+		delete shader;
+	}
+};
+
+//programs specialized for the sample cap and specular exponent of one level, keyed by engine and both values
+typedef std::map<std::string, std::unique_ptr<Shader, ProgramDeleter>> ShaderVariants;
+
+//GL objects of the offscreen renderpass, sized by the bake configuration
+struct BakeResources
+{
+	Shader* rasterShader = nullptr;
+	//only created if the context supports compute shaders
+	Shader* computeShader = nullptr;
+	//created on demand and shared with the resources that borrow the programs, the last of them deletes the variants
+	std::shared_ptr<ShaderVariants> variants;
+	//false if the programs are borrowed from other resources, which then have to be destroyed last
+	bool ownsPrograms = true;
+
+	unsigned int framebuffer = 0;
+	unsigned int colorTexture = 0;
+	unsigned int samplesTexture = 0;
+
+	//targets of the compute engine, RGBA32F and R32F with one level per mip
+	unsigned int computeTarget = 0;
+	unsigned int computeSamplesTarget = 0;
+
+	unsigned int squareVAO = 0;
+	unsigned int squareBuffer = 0;
+	unsigned int squareIndexBuffer = 0;
+
+	unsigned int samplePointsTexture = 0;
+	//CPU copy of the uploaded points for the CPU engine
+	std::vector<glm::vec2> samplePoints;
+
+	//resolution and level count the targets above are currently allocated for
+	int targetSize = 0;
+	int targetLevels = 0;
+
+	//environment of the in-memory bakes, only reallocated if the next image has another size
+	unsigned int environmentTexture = 0;
+	int environmentWidth = 0;
+	int environmentHeight = 0;
+	//float copy of an in-memory image for the CPU engine and the light extraction, keeps its capacity between bakes
+	std::vector<float> environmentData;
+};
+
+//environment as GL texture for the GPU engines and as decoded data for the CPU engine
+struct BakeSource
+{
+	unsigned int envMap;
+	EnvironmentMap environment;
+};
+
+//programs optionally provides already linked shader programs, so only the per bake objects are created
+bool createBakeResources(const BakeConfig& config, BakeResources& resources, const BakeResources* programs = nullptr);
+void destroyBakeResources(BakeResources& resources);
+
+//reallocates the render and compute targets if config needs another resolution or level count than they have
+void resizeBakeResources(const BakeConfig& config, BakeResources& resources);
+
+//true if a bake program reads file, directly or through an include
+bool bakeProgramsRead(const std::string& file);
+
+//FNV-1a over every file the bake programs read, as they are currently resolved, changes whenever a shader is edited
+unsigned long long bakeProgramsHash();
+
+//fresh compiles of the bake programs that replace those of a BakeResources once every one of them linked
+struct BakeProgramReload
+{
+	std::unique_ptr<Shader, ProgramDeleter> rasterShader;
+	std::unique_ptr<Shader, ProgramDeleter> computeShader;
+	//the variants of every level of the bake, they replace all variants of the resources
+	ShaderVariants variants;
+};
+
+//submits the programs a bake with config and numOfPoints runs from the current sources, a running reload is dropped
+//with config.specializeShaders those are the variants of every level, the generic programs are only recompiled
+//if compileGeneric is set, resources that were just created compiled theirs from the current sources already
+void beginBakeProgramReload(const BakeConfig& config, const BakeResources& resources, int numOfPoints,
+                            bool compileGeneric, BakeProgramReload& reload);
+
+//true once every program of the reload finished linking, never waits on drivers that compile in the background
+bool bakeProgramReloadReady(BakeProgramReload& reload);
+
+//swaps the programs of a ready reload into resources, which has to own its programs, the old variants are dropped
+//returns false and keeps the old programs if one of the new ones failed to link
+bool finishBakeProgramReload(BakeResources& resources, BakeProgramReload& reload);
+
+//GL internal format of the baked cubemap
+GLenum storageInternalFormat(StorageFormat format);
+
+//clamping, trilinear filtering and the mip range of a baked cubemap, the same for fresh and loaded bakes
+void setCubemapSampling(unsigned int cubeMapTexture, int mipLevels);
+
+//program a GPU engine runs for a level with numOfPoints samples, the specialized variant unless
+//config.specializeShaders is off, a variant is compiled the first time it is asked for
+Shader* bakeProgram(const BakeConfig& config, BakeResources& resources, BakeEngine engine, int mipLevel,
+                    int numOfPoints);
+
+//engine that actually runs, compute and CPU fall back to raster if the context or the source lacks them
+BakeEngine resolveEngine(const BakeConfig& config, const BakeResources& resources, const BakeSource& source);
+
+//generates count points of config.sampleSet and uploads them for the GPU engines, any prefix serves smaller counts
+void uploadSamplePoints(const BakeConfig& config, BakeResources& resources, int count);
+
+//prefilters the six faces of one mip level into faces, +X to -Z with size * size RGB floats each
+//samplesTaken optionally receives the fraction of numOfPoints every texel needed, one float per texel in the same order
+void bakeLevel(const BakeConfig& config, BakeResources& resources, const BakeSource& source, BakeEngine engine,
+               int mipLevel, int numOfPoints, float* faces, float* samplesTaken = nullptr);
+
+//a bake that runs one level per call, from the coarsest level to the base level
+//the cubemap is complete after every call because GL_TEXTURE_BASE_LEVEL points at the finest baked level
+struct BakeStream
+{
+	BakeConfig config;
+	BakeResources* resources = nullptr;
+	const BakeSource* source = nullptr;
+	BakeEngine engine = BakeEngine::Raster;
+	int numOfPoints = 0;
+	unsigned int cubeMapTexture = 0;
+	//level the next call bakes, -1 once every level is done
+	int nextLevel = -1;
+
+	//bake time without the frames in between, time, texels and error of the BC6H encoder
+	double milliseconds = 0.0;
+	double encodeMilliseconds = 0.0;
+	double encodedTexels = 0.0;
+	double squaredError = 0.0;
+	double deltaE = 0.0;
+	size_t compressedBytes = 0;
+};
+
+//uploads the sample points and sets up stream, resources and source are used by every later bakeNextLevel call
+void beginBake(const BakeConfig& config, BakeResources& resources, const BakeSource& source, int numOfPoints,
+               unsigned int cubeMapTexture, BakeStream& stream);
+
+//bakes and uploads stream.nextLevel and lowers the base level to it, returns true while levels are left
+bool bakeNextLevel(BakeStream& stream);
+
+//prefilters every face and mip level with the configured engine and uploads them into cubeMapTexture
+//numOfPoints is the sample cap of this bake, it differs from the config once dominant lights have been extracted
+//levels with an entry in config.mipSamples use that count instead
+bool bakeCubemap(const BakeConfig& config, BakeResources& resources, const BakeSource& source, int numOfPoints,
+                 unsigned int cubeMapTexture);
+
+enum class PixelType
+{
+	Float,
+	Half
+};
+
+//decoded equirect the caller already holds in memory, rows bottom to top like stbi_loadf with a vertical flip
+struct EquirectImage
+{
+	const void* pixels;
+	int width;
+	int height;
+	//3 or 4, alpha is ignored
+	int channels;
+	PixelType type;
+	//bytes from the start of one row to the next, 0 for tightly packed rows
+	size_t rowStride;
+};
+
+//floats of every level baked into memory, the base level first and every level the faces +X to -Z
+//with mipResolution * mipResolution RGB floats each
+size_t bakedFloatCount(const BakeConfig& config);
+
+//uploads image into the environment texture of resources and begins a bake of it into cubeMapTexture
+//source receives the environment and has to outlive the stream like the resources, see beginBake
+bool beginEquirectBake(const BakeConfig& config, BakeResources& resources, const EquirectImage& image,
+                       unsigned int cubeMapTexture, BakeSource& source, BakeStream& stream,
+                       std::vector<DominantLight>* lights = nullptr);
+
+//bakes image into cubeMapTexture without going through a file, config.environmentMap is ignored
+//resources are created once and reused by every call, the environment texture and targets are only resized
+//lights optionally receives the dominant lights cut out of the bake if config.extractLights is set, image is not changed
+bool bakeEquirectToTexture(const BakeConfig& config, BakeResources& resources, const EquirectImage& image,
+                           unsigned int cubeMapTexture, std::vector<DominantLight>* lights = nullptr);
+
+//bakes image like bakeEquirectToTexture, but writes bakedFloatCount(config) floats into levels instead of a texture
+bool bakeEquirectToMemory(const BakeConfig& config, BakeResources& resources, const EquirectImage& image,
+                          float* levels, std::vector<DominantLight>* lights = nullptr);
+
+#endif
@@ -0,0 +1,229 @@
+#include "pch.h"
+#include "CpuPrefilter.h"
+#include "SampleSets.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <thread>
+#include <vector>
+#include "stb_image_write.h"
+
+#define PI 3.14159265358979323846
+
+//samples taken before the error estimate is trusted and how often it is checked afterwards, same as in the shader
+#define minAdaptiveSamples 32
+#define adaptiveCheckInterval 16
+
+namespace
+{
+	uint32_t bitfieldReverse(uint32_t bits)
+	{
+		bits = (bits << 16u) | (bits >> 16u);
+		bits = ((bits & 0x55555555u) << 1u) | ((bits & 0xAAAAAAAAu) >> 1u);
+		bits = ((bits & 0x33333333u) << 2u) | ((bits & 0xCCCCCCCCu) >> 2u);
+		bits = ((bits & 0x0F0F0F0Fu) << 4u) | ((bits & 0xF0F0F0F0u) >> 4u);
+		bits = ((bits & 0x00FF00FFu) << 8u) | ((bits & 0xFF00FF00u) >> 8u);
+		return bits;
+	}
+
+	float sobolSecondDimension(uint32_t i)
+	{
+		uint32_t result = 0;
+		for (uint32_t v = 1u << 31; i != 0; i >>= 1, v ^= v >> 1)
+		{
+			if (i & 1u)
+				result ^= v;
+		}
+		return result / 4294967296.0f;
+	}
+
+	//bilinear lookup with clamp to edge, like the GL_LINEAR sampler of envMap
+	glm::vec3 sampleEnvMap(const EnvironmentMap& env, glm::vec3 vector)
+	{
+		glm::vec3 norm = normalize(vector);
+		float u = std::atan2(norm.x, norm.z) / (2.0f * static_cast<float>(PI)) + 0.5f;
+		float v = norm.y * 0.5f + 0.5f;
+
+		float x = u * env.width - 0.5f;
+		float y = v * env.height - 0.5f;
+		int x0 = static_cast<int>(std::floor(x));
+		int y0 = static_cast<int>(std::floor(y));
+		float fx = x - x0;
+		float fy = y - y0;
+
+		int xs[2] = {std::min(std::max(x0, 0), env.width - 1), std::min(std::max(x0 + 1, 0), env.width - 1)};
+		int ys[2] = {std::min(std::max(y0, 0), env.height - 1), std::min(std::max(y0 + 1, 0), env.height - 1)};
+		float wx[2] = {1.0f - fx, fx};
+		float wy[2] = {1.0f - fy, fy};
+
+		glm::vec3 result(0.0f);
+		for (int j = 0; j < 2; ++j)
+		{
+			for (int i = 0; i < 2; ++i)
+			{
+				const float* texel = env.data + (static_cast<size_t>(ys[j]) * env.width + xs[i]) * env.channels;
+				glm::vec3 value = env.channels >= 3 ? glm::vec3(texel[0], texel[1], texel[2]) : glm::vec3(texel[0]);
+				result += value * (wx[i] * wy[j]);
+			}
+		}
+		return result;
+	}
+}
+
+glm::vec3 cubeFaceDirection(int face, float sc, float tc)
+{
+	switch (face)
+	{
+	case 0: return glm::vec3(1.0f, -tc, -sc);
+	case 1: return glm::vec3(-1.0f, -tc, sc);
+	case 2: return glm::vec3(sc, 1.0f, tc);
+	case 3: return glm::vec3(sc, -1.0f, -tc);
+	case 4: return glm::vec3(sc, -tc, 1.0f);
+	default: return glm::vec3(-sc, -tc, -1.0f);
+	}
+}
+
+/*	Method is a line by line port of filterMap in cubeMapFrag.frag
+ *
+ *	env: the environment map to sample
+ *	normal: direction of the texel that gets filtered
+ *	settings: specular exponent, sample count, error threshold and point set of the current mip level
+ *	rotation: Cranley-Patterson offset added to every point of this texel
+ *	samplesTaken: optional, receives the number of samples until the estimate converged
+ *
+ *	Returns the filtered radiance
+ */
+glm::vec3 filterMap(const EnvironmentMap& env, glm::vec3 normal, const PrefilterSettings& settings,
+                    glm::vec2 rotation, int* samplesTaken)
+{
+	glm::vec3 norm = normalize(normal);
+	glm::vec3 up = std::fabs(norm.z) < 0.999f ? glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(1.0f, 0.0f, 0.0f);
+	glm::vec3 tangent = normalize(cross(up, norm));
+	glm::vec3 bitangent = cross(norm, tangent);
+
+	const bool adaptive = settings.errorThreshold > 0.0f;
+	const float exponent = 1.0f / (settings.specular + 1.0f);
+
+	float sum = 0.0f;
+	float sumSquared = 0.0f;
+	float mean = 0.0f;
+	float m2 = 0.0f;
+	glm::vec3 result(0.0f);
+	int i = 0;
+
+	while (i < settings.numOfPoints)
+	{
+		float hx, hy;
+		if (settings.samplePoints)
+		{
+			hx = settings.samplePoints[i].x;
+			hy = settings.samplePoints[i].y;
+		}
+		else
+		{
+			hx = adaptive ? sobolSecondDimension(i) : static_cast<float>(i) / settings.numOfPoints;
+			hy = bitfieldReverse(i) / 4294967296.0f;
+		}
+		if (settings.rotateSamples)
+		{
+			hx += rotation.x;
+			hy += rotation.y;
+			hx -= std::floor(hx);
+			hy -= std::floor(hy);
+		}
+
+		float theta = std::acos(std::pow(hy, exponent));
+		float phi = 2.0f * static_cast<float>(PI) * hx;
+		float sineTheta = std::sin(theta);
+		glm::vec3 L = tangent * (sineTheta * std::cos(phi)) + bitangent * (sineTheta * std::sin(phi)) +
+			norm * std::cos(theta);
+
+		float pNoL = std::pow(std::max(dot(norm, L), 0.0f), settings.specular);
+		glm::vec3 envSample = sampleEnvMap(env, L);
+
+		result += envSample * pNoL;
+		sum += pNoL;
+		++i;
+
+		float lum = dot(envSample, glm::vec3(0.2126f, 0.7152f, 0.0722f));
+		float delta = lum - mean;
+		sumSquared += pNoL * pNoL;
+		mean += sum > 0.0f ? (pNoL / sum) * delta : 0.0f;
+		m2 += pNoL * delta * (lum - mean);
+
+		if (adaptive && i >= minAdaptiveSamples && i % adaptiveCheckInterval == 0 && sum > 0.0f)
+		{
+			float meanVariance = (m2 / sum) * sumSquared / (sum * sum);
+			if (std::sqrt(meanVariance) <= settings.errorThreshold * std::max(mean, 1e-4f))
+				break;
+		}
+	}
+
+	if (samplesTaken)
+		*samplesTaken = i;
+	return sum > 0.0f ? result / sum : result;
+}
+
+void prefilterFace(const EnvironmentMap& env, int face, int size, const PrefilterSettings& settings,
+                   float* result, float* samplesTaken)
+{
+	std::atomic<int> nextRow(0);
+
+	auto worker = [&]()
+	{
+		for (int y = nextRow++; y < size; y = nextRow++)
+		{
+			float tc = (y + 0.5f) / size * 2.0f - 1.0f;
+			for (int x = 0; x < size; ++x)
+			{
+				float sc = (x + 0.5f) / size * 2.0f - 1.0f;
+				int taken;
+				glm::vec3 color = filterMap(env, cubeFaceDirection(face, sc, tc), settings,
+				                            texelRotation(x + 0.5f, y + 0.5f), &taken);
+
+				size_t texel = static_cast<size_t>(y) * size + x;
+				result[texel * 3 + 0] = color.x;
+				result[texel * 3 + 1] = color.y;
+				result[texel * 3 + 2] = color.z;
+				if (samplesTaken)
+					samplesTaken[texel] = static_cast<float>(taken) / settings.numOfPoints;
+			}
+		}
+	};
+
+	std::vector<std::thread> threads;
+	unsigned int threadCount = std::max(1u, std::thread::hardware_concurrency());
+	for (unsigned int t = 1; t < threadCount; ++t)
+		threads.emplace_back(worker);
+	worker();
+	for (std::thread& thread : threads)
+		thread.join();
+}
+
+bool writeSampleHeatmap(const std::string& path, const float* samplesTaken, int width, int height)
+{
+	//blue -> cyan -> green -> yellow -> red
+	const float ramp[5][3] = {{0, 0, 1}, {0, 1, 1}, {0, 1, 0}, {1, 1, 0}, {1, 0, 0}};
+
+	std::vector<unsigned char> pixels(static_cast<size_t>(width) * height * 3);
+	for (int y = 0; y < height; ++y)
+	{
+		//the GL rows start at the bottom, PNG rows at the top
+		const float* row = samplesTaken + static_cast<size_t>(height - 1 - y) * width;
+		for (int x = 0; x < width; ++x)
+		{
+			float t = std::min(std::max(row[x], 0.0f), 1.0f) * 4.0f;
+			int segment = std::min(static_cast<int>(t), 3);
+			float f = t - segment;
+
+			for (int c = 0; c < 3; ++c)
+			{
+				float value = ramp[segment][c] + (ramp[segment + 1][c] - ramp[segment][c]) * f;
+				pixels[(static_cast<size_t>(y) * width + x) * 3 + c] = static_cast<unsigned char>(value * 255.0f + 0.5f);
+			}
+		}
+	}
+
+	return stbi_write_png(path.c_str(), width, height, 3, pixels.data(), width * 3) != 0;
+}
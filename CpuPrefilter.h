@@ -0,0 +1,45 @@
+#ifndef CPU_PREFILTER_H
+#define CPU_PREFILTER_H
+
+#include <string>
+#include <glm/glm.hpp>
+
+//decoded equirect as returned by stbi_loadf, rows bottom to top
+struct EnvironmentMap
+{
+	const float* data;
+	int width;
+	int height;
+	int channels;
+};
+
+//parameters of one prefilter pass, mirrors the uniforms of cubeMapFrag.frag
+struct PrefilterSettings
+{
+	float specular;
+	int numOfPoints;
+	//relative standard error at which a texel stops sampling, 0 always takes numOfPoints samples
+	float errorThreshold;
+	//precomputed points from generateSamplePoints, nullptr computes Hammersley points in place
+	const glm::vec2* samplePoints;
+	//offset the points of every texel by texelRotation
+	bool rotateSamples;
+};
+
+//direction through the texel center (sc, tc) in [-1, 1] of a cubemap face, following the GL cubemap layout
+glm::vec3 cubeFaceDirection(int face, float sc, float tc);
+
+//CPU version of filterMap in cubeMapFrag.frag, samplesTaken receives the number of samples the texel needed
+//rotation is the Cranley-Patterson offset of the texel, only applied if settings.rotateSamples is set
+glm::vec3 filterMap(const EnvironmentMap& env, glm::vec3 normal, const PrefilterSettings& settings,
+                    glm::vec2 rotation = glm::vec2(0.0f), int* samplesTaken = nullptr);
+
+//prefilters a whole face of size x size texels into RGB floats on all hardware threads
+//samplesTaken optionally receives the fraction of numOfPoints every texel needed
+void prefilterFace(const EnvironmentMap& env, int face, int size, const PrefilterSettings& settings,
+                   float* result, float* samplesTaken = nullptr);
+
+//writes sample fractions as a blue to red PNG for debugging the adaptive sampling
+bool writeSampleHeatmap(const std::string& path, const float* samplesTaken, int width, int height);
+
+#endif
@@ -4,26 +4,49 @@
 #include <glfw3.h>
 #include "Shader.h"
 #include <vector>
+#include <algorithm>
+#include <memory>
+#include <chrono>
+#include <fstream>
+#include <future>
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 #include <glm/gtx/quaternion.hpp>
 #include <xlocmon>
 #include "stb_image.h"
+#include "LightExtraction.h"
+#include "BakeConfig.h"
+#include "Baker.h"
+#include "CubemapBaker.h"
+#include "FrameUniforms.h"
+#include "BakeTuner.h"
+#include "BakedCubemap.h"
+#include "SharedCubemap.h"
+#include "GLExtensions.h"
+#include "StartupTrace.h"
+#include "ShaderWatcher.h"
+#include "MeshOptimizer.h"
+#include "SphereMesh.h"
 
 
-//invAtan is a vec2 consisting of the parameters to clamp the sphere coordinates into the UV range
-//which are computed in the Fragment Shader 
-//x-coord: 2*PI approximation
-//y-coord: PI approximation
-#define numOfPoints 2048
-#define PI 3.14159265358979323846
 #define screenWidth 800
 #define screenHeight 600
-#define cubeMapWidth 512
-#define cubeMapHeight 512
-
-float mipmaps = 8.0f;
+#define sphereRadius 1.0f
+//the sphere levels of detail run from sphereCoarsestSectors x sphereCoarsestSectors / 2 up, doubling every level
+#define sphereCoarsestSectors 16
+#define sphereLodLevels 5
+//deviation of the drawn silhouette from the true sphere the chosen level of detail may have
+#define sphereLodPixelError 0.5f
+//frames a draw time query gets before its result is read, so reading it never waits for the GPU
+#define drawTimerQueries 4
+//the preview grid fills the square of this half size the single sphere covers, its rows run between these exposures
+#define previewGridExtent 1.2f
+#define previewMinExposure 0.25f
+#define previewMaxExposure 2.0f
+
+//resolution, mip chain, sample counts, storage format and engine of the bake, filled from the command line
+BakeConfig bakeConfig;
 
 float totalXRotation = 0.0f;
 glm::quat orientationQuat = glm::quat(1, 0, 0, 0);
@@ -50,17 +73,61 @@ bool mouseButtonPressed = false;
 void processInput(GLFWwindow* window);
 void mouse_callback(GLFWwindow* window, int button, int action, int mods);
 void mouse_move_callback(GLFWwindow* window, double xpos, double ypos);
-//method to create Sphere Coordinates to draw the Sphere! Check definition for more details
-void createSphereCoordinates(float radius, float sectors, float stacks, std::vector<unsigned int>& EBO,
-                             std::vector<float>& buffer);
+
+//everything the worker thread prepares while the driver compiles the programs
+struct StartupAssets
+{
+	float* data = nullptr;
+	int width = 0;
+	int height = 0;
+	int nrChannels = 0;
+	std::vector<DominantLight> lights;
+	//compact format filled if config.compactMesh is set and every level fits 16 bit indices
+	SphereLodChain sphere;
+};
+
+StartupAssets loadStartupAssets(BakeConfig config, bool decode);
+void decodeEnvironment(const BakeConfig& config, StartupAssets& assets, const char* lane);
 
 void framebuffer_size_callback(GLFWwindow* window, int width, int height)
 {
 	glViewport(0, 0, width, height);
 }
 
-int main()
+int main(int argc, char** argv)
 {
+	//time to the first frame with a cubemap is measured from here
+	auto startTime = std::chrono::steady_clock::now();
+	beginStartupTrace();
+
+	if (!parseBakeArguments(argc, argv, bakeConfig))
+		std::cout << "Continuing with the valid part of the bake configuration" << std::endl;
+	//watched shaders are edited in place, so the files have to replace the embedded sources
+	setShaderDirectory(bakeConfig.watchShaders && bakeConfig.shaderDirectory.empty() ? "." : bakeConfig.shaderDirectory);
+	//the binaries go where the executable is, not into whatever directory a farm job runs in
+	setProgramCacheDirectory(bakeConfig.programCache.empty() ? executableDirectory() : bakeConfig.programCache);
+
+	//a consumer only reads the segment of another instance, it needs neither a window nor a context
+	if (!bakeConfig.consume.empty())
+		return runSharedCubemapConsumer(bakeConfig.consume);
+	if (bakeConfig.benchmarkSphere)
+		return runSphereBenchmark(2048, 1024);
+
+	//a saved bake with the same settings most likely replaces the bake, then the environment is only decoded if the
+	//saved bake turns out to be stale, tuning and the debug outputs always need a fresh bake
+	const std::string bakedPath = bakedCubemapPath(bakeConfig);
+	bool mustBake = bakeConfig.rebake || bakeConfig.tune || bakeConfig.sampleHeatmap || bakeConfig.dumpFaces;
+	bool savedBake = static_cast<bool>(std::ifstream(bakedPath));
+	bool decodeUpFront = mustBake || !savedBake || bakeConfig.benchmarkBakes > 0 || bakeConfig.compareSampleSets ||
+		bakeConfig.compareVariants;
+
+	//startup runs as a small dependency graph: a worker decodes the environment and builds the sphere while the
+	//driver compiles the programs, the main thread only waits where it first needs one of them
+	stbi_set_flip_vertically_on_load(true);
+	std::future<StartupAssets> assetsFuture = std::async(std::launch::async, loadStartupAssets, bakeConfig,
+	                                                     decodeUpFront);
+
+	double contextStart = traceNow();
 	glfwInit();
 	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
 	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 4);
@@ -75,6 +142,7 @@ int main()
 		std::cout << "Failed to initialize GLAD" << std::endl;
 		return -1;
 	}
+	loadGLExtensions((GLADloadproc)glfwGetProcAddress);
 
 	glViewport(0, 0, screenWidth, screenHeight);
 
@@ -83,237 +151,220 @@ int main()
 	glfwSetMouseButtonCallback(window, mouse_callback);
 	glfwSetCursorPosCallback(window, mouse_move_callback);
 
-	//initialize the Shaders for the Offscreen-Renderpass and final image
-	Shader cubeMapShader("cubeMapVert.vs", "cubeMapFrag.frag");
-	Shader ourShader("vert.vs", "envFrag.fs");
-
-	//create and read the environment map texture
-	//-------------------------------------------------------------------------
-	int width, height, nrChannels;
-	stbi_set_flip_vertically_on_load(true);
-
-	float* data = stbi_loadf("cedar_bridge_1k1.hdr",
-	                         &width, &height, &nrChannels, 0);
+	traceSpan("main", "create context", contextStart, traceNow());
 
-	if (!data)
-		std::cout << "Image not loaded correctly" << std::endl;
-
-	unsigned int envMap;
-	glGenTextures(1, &envMap);
-	glBindTexture(GL_TEXTURE_2D, envMap);
-
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB32F, width, height, 0, GL_RGB, GL_FLOAT, data);
-
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	stbi_image_free(data);
+	if (hasParallelShaderCompile())
+		glMaxShaderCompilerThreadsKHR(0xFFFFFFFF);
 
-	//allocate framebuffer for the cubemap generation
-	//-------------------------------------------------------------------------
-	unsigned int cubeMapBuffer;
-	glGenFramebuffers(1, &cubeMapBuffer);
-	glBindFramebuffer(GL_FRAMEBUFFER, cubeMapBuffer);
-
-	unsigned int bufferTexture;
-	glGenTextures(1, &bufferTexture);
-	glBindTexture(GL_TEXTURE_2D, bufferTexture);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB32F, cubeMapWidth, cubeMapHeight, 0, GL_RGB, GL_FLOAT, nullptr);
-
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-	glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, bufferTexture, 0);
+	//initialize the Shader for the final image, the baker creates its own
+	//the compact mesh only stores normals, vert.vs rebuilds the positions from them
+	//the impostor reads no mesh at all, impostor.vs places a quad over the sphere and envFrag.fs traces it
+	//the preview grid draws the mesh with per instance values, INSTANCED adds them to vert.vs and envFrag.fs
+	double displaySubmit = traceNow();
+	if (bakeConfig.impostor && bakeConfig.previewGrid > 0)
+	{
+		std::cout << "The preview grid is drawn from the mesh, ignoring --impostor" << std::endl;
+		bakeConfig.impostor = false;
+	}
+	const char* displayVertexShader = bakeConfig.impostor ? "impostor.vs" : "vert.vs";
+	ShaderDefines displayDefines;
+	if (bakeConfig.impostor)
+		displayDefines = {{"IMPOSTOR", "1"}, {"SPHERE_RADIUS", std::to_string(sphereRadius)}};
+	else if (bakeConfig.compactMesh)
+		displayDefines = {{"COMPACT_MESH", "1"}, {"SPHERE_RADIUS", std::to_string(sphereRadius)}};
+	if (bakeConfig.previewGrid > 0)
+		displayDefines.push_back({"INSTANCED", "1"});
+	Shader ourShader(displayVertexShader, "envFrag.fs", displayDefines);
+	std::cout << "Display shader " << (ourShader.fromCache ? "loaded from its program binary" : "submitted to the compiler")
+		<< std::endl;
+
+	//the bake programs are submitted right away as well, unless a saved bake will most likely replace the bake
+	BakeResources bakeResources;
+	double bakeSubmit = traceNow();
+	if (mustBake || !savedBake)
+	{
+		if (!createBakeResources(bakeConfig, bakeResources))
+			return -1;
+	}
 
-	// Set the draw buffers, only one per pass is needed in this case since we only want to render one cubemap face
-	GLenum DrawBuffers[1] = {GL_COLOR_ATTACHMENT0};
-	glDrawBuffers(1, DrawBuffers);
+	//the programs are polled while the worker is busy, so the trace shows when the driver finished each of them
+	struct PendingProgram
+	{
+		Shader* shader;
+		const char* name;
+		double submitted;
+	};
+	std::vector<PendingProgram> pendingPrograms = {{&ourShader, "link display program", displaySubmit}};
+	if (bakeResources.rasterShader)
+		pendingPrograms.push_back({bakeResources.rasterShader, "link bake program", bakeSubmit});
+	if (bakeResources.computeShader)
+		pendingPrograms.push_back({bakeResources.computeShader, "link compute program", bakeSubmit});
+	auto pollPrograms = [&pendingPrograms]()
+	{
+		for (size_t i = 0; i < pendingPrograms.size();)
+		{
+			if (!pendingPrograms[i].shader->ready())
+			{
+				++i;
+				continue;
+			}
+			traceSpan("driver", pendingPrograms[i].name, pendingPrograms[i].submitted, traceNow());
+			pendingPrograms.erase(pendingPrograms.begin() + i);
+		}
+	};
 
-	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
-		return false;
+	double waitStart = traceNow();
+	while (assetsFuture.wait_for(std::chrono::milliseconds(1)) != std::future_status::ready)
+		pollPrograms();
+	traceSpan("main", "wait for worker", waitStart, traceNow());
 
-	//Now that we have our Buffer for the Cubemap rendering we can create the needed geometry
+	//create and read the environment map texture
 	//-------------------------------------------------------------------------
+	StartupAssets assets = assetsFuture.get();
+	float* data = assets.data;
+	int width = assets.width;
+	int height = assets.height;
+	int nrChannels = assets.nrChannels;
 
-	//square that covers the whole screen for the cubemap face generation
-	float squareCoordinates[] = {
-		//vertex coordinates   //normals
-		1.0f, 1.0f, 0.0f, 1.0f, 1.0f, 0.0f,
-		1.0f, -1.0f, 0.0f, 1.0f, 1.0f, 0.0f,
-		-1.0f, -1.0f, 0.0f, 1.0f, 1.0f, 0.0f,
-		-1.0f, 1.0f, 0.0f, 1.0f, 1.0f, 0.0f,
-	};
+	if (decodeUpFront && !data)
+		std::cout << "Image not loaded correctly" << std::endl;
 
-	//cubemap coordinates for the front and back points in 3d space
-	/*orientation analog for front and back, numbers are the indices:
-	 * 3---0
-	 * |   |
-	 * |   |
-	 * 2---1
-	 */
-	float cubeNormals[] = {
-		//front
-		1.0f, 1.0f, 1.0f,
-		1.0f, -1.0f, 1.0f,
-		-1.0f, -1.0f, 1.0f,
-		-1.0f, 1.0f, 1.0f,
-
-		//back
-		1.0f, 1.0f, -1.0f,
-		1.0f, -1.0f, -1.0f,
-		-1.0f, -1.0f, -1.0f,
-		-1.0f, 1.0f, -1.0f
-	};
+	if (bakeConfig.benchmarkBakes > 0 && data)
+	{
+		EquirectImage image = {data, width, height, nrChannels, PixelType::Float, 0};
+		int result = runBakerBenchmark(bakeConfig, image);
+		stbi_image_free(data);
+		glfwTerminate();
+		return result;
+	}
 
-	//indices to assign the normals to the appropriate faces 
-	short cubeIndices[]
+	//the worker cut the sun and similar spikes out of the environment, the display shader adds them back analytically
+	const std::vector<DominantLight>& lights = assets.lights;
+	for (const DominantLight& light : lights)
 	{
-		//right
-		5, 4, 0, 1,
-		//left
-		2, 3, 7, 6,
-
-		//top
-		0, 4, 7, 3,
-		//bottom
-		5, 1, 2, 6,
-
-		//back
-		1, 0, 3, 2,
-		//front
-		6, 7, 4, 5
-	};
+		std::cout << "Dominant light: direction (" << light.direction.x << ", " << light.direction.y << ", "
+			<< light.direction.z << ")   color (" << light.color.x << ", " << light.color.y << ", "
+			<< light.color.z << ")   solid angle " << light.solidAngle << std::endl;
+	}
 
-	//indices for drawing the square
-	unsigned int squareIndices[] = {
-		0, 1, 3,
-		1, 2, 3
-	};
+	//without the spikes the residual converges with far fewer samples
+	int bakeNumOfPoints = lights.empty() ? bakeConfig.numOfPoints : bakeConfig.residualNumOfPoints;
 
-	//usual buffer creation and binding
-	unsigned int squareBuffer, squareIndexBuffer, squareVAO;
-	glGenVertexArrays(1, &squareVAO);
-	glGenBuffers(1, &squareBuffer);
-	glGenBuffers(1, &squareIndexBuffer);
+	//the environment is decoded and uploaded once the first bake needs it, loading a saved bake never does
+	//the CPU engine reads the decoded data directly, so it is only freed after the bake
+	unsigned int envMap = 0;
+	BakeSource bakeSource = {0, {nullptr, 0, 0, 0}};
+	auto prepareEnvironment = [&]()
+	{
+		if (envMap)
+			return;
+		if (!data)
+		{
+			decodeEnvironment(bakeConfig, assets, "main");
+			data = assets.data;
+			width = assets.width;
+			height = assets.height;
+			nrChannels = assets.nrChannels;
+			bakeNumOfPoints = lights.empty() ? bakeConfig.numOfPoints : bakeConfig.residualNumOfPoints;
+			if (!data)
+				std::cout << "Image not loaded correctly" << std::endl;
+		}
 
-	glBindVertexArray(squareVAO);
+		double uploadStart = traceNow();
+		glGenTextures(1, &envMap);
+		glBindTexture(GL_TEXTURE_2D, envMap);
 
-	glBindBuffer(GL_ARRAY_BUFFER, squareBuffer);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(squareCoordinates), squareCoordinates, GL_STATIC_DRAW);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, squareIndexBuffer);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(squareIndices), squareIndices, GL_STATIC_DRAW);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB32F, width, height, 0, GL_RGB, GL_FLOAT, data);
 
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), static_cast<void*>(nullptr));
-	glEnableVertexAttribArray(0);
-	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)(3 * sizeof(float)));
-	glEnableVertexAttribArray(1);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		traceSpan("main", "upload environment", uploadStart, traceNow());
 
-	//offscreen renderpass
-	//-------------------------------------------------------------------------
+		bakeSource = {envMap, {data, width, height, nrChannels}};
+	};
 
-	//create mipmap resolution array
-	std::vector<int> mipResolutions;
-	mipResolutions.push_back(cubeMapHeight);
-	for (int i = 1; i < mipmaps + 1; ++i)
+	if (bakeConfig.compareSampleSets && data)
 	{
-		mipResolutions.push_back(mipResolutions[i - 1] * 0.5);
+		compareSampleSets({data, width, height, nrChannels}, bakeConfig.numOfPoints);
+		stbi_image_free(data);
+		glfwTerminate();
+		return 0;
 	}
 
-	cubeMapShader.use();
-
-	//no depth test needed since the square covers the entire screen
-	glDisable(GL_DEPTH_TEST);
-
-	glBindFramebuffer(GL_FRAMEBUFFER, cubeMapBuffer);
+	if (bakeConfig.compareVariants && data)
+	{
+		prepareEnvironment();
+		if (bakeResources.rasterShader || createBakeResources(bakeConfig, bakeResources))
+			compareShaderVariants(bakeConfig, bakeResources, bakeSource, bakeNumOfPoints);
+		destroyBakeResources(bakeResources);
+		stbi_image_free(data);
+		glfwTerminate();
+		return 0;
+	}
 
 	//generate the main Cubemap
 	unsigned int cubeMapTexture;
 	glGenTextures(1, &cubeMapTexture);
 
-	glUniform1f(glGetUniformLocation(cubeMapShader.ID, "numOfPoints"), numOfPoints);
-	glUniform1f(glGetUniformLocation(cubeMapShader.ID, "PI"), PI);
+	//a saved bake with the same settings replaces the bake, tuning and the debug outputs always need a fresh one
+	//either way the levels arrive coarsest first, one per frame, so the first image does not wait for the base level
+	BakedCubemapStream loadStream;
+	bool loading = !mustBake && beginBakedCubemapLoad(bakedPath, bakeConfig,
+	                                                  bakeSettingsHash(bakeConfig, bakeNumOfPoints), cubeMapTexture,
+	                                                  loadStream);
 
-	for (int i = 0; i < 6; ++i)
+	//offscreen renderpass
+	//-------------------------------------------------------------------------
+	BakeStream bakeStream;
+	bool baking = !loading;
+	if (baking)
 	{
-		//loop to change the normals for each face
-		//-------------------------------------------------------------------------
-		for (int n = 0; n < 4; ++n)
-		{
-			//offset to iterate over the second batch of coordinates in our vertex buffer
-			//every line is 6 indeces big and 3 of them are the screen Coordinates
-			short offset = n * 6 + 3;
-
-			//compute the index of the next coordinate as cubeIndices holds all indices for all Cubemap faces
-			//every line of indices in cubeIndices is sorted by face index,
-			//the index of n-th point of the i-th face (multiplied by 4 since 4 indices are in every row and have to be jumped over
-			//This index is then mulitplied by 3 to jump over each pair of 3 coordinates in the actual cubeNormals array for index-times
-			short pos = cubeIndices[n + (4 * i)] * 3;
-
-			//since both offset and pos now point to the first coordinate of a coordinate triplet we can simply iterate over it
-			squareCoordinates[offset++] = cubeNormals[pos++];
-			squareCoordinates[offset++] = cubeNormals[pos++];
-			squareCoordinates[offset] = cubeNormals[pos];
-		}
+		//only if the saved bake turned out to be stale
+		if (!bakeResources.rasterShader && !createBakeResources(bakeConfig, bakeResources))
+			return -1;
+		prepareEnvironment();
 
-		glBindVertexArray(squareVAO);
-		glBufferData(GL_ARRAY_BUFFER, sizeof(squareCoordinates), squareCoordinates, GL_STATIC_DRAW);
-
-		//loop to create the MIP levels manually
-		//9 since the base texture is 512 pixel (2^9)
-		//-------------------------------------------------------------------------
-		for (int mipLevel = 0; mipLevel < 9; ++mipLevel)
+		//the tuned schedule replaces the sampling settings of this bake and is saved for the next ones
+		if (bakeConfig.tune)
 		{
-			int tempCubeMapWidth = mipResolutions[mipLevel];
-			int tempCubeMapHeight = mipResolutions[mipLevel];
-
-			//resize the viewport to fit the mipmap resolution
-			glViewport(0, 0, tempCubeMapWidth, tempCubeMapHeight);
-
-			glBindTexture(GL_TEXTURE_2D, envMap);
-
-			//compute the specular exponent, the higher the mip level the lower the value should be
-			float exponent = 1.0f - (mipLevel / mipmaps);
-			float specular = pow(2, 15 * exponent);
-
-			glUniform1f(glGetUniformLocation(ourShader.ID, "specular"), specular);
-
-			glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, nullptr);
-
-			//bind the cubemap after the offscreen rendering pass
-			glBindTexture(GL_TEXTURE_CUBE_MAP, cubeMapTexture);
-			glReadBuffer(GL_COLOR_ATTACHMENT0);
-
-			//compute texture dimensions and read it into the buffer
-			float* texBuffer = new float[tempCubeMapWidth * tempCubeMapHeight * 3];
-
-			glReadPixels(0, 0, tempCubeMapWidth, tempCubeMapHeight, GL_RGB, GL_FLOAT, texBuffer);
-
-			glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i,
-			             mipLevel,
-			             GL_RGB32F,
-			             tempCubeMapWidth, tempCubeMapHeight, 0,
-			             GL_RGB, GL_FLOAT, texBuffer);
+			BakeProfile profile = tuneBake(bakeConfig, bakeResources, bakeSource, bakeNumOfPoints);
+			writeBakeProfile(bakeProfilePath(bakeConfig), profile);
+			bakeConfig = profile.config;
 		}
-	}
 
-	//set different parameters for filtering
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAX_LEVEL, mipmaps);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_CUBE_MAP_SEAMLESS, 1);
+		beginBake(bakeConfig, bakeResources, bakeSource, bakeNumOfPoints, cubeMapTexture, bakeStream);
+	}
+	else
+	{
+		//the decoded environment is only needed by the CPU engine
+		stbi_image_free(data);
+		data = nullptr;
+		bakeSource.environment.data = nullptr;
+	}
 
-	//Bind our main framebuffer to actually prepare the final scene
-	//-------------------------------------------------------------------------
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	//other processes can pick up every level as soon as it arrived here
+	SharedCubemapPublisher publisher;
+	if (!bakeConfig.publish.empty())
+		beginSharedCubemap(bakeConfig.publish, bakeConfig, bakeSettingsHash(bakeConfig, bakeNumOfPoints), publisher);
 
-	//get our relevant coordinates and begin filling up the buffers for the sphere model
-	std::vector<unsigned int> indices;
-	std::vector<float> vertices;
-	createSphereCoordinates(1.0, 144, 72, indices, vertices);
+	//the worker already computed the coordinates, fill up the buffers for the sphere model
+	const SphereLodChain& sphere = assets.sphere;
+	const std::vector<unsigned int>& indices = sphere.indices;
+	const std::vector<float>& vertices = sphere.vertices;
+	const CompactMesh& compact = sphere.compact;
+	const bool compactMesh = !compact.indices.empty();
 
+	//the display program was submitted before the worker knew whether the sphere fits the compact format
+	if (!bakeConfig.impostor && bakeConfig.compactMesh && !compactMesh)
+	{
+		ourShader.release();
+		displayDefines.clear();
+		if (bakeConfig.previewGrid > 0)
+			displayDefines.push_back({"INSTANCED", "1"});
+		ourShader = Shader("vert.vs", "envFrag.fs", displayDefines);
+	}
 
 	unsigned int buffer, VAO, EBO;
 	glGenVertexArrays(1, &VAO);
@@ -323,60 +374,365 @@ int main()
 	// bind the Vertex Array Object first, then bind and set vertex buffer(s), and then configure vertex attributes(s).
 	glBindVertexArray(VAO);
 
-	glBindBuffer(GL_ARRAY_BUFFER, buffer);
-	glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(float), vertices.data(), GL_STATIC_DRAW);
+	GLenum indexType;
+	size_t vertexBytes, indexBytes;
+	if (compactMesh)
+	{
+		vertexBytes = compact.vertexBytes();
+		indexBytes = compact.indexBytes();
+		indexType = GL_UNSIGNED_SHORT;
 
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), indices.data(), GL_STATIC_DRAW);
+		glBindBuffer(GL_ARRAY_BUFFER, buffer);
+		glBufferData(GL_ARRAY_BUFFER, vertexBytes, compact.normals.data(), GL_STATIC_DRAW);
 
-	//coordinates
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), static_cast<void*>(nullptr));
-	//normals
-	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)(3 * sizeof(float)));
-	glEnableVertexAttribArray(0);
-	glEnableVertexAttribArray(1);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexBytes, compact.indices.data(), GL_STATIC_DRAW);
 
+		//octahedral normals, the positions are rebuilt from them
+		glVertexAttribPointer(0, 2, GL_SHORT, GL_TRUE, 2 * sizeof(short), static_cast<void*>(nullptr));
+		glEnableVertexAttribArray(0);
+	}
+	else
+	{
+		vertexBytes = vertices.size() * sizeof(float);
+		indexBytes = indices.size() * sizeof(unsigned int);
+		indexType = GL_UNSIGNED_INT;
+
+		glBindBuffer(GL_ARRAY_BUFFER, buffer);
+		glBufferData(GL_ARRAY_BUFFER, vertexBytes, vertices.data(), GL_STATIC_DRAW);
+
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexBytes, indices.data(), GL_STATIC_DRAW);
+
+		//coordinates
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), static_cast<void*>(nullptr));
+		//normals
+		glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)(3 * sizeof(float)));
+		glEnableVertexAttribArray(0);
+		glEnableVertexAttribArray(1);
+	}
+	const size_t indexSize = compactMesh ? sizeof(unsigned short) : sizeof(unsigned int);
+	std::cout << "Sphere buffers: " << vertexBytes << " bytes of vertices and " << indexBytes << " bytes of indices, "
+		<< (compactMesh ? "compact" : "float") << " format, " << sphere.lods.size() << " levels of detail" << std::endl;
+
+	//transform, roughness and exposure of every sphere of the preview grid, advanced once per instance
+	//the matrix takes the four locations from 2 on, one column each
+	unsigned int instanceBuffer = 0;
+	std::vector<SphereInstance> previewInstances;
+	float previewScale = 1.0f;
+	if (bakeConfig.previewGrid > 0)
+	{
+		previewScale = buildPreviewGrid(bakeConfig.previewGrid, sphereRadius, previewGridExtent, previewMinExposure,
+		                                previewMaxExposure, previewInstances);
+		glGenBuffers(1, &instanceBuffer);
+		glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+		glBufferData(GL_ARRAY_BUFFER, previewInstances.size() * sizeof(SphereInstance), previewInstances.data(),
+		             GL_STATIC_DRAW);
+		for (int column = 0; column < 4; ++column)
+		{
+			glVertexAttribPointer(2 + column, 4, GL_FLOAT, GL_FALSE, sizeof(SphereInstance),
+			                      reinterpret_cast<void*>(offsetof(SphereInstance, transform) + column * sizeof(glm::vec4)));
+			glEnableVertexAttribArray(2 + column);
+			glVertexAttribDivisor(2 + column, 1);
+		}
+		glVertexAttribPointer(6, 2, GL_FLOAT, GL_FALSE, sizeof(SphereInstance),
+		                      reinterpret_cast<void*>(offsetof(SphereInstance, roughness)));
+		glEnableVertexAttribArray(6);
+		glVertexAttribDivisor(6, 1);
+		std::cout << "Preview grid: " << previewInstances.size() << " spheres in one draw, "
+			<< previewInstances.size() * sizeof(SphereInstance) << " bytes of instance data" << std::endl;
+	}
 
-	//Viewport reset
-	glViewport(0, 0, screenWidth, screenHeight);
-	glEnable(GL_DEPTH_TEST);
 
 	glBindTexture(GL_TEXTURE_2D, 0);
 
+	//the extracted lights never change, so they only have to be set once per display program
+	//everything that changes per frame lives in the FrameData block, written into the next region of a ring
+	auto setupDisplayProgram = [&lights](Shader& shader)
+	{
+		shader.use();
+		shader.setInt(shader.uniform("numLights"), static_cast<int>(lights.size()));
+		for (size_t i = 0; i < lights.size(); ++i)
+		{
+			std::string index = "[" + std::to_string(i) + "]";
+			shader.setVec3(shader.uniform("lightDirection" + index), lights[i].direction);
+			shader.setVec3(shader.uniform("lightColor" + index), lights[i].color);
+			shader.setFloat(shader.uniform("lightSolidAngle" + index), lights[i].solidAngle);
+		}
+		shader.bindUniformBlock("FrameData", frameDataBinding);
+	};
+	setupDisplayProgram(ourShader);
+	UniformRing frameUniforms;
+	if (!frameUniforms.create(sizeof(FrameData)))
+		return -1;
+
+	//the window keeps its size, so the projection is the same for every frame
+	const glm::mat4 projection = glm::perspective(glm::radians(90.0f), static_cast<float>(screenWidth) /
+	                                              static_cast<float>(screenHeight), 0.1f, 100.0f);
+	double frameSetupMicroseconds = 0.0;
+	long long frames = 0;
+
+	//GPU time of the sphere draw, every query is read drawTimerQueries frames after it was issued
+	unsigned int drawQueries[drawTimerQueries];
+	bool drawQueryIssued[drawTimerQueries] = {};
+	glGenQueries(drawTimerQueries, drawQueries);
+	double drawMilliseconds = 0.0;
+	long long timedDraws = 0;
+	//level of detail of the last frame, reported whenever it changes
+	int sphereLod = -1;
+
+	//finest level of the cubemap that exists so far, the display shader offsets its lod by it
+	int baseLevel = bakeConfig.mipLevels();
+	bool firstImage = true;
+
+	//edited shaders are compiled next to the running viewer and only swapped in once they linked
+	//a bake program re-bakes from the uploaded environment, a display program is just replaced
+	ShaderWatcher shaderWatcher;
+	if (bakeConfig.watchShaders)
+		shaderWatcher.watch(bakeConfig.shaderDirectory);
+	std::unique_ptr<Shader> displayReload;
+	BakeProgramReload bakeReload;
+	bool reloadingBake = false;
+	//bakes of edited shaders are not saved, the saved bake has to match the embedded shaders
+	bool editedBake = false;
+	std::chrono::steady_clock::time_point reloadStart;
+
 	//main render loop
 	while (!glfwWindowShouldClose(window))
 	{
+		//one more level of the cubemap per frame until the base level is there
+		if (loading || baking)
+		{
+			if (loading)
+			{
+				loading = loadNextBakedLevel(loadStream);
+				baseLevel = loadStream.nextLevel + 1;
+			}
+			else
+			{
+				baking = bakeNextLevel(bakeStream);
+				baseLevel = bakeStream.nextLevel + 1;
+				if (!baking && !editedBake)
+				{
+					saveBakedCubemap(bakedPath, bakeConfig, bakeSettingsHash(bakeConfig, bakeNumOfPoints),
+					                 cubeMapTexture);
+					//the CPU engine has no shaders, so the decoded data is never needed again
+					if (bakeStream.engine == BakeEngine::Cpu || !bakeConfig.watchShaders)
+					{
+						stbi_image_free(data);
+						data = nullptr;
+						bakeSource.environment.data = nullptr;
+					}
+				}
+			}
+
+			publishSharedLevel(publisher, baseLevel, cubeMapTexture);
+
+			//the bake leaves its own viewport and state behind
+			int framebufferWidth, framebufferHeight;
+			glfwGetFramebufferSize(window, &framebufferWidth, &framebufferHeight);
+			glViewport(0, 0, framebufferWidth, framebufferHeight);
+			glEnable(GL_DEPTH_TEST);
+		}
+
+		//programs the driver finished in the background since the last frame
+		pollPrograms();
+
+		for (const std::string& file : shaderWatcher.changedFiles())
+		{
+			std::vector<std::string> displayFiles = Shader::sourceFiles(displayVertexShader);
+			std::vector<std::string> fragmentFiles = Shader::sourceFiles("envFrag.fs");
+			displayFiles.insert(displayFiles.end(), fragmentFiles.begin(), fragmentFiles.end());
+			bool display = std::find(displayFiles.begin(), displayFiles.end(), file) != displayFiles.end();
+			bool bake = bakeConfig.engine != BakeEngine::Cpu && bakeProgramsRead(file);
+			if (!display && !bake)
+				continue;
+
+			std::cout << file << " changed, recompiling" << std::endl;
+			reloadStart = std::chrono::steady_clock::now();
+			if (display)
+			{
+				//a reload that is still compiling is outdated by this one
+				if (displayReload)
+					displayReload->release();
+				displayReload.reset(new Shader(displayVertexShader, "envFrag.fs", displayDefines));
+			}
+			if (bake)
+			{
+				//the bake runs the variants if it is specialized, and resources created only now compiled their
+				//generic programs from the current sources already
+				bool created = !bakeResources.rasterShader;
+				if (!created || createBakeResources(bakeConfig, bakeResources))
+				{
+					beginBakeProgramReload(bakeConfig, bakeResources, bakeNumOfPoints,
+					                       !created && !bakeConfig.specializeShaders, bakeReload);
+					reloadingBake = true;
+				}
+			}
+		}
+
+		if (displayReload && displayReload->ready())
+		{
+			if (displayReload->linked)
+			{
+				ourShader.release();
+				ourShader = *displayReload;
+				setupDisplayProgram(ourShader);
+				std::cout << "Display program swapped after " << std::chrono::duration<double, std::milli>(
+					std::chrono::steady_clock::now() - reloadStart).count() << " ms" << std::endl;
+			}
+			else
+			{
+				displayReload->release();
+				std::cout << "Keeping the old display program" << std::endl;
+			}
+			displayReload.reset();
+		}
+
+		if (reloadingBake && bakeProgramReloadReady(bakeReload))
+		{
+			reloadingBake = false;
+			if (finishBakeProgramReload(bakeResources, bakeReload))
+			{
+				std::cout << "Bake programs recompiled after " << std::chrono::duration<double, std::milli>(
+					std::chrono::steady_clock::now() - reloadStart).count() << " ms, re-baking" << std::endl;
+
+				//a loaded cubemap has immutable storage, so the new bake goes into a new texture
+				glDeleteTextures(1, &cubeMapTexture);
+				glGenTextures(1, &cubeMapTexture);
+				loading = false;
+				prepareEnvironment();
+				//consumers were told the old levels are ready, the bake of the edited shaders is a new generation
+				//with a hash of its own
+				if (publisher.memory)
+				{
+					beginSharedCubemap(bakeConfig.publish, bakeConfig, bakeSettingsHash(bakeConfig, bakeNumOfPoints),
+					                   publisher);
+				}
+				beginBake(bakeConfig, bakeResources, bakeSource, bakeNumOfPoints, cubeMapTexture, bakeStream);
+				baking = true;
+				editedBake = true;
+				baseLevel = bakeConfig.mipLevels();
+			}
+			else
+				std::cout << "Keeping the old bake programs and the current cubemap" << std::endl;
+		}
+
 		processInput(window);
 		glClearColor(0.2f, 0.3f, 0.6f, 1.0f);
 		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
+		auto setupStart = std::chrono::steady_clock::now();
 		ourShader.use();
 
-		ourShader.setMat4("transMat", Model);
-		ourShader.setMat4("projMatrix", glm::perspective(glm::radians(90.0f),
-		                                                 static_cast<float>(screenWidth) / static_cast<float>(
-			                                                 screenHeight), 0.1f, 100.0f));
-		ourShader.setMat4("viewMatrix", view);
-
-		glUniform1f(glGetUniformLocation(ourShader.ID, "roughness"), roughness);
-		glUniform1i(glGetUniformLocation(ourShader.ID, "mipLevels"), mipmaps);
-		glUniform1f(glGetUniformLocation(ourShader.ID, "exposure"), exposure);
+		FrameData* frame = static_cast<FrameData*>(frameUniforms.map());
+		frame->transMat = Model;
+		frame->projMatrix = projection;
+		frame->viewMatrix = view;
+		frame->roughness = static_cast<float>(roughness);
+		frame->exposure = static_cast<float>(exposure);
+		frame->mipLevels = bakeConfig.mipLevels() - 1;
+		frame->baseLevel = baseLevel;
+		frameUniforms.bind(frameDataBinding);
+
+		//as many triangles as the pixels the sphere covers need for a smooth silhouette, the impostor is exact anyway
+		int framebufferWidth, framebufferHeight;
+		glfwGetFramebufferSize(window, &framebufferWidth, &framebufferHeight);
+		//the spheres of the preview grid all share the level the one at its center needs
+		float pixelRadius = projectedSphereRadius(projection, view, Model, sphereRadius * previewScale,
+		                                          static_cast<float>(framebufferHeight));
+		int lod = selectSphereLod(sphere, pixelRadius, sphereLodPixelError);
+		if (!bakeConfig.impostor && lod != sphereLod)
+		{
+			sphereLod = lod;
+			std::cout << "Sphere level of detail " << sphere.lods[lod].sectors << "x" << sphere.lods[lod].stacks << ", "
+				<< sphere.lods[lod].indexCount / 3 << " triangles for a radius of " << pixelRadius << " pixels" << std::endl;
+		}
 
 		glBindTexture(GL_TEXTURE_CUBE_MAP, cubeMapTexture);
 		glBindVertexArray(VAO);
+		frameSetupMicroseconds += std::chrono::duration<double, std::micro>(
+			std::chrono::steady_clock::now() - setupStart).count();
+		++frames;
 
-		glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, nullptr);
+		unsigned int drawQuery = drawQueries[frames % drawTimerQueries];
+		if (drawQueryIssued[frames % drawTimerQueries])
+		{
+			int available = 0;
+			glGetQueryObjectiv(drawQuery, GL_QUERY_RESULT_AVAILABLE, &available);
+			if (available)
+			{
+				GLuint64 nanoseconds = 0;
+				glGetQueryObjectui64v(drawQuery, GL_QUERY_RESULT, &nanoseconds);
+				drawMilliseconds += nanoseconds / 1e6;
+				++timedDraws;
+			}
+		}
+		glBeginQuery(GL_TIME_ELAPSED, drawQuery);
+		if (bakeConfig.impostor)
+		{
+			//impostor.vs builds the four corners from gl_VertexID, the bound buffers are not read
+			glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+		}
+		else
+		{
+			const SphereLod& level = sphere.lods[sphereLod];
+			if (instanceBuffer)
+			{
+				glDrawElementsInstancedBaseVertex(GL_TRIANGLES, static_cast<GLsizei>(level.indexCount), indexType,
+				                                  reinterpret_cast<void*>(level.firstIndex * indexSize),
+				                                  static_cast<GLsizei>(previewInstances.size()), level.baseVertex);
+			}
+			else
+			{
+				glDrawElementsBaseVertex(GL_TRIANGLES, static_cast<GLsizei>(level.indexCount), indexType,
+				                         reinterpret_cast<void*>(level.firstIndex * indexSize), level.baseVertex);
+			}
+		}
+		glEndQuery(GL_TIME_ELAPSED);
+		drawQueryIssued[frames % drawTimerQueries] = true;
+		frameUniforms.fence();
 
 		glfwSwapBuffers(window);
 		glfwPollEvents();
+
+		if (firstImage)
+		{
+			firstImage = false;
+			std::cout << "First image after " << std::chrono::duration<double, std::milli>(
+				std::chrono::steady_clock::now() - startTime).count() << " ms, showing level " << baseLevel
+				<< std::endl;
+			printStartupTrace();
+		}
+	}
+
+	if (frames > 0)
+	{
+		std::cout << "Frame state setup: " << frameSetupMicroseconds / frames << " us per frame over " << frames
+			<< " frames, uniform ring " << (frameUniforms.persistent() ? "persistently mapped" : "copied") << std::endl;
+	}
+	if (timedDraws > 0)
+	{
+		std::cout << "Sphere draw: " << drawMilliseconds / timedDraws << " ms of GPU time per frame from the "
+			<< (bakeConfig.impostor ? "impostor" : compactMesh ? "compact mesh" : "float mesh");
+		if (instanceBuffer)
+			std::cout << ", " << previewInstances.size() << " instances";
+		std::cout << std::endl;
 	}
+	glDeleteQueries(drawTimerQueries, drawQueries);
 
+	//unfinished reloads are dropped without waiting for the driver
+	bakeReload = BakeProgramReload();
+	if (displayReload)
+		displayReload->release();
+	stbi_image_free(data);
 	glDeleteVertexArrays(1, &VAO);
-	glDeleteVertexArrays(1, &squareVAO);
 	glDeleteBuffers(1, &buffer);
 	glDeleteBuffers(1, &EBO);
-	glDeleteBuffers(1, &squareBuffer);
-	glDeleteBuffers(1, &squareIndexBuffer);
+	if (instanceBuffer)
+		glDeleteBuffers(1, &instanceBuffer);
+	destroyBakeResources(bakeResources);
+	frameUniforms.destroy();
 
 	glfwTerminate();
 	return 0;
@@ -452,93 +808,51 @@ void mouse_move_callback(GLFWwindow* window, double xpos, double ypos)
 	}
 }
 
-/*	Method takes the sphere radius as first input
- *	Calculation happens based on the sector and stacks principle where the Sphere is divided into tinier spaces
- *	Then we can approximate the vertices of those spaces
+/*	Method runs on the startup worker while the main thread submits the programs
+ *
+ *	config: copy of the bake configuration, decides the environment and whether lights are extracted
+ *	decode: false if a saved bake will most likely be loaded
  *
- *	radius: the radius of the sphere
- *	sectors: number of pieces along the x-axis
- *	stacks: number of pieces along the y-axis
- *	EBO: the EBO in which the indices should be written into to draw the sphere later
- *	buffer: the VAO into which the coordinates should be written
- *	
- *	Writes the indices into the specified EBO and the coordinates, normals as well as texture coordinates into the buffer
+ *	Decodes the environment, cuts the dominant lights out of it and builds the sphere, each step is traced
+ *	Without decode only the lights the last decode saved next to the environment are read, the environment is
+ *	still decoded if there are none
  */
-void createSphereCoordinates(float radius, float sectors, float stacks, std::vector<unsigned int>& EBO,
-                             std::vector<float>& buffer)
+StartupAssets loadStartupAssets(BakeConfig config, bool decode)
 {
-	float x, y, z;
+	StartupAssets assets;
+	if (decode || (config.extractLights && !readDominantLights(config.environmentMap + ".lights", assets.lights)))
+		decodeEnvironment(config, assets, "worker");
 
-	//helper variables for normal calculation
-	float nx, ny, nz;
-
-	float s, t;
-
-	//declared for the normal calculation:
-	//multiplying a given coordinate by the length Inverse results 
-	float lengthInv = 1.0f / radius;
-
-	float sectorAngle, stackAngle;
-
-	//some helper values
-	float cosStack, sinStack;
-
-	//compute coordinates, normals and texCoords in this order, using the known formulas to compute each point on a sphere
-	for (float i = 0; i <= stacks; ++i)
 	{
-		stackAngle = (PI / 2) - PI * (i / stacks);
-		cosStack = cosf(stackAngle);
-		z = radius * sinf(stackAngle);
-
-		for (float j = 0; j <= sectors; ++j)
-		{
-			sectorAngle = 2 * PI * (j / sectors);
-
-			x = (radius * cosStack) * cosf(sectorAngle);
-			y = (radius * cosStack) * sinf(sectorAngle);
-			buffer.push_back(x);
-			buffer.push_back(y);
-			buffer.push_back(z);
-
-			nx = x * lengthInv;
-			ny = y * lengthInv;
-			nz = z * lengthInv;
-			buffer.push_back(nx);
-			buffer.push_back(ny);
-			buffer.push_back(nz);
-		}
+		//stack by stack order revisits every row of vertices after a full turn, so every level is also reordered
+		//for the vertex cache before it is packed
+		TraceScope trace("worker", "build sphere");
+		buildSphereLodChain(sphereRadius, sphereCoarsestSectors, sphereLodLevels, config.compactMesh, assets.sphere);
+		if (config.compactMesh && assets.sphere.compact.indices.empty())
+			std::cout << "The sphere has too many vertices for 16 bit indices, drawing it from floats" << std::endl;
 	}
+	return assets;
+}
 
-	int s1, s2;
-	// logic to create the index buffer
-	for (int i = 0; i < stacks; ++i)
+/*	Method decodes the environment and cuts the dominant lights out of it
+ *
+ *	config: decides the environment and whether lights are extracted
+ *	assets: receives the decoded data and the lights
+ *	lane: startup trace lane of the calling thread
+ */
+void decodeEnvironment(const BakeConfig& config, StartupAssets& assets, const char* lane)
+{
 	{
-		// determine our current stack and next stack
-		s1 = i * (sectors + 1);
-		s2 = s1 + sectors + 1;
-
-		/* iterate through the two stacks, adding two triangles each iteration for every stack except the top and bottom one
-		 * since we have to draw counter clockwise in order to make the face appear outside:
-		 * k1 -> k2 -> k1+1 gives us a triangle with the center at the bottom
-		 * s1+1 -> s2 -> s2+1 creates a triangle with the center at the top
-		 */
-		for (int j = 0; j < sectors; ++j, ++s1, ++s2)
-		{
-			//we need 2 vertices from first sector and 1 from next sector
-			if (i != 0)
-			{
-				EBO.push_back(s1);
-				EBO.push_back(s2);
-				EBO.push_back(s1 + 1);
-			}
+		TraceScope trace(lane, "decode environment");
+		assets.data = stbi_loadf(config.environmentMap.c_str(), &assets.width, &assets.height, &assets.nrChannels, 0);
+	}
 
-			//we need 1 vertices from first sector and 2 from next sector
-			if (i != (stacks - 1))
-			{
-				EBO.push_back(s1 + 1);
-				EBO.push_back(s2);
-				EBO.push_back(s2 + 1);
-			}
-		}
+	//the benchmark bakes the untouched environment, its baker extracts the lights itself
+	if (assets.data && config.extractLights && config.benchmarkBakes == 0)
+	{
+		TraceScope trace(lane, "extract lights");
+		assets.lights = extractDominantLights(assets.data, assets.width, assets.height, assets.nrChannels,
+		                                      maxDominantLights, config.lightThreshold);
+		writeDominantLights(config.environmentMap + ".lights", assets.lights);
 	}
 }
@@ -0,0 +1,234 @@
+#include "pch.h"
+#include "CubemapBaker.h"
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+
+//a handle is the slot index in the low bits and the generation of the slot in the bits above
+#define HANDLE_INDEX_BITS 16
+#define HANDLE_INDEX_MASK ((1 << HANDLE_INDEX_BITS) - 1)
+#define HANDLE_GENERATION_MASK 0x7fff
+
+struct CubemapBaker::Slot
+{
+	BakeResources resources;
+	BakeSource source;
+	BakeStream stream;
+	int index = 0;
+	//counts the bakes the slot was handed to, a handle of an earlier bake no longer matches it
+	int generation = 0;
+	bool busy = false;
+};
+
+CubemapBaker::CubemapBaker() = default;
+
+CubemapBaker::~CubemapBaker()
+{
+	//the first slot owns the programs the others borrow
+	for (size_t i = slots.size(); i-- > 0;)
+		destroyBakeResources(slots[i]->resources);
+}
+
+/*	Method finds a free slot for a bake or adds one to the pool
+ *
+ *	config: the bake, its resolution and level count decide which free slot fits best
+ *
+ *	A free slot whose targets already have the size of the bake is taken as it is, any other free slot is resized
+ *	Only if every slot is busy a new one is created, with the programs of the first slot
+ *	Returns nullptr if the new slot cannot be created
+ */
+CubemapBaker::Slot* CubemapBaker::acquire(const BakeConfig& config)
+{
+	auto start = std::chrono::steady_clock::now();
+
+	Slot* slot = nullptr;
+	for (const std::unique_ptr<Slot>& candidate : slots)
+	{
+		if (candidate->busy)
+			continue;
+		bool fits = candidate->resources.targetSize == config.cubeMapSize &&
+			candidate->resources.targetLevels == config.mipLevels();
+		if (!slot || fits)
+			slot = candidate.get();
+		if (fits)
+			break;
+	}
+
+	if (slot)
+		resizeBakeResources(config, slot->resources);
+	else
+	{
+		std::unique_ptr<Slot> created(new Slot());
+		if (!createBakeResources(config, created->resources, slots.empty() ? nullptr : &slots.front()->resources))
+		{
+			destroyBakeResources(created->resources);
+			return nullptr;
+		}
+		created->index = static_cast<int>(slots.size());
+		slot = created.get();
+		slots.push_back(std::move(created));
+	}
+	slot->busy = true;
+	slot->generation = (slot->generation + 1) & HANDLE_GENERATION_MASK;
+
+	lastSetupMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	return slot;
+}
+
+int CubemapBaker::begin(const BakeConfig& config, const EquirectImage& image, unsigned int cubeMapTexture,
+                        std::vector<DominantLight>* lights)
+{
+	Slot* slot = acquire(config);
+	if (!slot)
+		return -1;
+
+	if (!beginEquirectBake(config, slot->resources, image, cubeMapTexture, slot->source, slot->stream, lights))
+	{
+		slot->busy = false;
+		return -1;
+	}
+	return (slot->generation << HANDLE_INDEX_BITS) | slot->index;
+}
+
+/*	Method resolves the handle of a bake to its slot
+ *
+ *	bake: handle returned by begin
+ *
+ *	Returns nullptr if the handle is invalid or the bake is over, also once the slot went on to a later bake
+ */
+CubemapBaker::Slot* CubemapBaker::find(int bake)
+{
+	if (bake < 0)
+		return nullptr;
+	int index = bake & HANDLE_INDEX_MASK;
+	if (index >= static_cast<int>(slots.size()))
+		return nullptr;
+	Slot* slot = slots[index].get();
+	if (!slot->busy || slot->generation != bake >> HANDLE_INDEX_BITS)
+		return nullptr;
+	return slot;
+}
+
+bool CubemapBaker::step(int bake)
+{
+	Slot* slot = find(bake);
+	if (!slot)
+		return false;
+
+	if (bakeNextLevel(slot->stream))
+		return true;
+	slot->busy = false;
+	return false;
+}
+
+void CubemapBaker::cancel(int bake)
+{
+	Slot* slot = find(bake);
+	if (!slot)
+		return;
+	slot->stream = BakeStream();
+	slot->busy = false;
+}
+
+bool CubemapBaker::bake(const BakeConfig& config, const EquirectImage& image, unsigned int cubeMapTexture,
+                        std::vector<DominantLight>* lights)
+{
+	int handle = begin(config, image, cubeMapTexture, lights);
+	if (handle < 0)
+		return false;
+	while (step(handle))
+	{
+	}
+	return true;
+}
+
+bool CubemapBaker::bakeToMemory(const BakeConfig& config, const EquirectImage& image, float* levels,
+                                std::vector<DominantLight>* lights)
+{
+	Slot* slot = acquire(config);
+	if (!slot)
+		return false;
+
+	bool baked = bakeEquirectToMemory(config, slot->resources, image, levels, lights);
+	slot->busy = false;
+	return baked;
+}
+
+double CubemapBaker::setupMilliseconds() const
+{
+	return lastSetupMilliseconds;
+}
+
+size_t CubemapBaker::slotCount() const
+{
+	return slots.size();
+}
+
+/*	Method measures the setup a pooled bake pays against creating its resources from scratch
+ *
+ *	config: the large bake, config.benchmarkBakes is the number of rounds
+ *	image: environment both bakes of every round read
+ *
+ *	Every round begins the bake of config and one of half its size and bakes them a level each in turn,
+ *	the first round fills the pool, the later ones should only find their slots
+ */
+int runBakerBenchmark(const BakeConfig& config, const EquirectImage& image)
+{
+	//what every bake paid before the pool: compiling the programs and creating every object
+	auto start = std::chrono::steady_clock::now();
+	BakeResources fresh;
+	bool created = createBakeResources(config, fresh);
+	glFinish();
+	double freshMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	destroyBakeResources(fresh);
+	if (!created)
+		return -1;
+
+	BakeConfig smallConfig = config;
+	smallConfig.cubeMapSize = std::max(config.cubeMapSize / 2, 1);
+
+	unsigned int cubeMapTextures[2];
+	glGenTextures(2, cubeMapTextures);
+
+	int result = 0;
+	double reusedMilliseconds = 0.0;
+	{
+		CubemapBaker baker;
+		for (int round = 0; round < config.benchmarkBakes; ++round)
+		{
+			int large = baker.begin(config, image, cubeMapTextures[0]);
+			double largeSetup = baker.setupMilliseconds();
+			int small = baker.begin(smallConfig, image, cubeMapTextures[1]);
+			double smallSetup = baker.setupMilliseconds();
+			if (large < 0 || small < 0)
+			{
+				result = -1;
+				break;
+			}
+
+			//one level of each bake in turn, both slots keep their own targets and sample points
+			bool largeRunning = true;
+			bool smallRunning = true;
+			while (largeRunning || smallRunning)
+			{
+				if (largeRunning)
+					largeRunning = baker.step(large);
+				if (smallRunning)
+					smallRunning = baker.step(small);
+			}
+
+			std::cout << "Round " << round << ": setup " << largeSetup << " ms and " << smallSetup << " ms, "
+				<< baker.slotCount() << " slots" << std::endl;
+			if (round > 0)
+				reusedMilliseconds += largeSetup + smallSetup;
+		}
+	}
+	glDeleteTextures(2, cubeMapTextures);
+
+	if (result == 0 && config.benchmarkBakes > 1)
+	{
+		std::cout << "Setup per bake: " << freshMilliseconds << " ms with fresh resources, "
+			<< reusedMilliseconds / (2 * (config.benchmarkBakes - 1)) << " ms with pooled ones" << std::endl;
+	}
+	return result;
+}
@@ -0,0 +1,58 @@
+#ifndef CUBEMAP_BAKER_H
+#define CUBEMAP_BAKER_H
+
+#include <memory>
+#include <vector>
+#include "Baker.h"
+
+//bakes equirects from memory on a pool of bake resources that lives as long as the baker
+//every running bake holds one slot with its own framebuffer, targets, VAO and environment texture, so bakes can run
+//back to back or interleaved level by level, the shader programs are linked once and shared by all slots
+//a finished bake returns its slot, new slots are only created while every slot is busy
+class CubemapBaker
+{
+public:
+	CubemapBaker();
+	~CubemapBaker();
+	CubemapBaker(const CubemapBaker&) = delete;
+	CubemapBaker& operator=(const CubemapBaker&) = delete;
+
+	//starts a bake of image into cubeMapTexture and returns its handle, -1 if the image cannot be baked
+	//image has to stay valid until the bake is done, see bakeEquirectToTexture for the rest
+	int begin(const BakeConfig& config, const EquirectImage& image, unsigned int cubeMapTexture,
+	          std::vector<DominantLight>* lights = nullptr);
+
+	//bakes the next level of a bake from begin, returns true while levels are left
+	//the slot of a finished bake is free for the next begin, its old handle is rejected from then on
+	bool step(int bake);
+
+	//stops a running bake, the cubemap keeps the levels baked so far, a finished or cancelled bake is left alone
+	void cancel(int bake);
+
+	//bakes every level at once, into a cubemap or into bakedFloatCount(config) floats
+	bool bake(const BakeConfig& config, const EquirectImage& image, unsigned int cubeMapTexture,
+	          std::vector<DominantLight>* lights = nullptr);
+	bool bakeToMemory(const BakeConfig& config, const EquirectImage& image, float* levels,
+	                  std::vector<DominantLight>* lights = nullptr);
+
+	//time the last bake spent getting a slot with targets of its size, without uploading the image and sample points
+	double setupMilliseconds() const;
+	size_t slotCount() const;
+
+private:
+	struct Slot;
+
+	//free slot for a bake with config, prefers one whose targets already have its size
+	Slot* acquire(const BakeConfig& config);
+	//slot of a running bake, nullptr for a stale handle
+	Slot* find(int bake);
+
+	std::vector<std::unique_ptr<Slot>> slots;
+	double lastSetupMilliseconds = 0.0;
+};
+
+//bakes the environment config.benchmarkBakes times through one baker, interleaving it with a bake of half the size,
+//and prints the setup time of every bake next to the cost of creating fresh resources, returns the process exit code
+int runBakerBenchmark(const BakeConfig& config, const EquirectImage& image);
+
+#endif
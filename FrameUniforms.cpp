@@ -0,0 +1,118 @@
+#include "pch.h"
+#include "FrameUniforms.h"
+#include <iostream>
+#include "GLExtensions.h"
+
+UniformRing::UniformRing() = default;
+
+UniformRing::~UniformRing()
+{
+	destroy();
+}
+
+/*	Method allocates the ring
+ *
+ *	blockSize: bytes of the uniform block, every region holds one
+ *	regionCount: regions the CPU may be ahead of the GPU, 3 covers double buffering plus the frame being written
+ *
+ *	Regions start at multiples of GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT
+ *	Returns false if the buffer could not be mapped
+ */
+bool UniformRing::create(size_t blockSize, int regionCount)
+{
+	GLint alignment = 256;
+	glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+	blockBytes = blockSize;
+	stride = (blockSize + alignment - 1) / alignment * alignment;
+	fences.assign(regionCount, nullptr);
+	current = -1;
+
+	const GLsizeiptr bytes = static_cast<GLsizeiptr>(stride * regionCount);
+	glGenBuffers(1, &buffer);
+	glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+	if (hasBufferStorageSupport())
+	{
+		const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		glBufferStorage(GL_UNIFORM_BUFFER, bytes, nullptr, flags);
+		mapped = static_cast<unsigned char*>(glMapBufferRange(GL_UNIFORM_BUFFER, 0, bytes, flags));
+		if (!mapped)
+		{
+			std::cout << "Could not map the uniform ring" << std::endl;
+			glBindBuffer(GL_UNIFORM_BUFFER, 0);
+			return false;
+		}
+	}
+	else
+	{
+		glBufferData(GL_UNIFORM_BUFFER, bytes, nullptr, GL_DYNAMIC_DRAW);
+		staging.resize(blockSize);
+	}
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	return true;
+}
+
+void UniformRing::destroy()
+{
+	if (!buffer)
+		return;
+
+	for (GLsync sync : fences)
+	{
+		if (sync)
+			glDeleteSync(sync);
+	}
+	if (mapped)
+	{
+		glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+		glUnmapBuffer(GL_UNIFORM_BUFFER);
+		glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	}
+	glDeleteBuffers(1, &buffer);
+
+	buffer = 0;
+	mapped = nullptr;
+	fences.clear();
+	staging.clear();
+}
+
+void* UniformRing::map()
+{
+	current = (current + 1) % static_cast<int>(fences.size());
+	if (!mapped)
+		return staging.data();
+
+	//only blocks if the CPU is a whole ring ahead of the GPU
+	GLsync& sync = fences[current];
+	if (sync)
+	{
+		while (glClientWaitSync(sync, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000) == GL_TIMEOUT_EXPIRED)
+		{
+		}
+		glDeleteSync(sync);
+		sync = nullptr;
+	}
+	return mapped + current * stride;
+}
+
+void UniformRing::bind(unsigned int bindingPoint)
+{
+	const GLintptr offset = static_cast<GLintptr>(current * stride);
+	if (!mapped)
+	{
+		glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+		glBufferSubData(GL_UNIFORM_BUFFER, offset, static_cast<GLsizeiptr>(blockBytes), staging.data());
+	}
+	glBindBufferRange(GL_UNIFORM_BUFFER, bindingPoint, buffer, offset, static_cast<GLsizeiptr>(blockBytes));
+}
+
+void UniformRing::fence()
+{
+	//the copy path is ordered by glBufferSubData itself
+	if (mapped)
+		fences[current] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+bool UniformRing::persistent() const
+{
+	return mapped != nullptr;
+}
@@ -0,0 +1,62 @@
+#ifndef FRAME_UNIFORMS_H
+#define FRAME_UNIFORMS_H
+
+#include <cstddef>
+#include <vector>
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+//binding point of the FrameData block in frameData.glsl
+#define frameDataBinding 0
+
+//per frame values of the display shaders, std140 layout of the FrameData block in frameData.glsl
+struct FrameData
+{
+	glm::mat4 transMat;
+	glm::mat4 projMatrix;
+	glm::mat4 viewMatrix;
+	float roughness;
+	float exposure;
+	int mipLevels;
+	int baseLevel;
+};
+
+static_assert(sizeof(FrameData) == 3 * 64 + 16, "FrameData has to match the std140 layout of the block");
+
+//ring of uniform block regions in one buffer, a region is only written again once the GPU read it
+//the buffer is persistently mapped if the context has buffer storage, otherwise every region is copied in
+class UniformRing
+{
+public:
+	UniformRing();
+	~UniformRing();
+	UniformRing(const UniformRing&) = delete;
+	UniformRing& operator=(const UniformRing&) = delete;
+
+	//allocates regionCount regions of blockSize bytes, each aligned for glBindBufferRange
+	bool create(size_t blockSize, int regionCount = 3);
+	//frees the buffer and fences, has to run while the context is still current
+	void destroy();
+
+	//waits until the GPU is done with the next region and returns the memory to write the block into
+	void* map();
+	//makes the region from the last map visible at bindingPoint
+	void bind(unsigned int bindingPoint);
+	//fences the region once the draws reading it are submitted
+	void fence();
+
+	//true if the regions are written in place
+	bool persistent() const;
+
+private:
+	unsigned int buffer = 0;
+	size_t blockBytes = 0;
+	size_t stride = 0;
+	int current = -1;
+	unsigned char* mapped = nullptr;
+	std::vector<GLsync> fences;
+	//the block of the current region until bind copies it in, only without persistent mapping
+	std::vector<unsigned char> staging;
+};
+
+#endif
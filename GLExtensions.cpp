@@ -0,0 +1,113 @@
+#include "pch.h"
+#include "GLExtensions.h"
+#include <cstring>
+
+#ifndef GL_VERSION_4_1
+PFNGLGETPROGRAMBINARYPROC ext_glGetProgramBinary = nullptr;
+PFNGLPROGRAMBINARYPROC ext_glProgramBinary = nullptr;
+PFNGLPROGRAMPARAMETERIPROC ext_glProgramParameteri = nullptr;
+#endif
+
+#ifndef GL_VERSION_4_2
+PFNGLBINDIMAGETEXTUREPROC ext_glBindImageTexture = nullptr;
+PFNGLMEMORYBARRIERPROC ext_glMemoryBarrier = nullptr;
+PFNGLTEXSTORAGE2DPROC ext_glTexStorage2D = nullptr;
+#endif
+
+#ifndef GL_VERSION_4_3
+PFNGLDISPATCHCOMPUTEPROC ext_glDispatchCompute = nullptr;
+#endif
+
+#ifndef GL_VERSION_4_4
+PFNGLBUFFERSTORAGEPROC ext_glBufferStorage = nullptr;
+#endif
+
+#ifndef GL_KHR_parallel_shader_compile
+PFNGLMAXSHADERCOMPILERTHREADSKHRPROC ext_glMaxShaderCompilerThreadsKHR = nullptr;
+#endif
+
+void loadGLExtensions(GLADloadproc load)
+{
+#ifndef GL_VERSION_4_1
+	ext_glGetProgramBinary = (PFNGLGETPROGRAMBINARYPROC)load("glGetProgramBinary");
+	ext_glProgramBinary = (PFNGLPROGRAMBINARYPROC)load("glProgramBinary");
+	ext_glProgramParameteri = (PFNGLPROGRAMPARAMETERIPROC)load("glProgramParameteri");
+#endif
+
+#ifndef GL_VERSION_4_2
+	ext_glBindImageTexture = (PFNGLBINDIMAGETEXTUREPROC)load("glBindImageTexture");
+	ext_glMemoryBarrier = (PFNGLMEMORYBARRIERPROC)load("glMemoryBarrier");
+	ext_glTexStorage2D = (PFNGLTEXSTORAGE2DPROC)load("glTexStorage2D");
+#endif
+
+#ifndef GL_VERSION_4_3
+	ext_glDispatchCompute = (PFNGLDISPATCHCOMPUTEPROC)load("glDispatchCompute");
+#endif
+
+#ifndef GL_VERSION_4_4
+	ext_glBufferStorage = (PFNGLBUFFERSTORAGEPROC)load("glBufferStorage");
+#endif
+
+#ifndef GL_KHR_parallel_shader_compile
+	//the ARB flavor has the same signature and enums
+	ext_glMaxShaderCompilerThreadsKHR = (PFNGLMAXSHADERCOMPILERTHREADSKHRPROC)load("glMaxShaderCompilerThreadsKHR");
+	if (!ext_glMaxShaderCompilerThreadsKHR)
+		ext_glMaxShaderCompilerThreadsKHR = (PFNGLMAXSHADERCOMPILERTHREADSKHRPROC)load("glMaxShaderCompilerThreadsARB");
+#endif
+}
+
+bool hasComputeSupport()
+{
+	GLint major = 0, minor = 0;
+	glGetIntegerv(GL_MAJOR_VERSION, &major);
+	glGetIntegerv(GL_MINOR_VERSION, &minor);
+
+	bool version = major > 4 || (major == 4 && minor >= 3) || hasGLExtension("GL_ARB_compute_shader");
+	return version && glDispatchCompute && glBindImageTexture && glMemoryBarrier;
+}
+
+bool hasBufferStorageSupport()
+{
+	GLint major = 0, minor = 0;
+	glGetIntegerv(GL_MAJOR_VERSION, &major);
+	glGetIntegerv(GL_MINOR_VERSION, &minor);
+
+	bool version = major > 4 || (major == 4 && minor >= 4) || hasGLExtension("GL_ARB_buffer_storage");
+	return version && glBufferStorage && glTexStorage2D;
+}
+
+bool hasProgramBinarySupport()
+{
+	GLint major = 0, minor = 0;
+	glGetIntegerv(GL_MAJOR_VERSION, &major);
+	glGetIntegerv(GL_MINOR_VERSION, &minor);
+
+	bool version = major > 4 || (major == 4 && minor >= 1) || hasGLExtension("GL_ARB_get_program_binary");
+	if (!version || !glGetProgramBinary || !glProgramBinary || !glProgramParameteri)
+		return false;
+
+	//a driver may support the entry points without offering a single format
+	GLint formats = 0;
+	glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+	return formats > 0;
+}
+
+bool hasParallelShaderCompile()
+{
+	bool extension = hasGLExtension("GL_KHR_parallel_shader_compile") ||
+		hasGLExtension("GL_ARB_parallel_shader_compile");
+	return extension && glMaxShaderCompilerThreadsKHR;
+}
+
+bool hasGLExtension(const char* name)
+{
+	GLint count = 0;
+	glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+	for (GLint i = 0; i < count; ++i)
+	{
+		const char* extension = reinterpret_cast<const char*>(glGetStringi(GL_EXTENSIONS, i));
+		if (extension && std::strcmp(extension, name) == 0)
+			return true;
+	}
+	return false;
+}
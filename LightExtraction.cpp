@@ -0,0 +1,201 @@
+#include "pch.h"
+#include "LightExtraction.h"
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+#define PI 3.14159265358979323846
+
+//largest fraction of the sphere a region may cover and still count as a compact light
+#define maxLightCoverage 0.01f
+
+namespace
+{
+	float luminance(const float* pixel, int channels)
+	{
+		if (channels < 3)
+			return pixel[0];
+		return 0.2126f * pixel[0] + 0.7152f * pixel[1] + 0.0722f * pixel[2];
+	}
+
+	//inverse of sampleEnvMap in cubeMapFrag.frag, so the light lands exactly where the bake would have seen it
+	glm::vec3 pixelDirection(int x, int y, int width, int height)
+	{
+		float u = (x + 0.5f) / width;
+		float v = (y + 0.5f) / height;
+
+		float phi = (u - 0.5f) * 2.0f * static_cast<float>(PI);
+		float dirY = v * 2.0f - 1.0f;
+		float ring = std::sqrt(std::fmax(0.0f, 1.0f - dirY * dirY));
+
+		return glm::vec3(ring * std::sin(phi), dirY, ring * std::cos(phi));
+	}
+}
+
+/*	Method scans the equirect for its brightest pixels and grows a region around each of them
+ *	The sampleEnvMap mapping is equal-area, hence every pixel covers the same solid angle of 4*PI/(width*height)
+ *
+ *	data: the decoded environment map, modified in place
+ *	width, height, channels: dimensions as returned by stbi_loadf
+ *	maxLights: number of regions to extract at most
+ *	threshold: a region has to be this many times brighter than the average luminance to become a light
+ *
+ *	Every accepted region is replaced by the average of the pixels bordering it, what remains is a low variance residual
+ *	Returns the fitted lights, brightest first
+ */
+std::vector<DominantLight> extractDominantLights(float* data, int width, int height, int channels,
+                                                 int maxLights, float threshold)
+{
+	std::vector<DominantLight> lights;
+	if (!data || width <= 0 || height <= 0)
+		return lights;
+
+	const int pixelCount = width * height;
+	const float pixelSolidAngle = 4.0f * static_cast<float>(PI) / pixelCount;
+	const int maxRegionSize = static_cast<int>(pixelCount * maxLightCoverage);
+
+	std::vector<float> lum(pixelCount);
+	double lumSum = 0.0;
+	for (int p = 0; p < pixelCount; ++p)
+	{
+		lum[p] = luminance(data + p * channels, channels);
+		lumSum += lum[p];
+	}
+	const float cutoff = static_cast<float>(lumSum / pixelCount) * threshold;
+
+	//0: untouched, 1: part of the current region, 2: already handled
+	std::vector<unsigned char> state(pixelCount, 0);
+	std::vector<int> region;
+	std::vector<int> border;
+
+	while (static_cast<int>(lights.size()) < maxLights)
+	{
+		int peak = -1;
+		for (int p = 0; p < pixelCount; ++p)
+		{
+			if (state[p] == 0 && (peak < 0 || lum[p] > lum[peak]))
+				peak = p;
+		}
+		if (peak < 0 || lum[peak] < cutoff)
+			break;
+
+		//flood fill every connected pixel above the cutoff, the longitude wraps around
+		//the fill is not capped, an oversized area has to be handled as a whole or its rest looks like a light later
+		region.clear();
+		border.clear();
+		region.push_back(peak);
+		state[peak] = 1;
+		for (size_t r = 0; r < region.size(); ++r)
+		{
+			int x = region[r] % width;
+			int y = region[r] / width;
+			const int neighbours[4][2] = {{(x + 1) % width, y}, {(x + width - 1) % width, y}, {x, y - 1}, {x, y + 1}};
+
+			for (const auto& n : neighbours)
+			{
+				if (n[1] < 0 || n[1] >= height)
+					continue;
+				int q = n[1] * width + n[0];
+				if (state[q] == 1)
+					continue;
+				if (state[q] == 0 && lum[q] >= cutoff)
+				{
+					state[q] = 1;
+					region.push_back(q);
+				}
+				else
+					border.push_back(q);
+			}
+		}
+
+		for (int p : region)
+			state[p] = 2;
+
+		//large bright areas like an overcast sky are no light source, the bake handles them fine
+		if (static_cast<int>(region.size()) > maxRegionSize)
+			continue;
+
+		float fill[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+		int borderCount = 0;
+		for (int q : border)
+		{
+			if (state[q] == 2)
+				continue;
+			for (int c = 0; c < channels; ++c)
+				fill[c] += data[q * channels + c];
+			++borderCount;
+		}
+		for (int c = 0; c < channels && borderCount > 0; ++c)
+			fill[c] /= borderCount;
+
+		DominantLight light;
+		light.color = glm::vec3(0.0f);
+		light.solidAngle = region.size() * pixelSolidAngle;
+
+		glm::vec3 weightedDirection(0.0f);
+		for (int p : region)
+		{
+			float* pixel = data + p * channels;
+			float excess[3];
+			for (int c = 0; c < 3; ++c)
+				excess[c] = std::fmax(0.0f, pixel[c < channels ? c : 0] - fill[c < channels ? c : 0]);
+
+			light.color += glm::vec3(excess[0], excess[1], excess[2]) * pixelSolidAngle;
+			weightedDirection += pixelDirection(p % width, p / width, width, height) * luminance(excess, 3);
+
+			for (int c = 0; c < channels; ++c)
+				pixel[c] = fill[c];
+		}
+
+		if (length(weightedDirection) <= 0.0f)
+			continue;
+		light.direction = normalize(weightedDirection);
+		lights.push_back(light);
+	}
+
+	return lights;
+}
+
+bool writeDominantLights(const std::string& path, const std::vector<DominantLight>& lights)
+{
+	std::ofstream file(path);
+	if (!file)
+	{
+		std::cout << "Could not write light parameters to " << path << std::endl;
+		return false;
+	}
+
+	file << "# direction.xyz color.rgb solidAngle\n";
+	for (const DominantLight& light : lights)
+	{
+		file << light.direction.x << ' ' << light.direction.y << ' ' << light.direction.z << ' '
+			<< light.color.x << ' ' << light.color.y << ' ' << light.color.z << ' '
+			<< light.solidAngle << '\n';
+	}
+	return true;
+}
+
+bool readDominantLights(const std::string& path, std::vector<DominantLight>& lights)
+{
+	std::ifstream file(path);
+	if (!file)
+		return false;
+
+	std::vector<DominantLight> read;
+	std::string line;
+	while (std::getline(file, line))
+	{
+		if (line.empty() || line[0] == '#')
+			continue;
+
+		std::istringstream values(line);
+		DominantLight light;
+		if (!(values >> light.direction.x >> light.direction.y >> light.direction.z >> light.color.x >> light.color.y
+			>> light.color.z >> light.solidAngle) || read.size() == maxDominantLights)
+			return false;
+		read.push_back(light);
+	}
+	lights = read;
+	return true;
+}
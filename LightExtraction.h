@@ -0,0 +1,31 @@
+#ifndef LIGHT_EXTRACTION_H
+#define LIGHT_EXTRACTION_H
+
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+
+//upper bound of lights the display shader can add back, has to match MAX_LIGHTS in envFrag.fs
+#define maxDominantLights 4
+
+//directional light fitted to a bright and compact region of the environment map
+//direction lives in the same space as the cubemap coordinates used by both shaders
+struct DominantLight
+{
+	glm::vec3 direction;
+	//radiance of the removed region integrated over its solid angle
+	glm::vec3 color;
+	float solidAngle;
+};
+
+//finds the brightest compact regions in the equirect, fits a directional light to each of them and removes them from data
+std::vector<DominantLight> extractDominantLights(float* data, int width, int height, int channels,
+                                                 int maxLights, float threshold);
+
+//writes the light parameters as plain text, one light per line: direction, color, solid angle
+bool writeDominantLights(const std::string& path, const std::vector<DominantLight>& lights);
+
+//reads lights written by writeDominantLights, false if the file is missing or malformed
+bool readDominantLights(const std::string& path, std::vector<DominantLight>& lights);
+
+#endif
@@ -0,0 +1,251 @@
+#include "pch.h"
+#include "MeshOptimizer.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <vector>
+
+//the triangle order is scored against an LRU cache of this size, larger than the hardware cache so the order
+//also stays good for GPUs with bigger caches
+#define forsythCacheSize 32
+
+namespace
+{
+	//weights of Tom Forsyth's linear speed vertex cache optimisation
+	const float cacheDecayPower = 1.5f;
+	const float lastTriangleScore = 0.75f;
+	const float valenceBoostScale = 2.0f;
+	const float valenceBoostPower = 0.5f;
+
+	//vertices of the last triangle score the same so it does not matter in which order they were used,
+	//vertices with few triangles left score higher so they are finished before they leave the cache
+	float vertexScore(int cachePosition, unsigned int remainingTriangles)
+	{
+		if (remainingTriangles == 0)
+			return -1.0f;
+
+		float score = 0.0f;
+		if (cachePosition >= 0)
+		{
+			if (cachePosition < 3)
+				score = lastTriangleScore;
+			else
+				score = std::pow(1.0f - static_cast<float>(cachePosition - 3) / (forsythCacheSize - 3), cacheDecayPower);
+		}
+		return score + valenceBoostScale * std::pow(static_cast<float>(remainingTriangles), -valenceBoostPower);
+	}
+}
+
+/*	Method simulates the post-transform cache of a GPU on an index buffer
+ *
+ *	indices: triangle list
+ *	indexCount: number of indices, a multiple of 3
+ *	vertexCount: number of vertices the indices refer to
+ *	cacheSize: entries of the simulated FIFO cache
+ *
+ *	Every miss is one vertex shader invocation
+ */
+VertexCacheStats analyzeVertexCache(const unsigned int* indices, size_t indexCount, size_t vertexCount, int cacheSize)
+{
+	VertexCacheStats stats = {0.0f, 0.0f};
+	if (indexCount < 3 || vertexCount == 0)
+		return stats;
+
+	//miss count at the time a vertex entered the cache, 0 for vertices that never did
+	std::vector<size_t> entered(vertexCount, 0);
+	size_t misses = 0;
+	for (size_t i = 0; i < indexCount; ++i)
+	{
+		unsigned int vertex = indices[i];
+		if (entered[vertex] != 0 && misses - entered[vertex] < static_cast<size_t>(cacheSize))
+			continue;
+		++misses;
+		entered[vertex] = misses;
+	}
+
+	stats.acmr = static_cast<float>(misses) / static_cast<float>(indexCount / 3);
+	stats.atvr = static_cast<float>(misses) / static_cast<float>(vertexCount);
+	return stats;
+}
+
+/*	Method reorders the triangles of a triangle list with Tom Forsyth's linear speed vertex cache optimisation
+ *
+ *	indices: triangle list, overwritten with the new order
+ *	indexCount: number of indices, a multiple of 3
+ *	vertexCount: number of vertices the indices refer to
+ *
+ *	Every step emits the triangle with the highest score, a triangle scores the sum of its vertices, which score
+ *	by their position in a simulated LRU cache and by how many of their triangles are left
+ *	Only the triangles of the vertices in the cache are rescored, so the cost stays linear in the triangle count
+ *	If none of them has triangles left, the next triangle in input order continues
+ */
+void optimizeVertexCache(unsigned int* indices, size_t indexCount, size_t vertexCount)
+{
+	const size_t triangleCount = indexCount / 3;
+	if (triangleCount == 0)
+		return;
+
+	//the triangles of every vertex in one array, vertex v owns the first remaining[v] entries from triangleOffset[v]
+	std::vector<unsigned int> remaining(vertexCount, 0);
+	for (size_t i = 0; i < triangleCount * 3; ++i)
+		++remaining[indices[i]];
+	std::vector<size_t> triangleOffset(vertexCount + 1, 0);
+	for (size_t vertex = 0; vertex < vertexCount; ++vertex)
+		triangleOffset[vertex + 1] = triangleOffset[vertex] + remaining[vertex];
+	std::vector<unsigned int> vertexTriangles(triangleCount * 3);
+	std::vector<unsigned int> filled(vertexCount, 0);
+	for (size_t triangle = 0; triangle < triangleCount; ++triangle)
+	{
+		for (int corner = 0; corner < 3; ++corner)
+		{
+			unsigned int vertex = indices[3 * triangle + corner];
+			vertexTriangles[triangleOffset[vertex] + filled[vertex]++] = static_cast<unsigned int>(triangle);
+		}
+	}
+
+	std::vector<int> cachePosition(vertexCount, -1);
+	std::vector<float> score(vertexCount);
+	for (size_t vertex = 0; vertex < vertexCount; ++vertex)
+		score[vertex] = vertexScore(-1, remaining[vertex]);
+
+	std::vector<float> triangleScore(triangleCount);
+	std::vector<char> emitted(triangleCount, 0);
+	size_t best = 0;
+	for (size_t triangle = 0; triangle < triangleCount; ++triangle)
+	{
+		const unsigned int* corners = indices + 3 * triangle;
+		triangleScore[triangle] = score[corners[0]] + score[corners[1]] + score[corners[2]];
+		if (triangleScore[triangle] > triangleScore[best])
+			best = triangle;
+	}
+
+	std::vector<unsigned int> output;
+	output.reserve(triangleCount * 3);
+	std::vector<unsigned int> cache;
+	std::vector<unsigned int> nextCache;
+	cache.reserve(forsythCacheSize + 3);
+	nextCache.reserve(forsythCacheSize + 3);
+	size_t scanCursor = 0;
+
+	const size_t none = std::numeric_limits<size_t>::max();
+	while (output.size() < triangleCount * 3)
+	{
+		if (best == none)
+		{
+			while (emitted[scanCursor])
+				++scanCursor;
+			best = scanCursor;
+		}
+		emitted[best] = 1;
+
+		//the triangle leaves the lists of its vertices and its vertices move to the front of the cache
+		const unsigned int* corners = indices + 3 * best;
+		nextCache.clear();
+		for (int corner = 0; corner < 3; ++corner)
+		{
+			unsigned int vertex = corners[corner];
+			output.push_back(vertex);
+
+			unsigned int* triangles = vertexTriangles.data() + triangleOffset[vertex];
+			for (unsigned int i = 0; i < remaining[vertex]; ++i)
+			{
+				if (triangles[i] == best)
+				{
+					std::swap(triangles[i], triangles[remaining[vertex] - 1]);
+					--remaining[vertex];
+					break;
+				}
+			}
+			if (std::find(nextCache.begin(), nextCache.end(), vertex) == nextCache.end())
+				nextCache.push_back(vertex);
+		}
+		for (unsigned int vertex : cache)
+		{
+			if (vertex != corners[0] && vertex != corners[1] && vertex != corners[2])
+				nextCache.push_back(vertex);
+		}
+
+		//the entries past the cache size were pushed out, their scores drop as well
+		for (size_t i = 0; i < nextCache.size(); ++i)
+		{
+			unsigned int vertex = nextCache[i];
+			cachePosition[vertex] = i < forsythCacheSize ? static_cast<int>(i) : -1;
+			score[vertex] = vertexScore(cachePosition[vertex], remaining[vertex]);
+		}
+
+		best = none;
+		float bestScore = -1.0f;
+		for (unsigned int vertex : nextCache)
+		{
+			const unsigned int* triangles = vertexTriangles.data() + triangleOffset[vertex];
+			for (unsigned int i = 0; i < remaining[vertex]; ++i)
+			{
+				const unsigned int* neighbour = indices + 3 * triangles[i];
+				float neighbourScore = score[neighbour[0]] + score[neighbour[1]] + score[neighbour[2]];
+				triangleScore[triangles[i]] = neighbourScore;
+				if (neighbourScore > bestScore)
+				{
+					bestScore = neighbourScore;
+					best = triangles[i];
+				}
+			}
+		}
+
+		if (nextCache.size() > forsythCacheSize)
+			nextCache.resize(forsythCacheSize);
+		cache.swap(nextCache);
+	}
+
+	std::memcpy(indices, output.data(), output.size() * sizeof(unsigned int));
+}
+
+/*	Method stores the vertices in the order the indices first reference them
+ *
+ *	vertices: vertexCount vertices of vertexSize bytes, overwritten with the new order
+ *	indices: remapped to the new order
+ *
+ *	Run after optimizeVertexCache, the vertex fetches then walk through memory almost sequentially
+ */
+size_t optimizeVertexFetch(void* vertices, size_t vertexSize, size_t vertexCount, unsigned int* indices,
+                           size_t indexCount)
+{
+	const unsigned int unused = std::numeric_limits<unsigned int>::max();
+	std::vector<unsigned int> remap(vertexCount, unused);
+	unsigned int used = 0;
+	for (size_t i = 0; i < indexCount; ++i)
+	{
+		unsigned int& target = remap[indices[i]];
+		if (target == unused)
+			target = used++;
+		indices[i] = target;
+	}
+
+	unsigned char* bytes = static_cast<unsigned char*>(vertices);
+	std::vector<unsigned char> reordered(used * vertexSize);
+	for (size_t vertex = 0; vertex < vertexCount; ++vertex)
+	{
+		if (remap[vertex] != unused)
+			std::memcpy(reordered.data() + remap[vertex] * vertexSize, bytes + vertex * vertexSize, vertexSize);
+	}
+	std::memcpy(bytes, reordered.data(), reordered.size());
+	return used;
+}
+
+size_t optimizeMesh(const char* name, void* vertices, size_t vertexSize, size_t vertexCount, unsigned int* indices,
+                    size_t indexCount)
+{
+	auto start = std::chrono::steady_clock::now();
+	VertexCacheStats before = analyzeVertexCache(indices, indexCount, vertexCount);
+	optimizeVertexCache(indices, indexCount, vertexCount);
+	size_t usedVertices = optimizeVertexFetch(vertices, vertexSize, vertexCount, indices, indexCount);
+	VertexCacheStats after = analyzeVertexCache(indices, indexCount, usedVertices);
+	double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+	std::cout << "Mesh " << name << ": " << indexCount / 3 << " triangles, ACMR " << before.acmr << " -> " << after.acmr
+		<< ", ATVR " << before.atvr << " -> " << after.atvr << " on a " << vertexCacheSize << " entry cache, optimized in "
+		<< milliseconds << " ms" << std::endl;
+	return usedVertices;
+}
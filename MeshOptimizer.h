@@ -0,0 +1,35 @@
+#ifndef MESH_OPTIMIZER_H
+#define MESH_OPTIMIZER_H
+
+#include <cstddef>
+
+//entries of the post-transform cache the statistics simulate and the triangle order is optimized for
+#define vertexCacheSize 16
+
+//post-transform cache behaviour of an index buffer, measured on a FIFO cache of cacheSize vertices
+struct VertexCacheStats
+{
+	//vertex shader invocations per triangle, 0.5 is the limit for large regular meshes, 3 means no reuse at all
+	float acmr;
+	//vertex shader invocations per vertex, 1 is ideal
+	float atvr;
+};
+
+VertexCacheStats analyzeVertexCache(const unsigned int* indices, size_t indexCount, size_t vertexCount,
+                                    int cacheSize = vertexCacheSize);
+
+//reorders the triangles of a triangle list for the post-transform cache, the triangles themselves stay the same
+void optimizeVertexCache(unsigned int* indices, size_t indexCount, size_t vertexCount);
+
+//reorders the vertices into the order the indices first use them and remaps the indices
+//vertices holds vertexCount vertices of vertexSize bytes, returns the number of vertices still referenced,
+//unreferenced ones are dropped from the end
+size_t optimizeVertexFetch(void* vertices, size_t vertexSize, size_t vertexCount, unsigned int* indices,
+                           size_t indexCount);
+
+//optimizes both orders of an indexed triangle list and prints the cache statistics before and after
+//returns the new vertex count like optimizeVertexFetch
+size_t optimizeMesh(const char* name, void* vertices, size_t vertexSize, size_t vertexCount, unsigned int* indices,
+                    size_t indexCount);
+
+#endif
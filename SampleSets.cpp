@@ -0,0 +1,279 @@
+#include "pch.h"
+#include "SampleSets.h"
+#include "CpuPrefilter.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <iostream>
+
+//candidates tried for every new blue noise point, more gives a cleaner spectrum at quadratic cost
+#define blueNoiseCandidates 16
+
+namespace
+{
+	uint32_t reverseBits(uint32_t bits)
+	{
+		bits = (bits << 16u) | (bits >> 16u);
+		bits = ((bits & 0x55555555u) << 1u) | ((bits & 0xAAAAAAAAu) >> 1u);
+		bits = ((bits & 0x33333333u) << 2u) | ((bits & 0xCCCCCCCCu) >> 2u);
+		bits = ((bits & 0x0F0F0F0Fu) << 4u) | ((bits & 0xF0F0F0F0u) >> 4u);
+		bits = ((bits & 0x00FF00FFu) << 8u) | ((bits & 0xFF00FF00u) >> 8u);
+		return bits;
+	}
+
+	uint32_t sobolSecondDimension(uint32_t i)
+	{
+		uint32_t result = 0;
+		for (uint32_t v = 1u << 31; i != 0; i >>= 1, v ^= v >> 1)
+		{
+			if (i & 1u)
+				result ^= v;
+		}
+		return result;
+	}
+
+	//hash based nested uniform scrambling (Burley 2020), every bit is flipped depending on all bits above it
+	uint32_t owenScramble(uint32_t x, uint32_t seed)
+	{
+		x = reverseBits(x);
+		x += seed;
+		x ^= x * 0x6C50B47Cu;
+		x ^= x * 0xB82F1E52u;
+		x ^= x * 0xC7AFE638u;
+		x ^= x * 0x8D22F6E6u;
+		return reverseBits(x);
+	}
+
+	uint32_t hash(uint32_t x)
+	{
+		x ^= x >> 16;
+		x *= 0x7FEB352Du;
+		x ^= x >> 15;
+		x *= 0x846CA68Bu;
+		x ^= x >> 16;
+		return x;
+	}
+
+	float toUnit(uint32_t bits)
+	{
+		//keep the top 24 bits so the result stays below 1 in float precision
+		return (bits >> 8) * (1.0f / 16777216.0f);
+	}
+
+	float toroidalDistanceSquared(glm::vec2 a, glm::vec2 b)
+	{
+		float dx = std::fabs(a.x - b.x);
+		float dy = std::fabs(a.y - b.y);
+		dx = std::min(dx, 1.0f - dx);
+		dy = std::min(dy, 1.0f - dy);
+		return dx * dx + dy * dy;
+	}
+
+	//Mitchell's best candidate on the torus, every new point is the candidate furthest away from all previous ones
+	std::vector<glm::vec2> bestCandidate(int count, uint32_t seed)
+	{
+		std::vector<glm::vec2> points;
+		points.reserve(count);
+		uint32_t state = seed;
+
+		for (int i = 0; i < count; ++i)
+		{
+			glm::vec2 best;
+			float bestDistance = -1.0f;
+			for (int c = 0; c < blueNoiseCandidates; ++c)
+			{
+				state = hash(state + 0x9E3779B9u);
+				glm::vec2 candidate(toUnit(state), toUnit(hash(state)));
+
+				float nearest = 2.0f;
+				for (const glm::vec2& p : points)
+					nearest = std::min(nearest, toroidalDistanceSquared(candidate, p));
+
+				if (nearest > bestDistance)
+				{
+					bestDistance = nearest;
+					best = candidate;
+				}
+			}
+			points.push_back(best);
+		}
+		return points;
+	}
+
+	float tonemap(float value)
+	{
+		return value / (1.0f + value);
+	}
+}
+
+const char* sampleSetName(SampleSet set)
+{
+	switch (set)
+	{
+	case SampleSet::OwenSobol: return "sobol";
+	case SampleSet::BlueNoise: return "bluenoise";
+	default: return "hammersley";
+	}
+}
+
+bool parseSampleSet(const std::string& name, SampleSet& set)
+{
+	for (SampleSet candidate : {SampleSet::Hammersley, SampleSet::OwenSobol, SampleSet::BlueNoise})
+	{
+		if (name == sampleSetName(candidate))
+		{
+			set = candidate;
+			return true;
+		}
+	}
+	return false;
+}
+
+/*	Method precomputes a point set for the prefilter
+ *
+ *	set: which construction to use
+ *	count: number of points, the Hammersley set is only complete at exactly this count
+ *	seed: decorrelates the Owen scrambling and the blue noise candidates
+ *
+ *	Returns count points in [0, 1)^2, x is used for the azimuth and y for the specular lobe
+ */
+std::vector<glm::vec2> generateSamplePoints(SampleSet set, int count, unsigned int seed)
+{
+	std::vector<glm::vec2> points;
+	if (count <= 0)
+		return points;
+
+	switch (set)
+	{
+	case SampleSet::OwenSobol:
+		points.reserve(count);
+		for (int i = 0; i < count; ++i)
+		{
+			//dimension 0 of Sobol is the radical inverse, dimension 1 uses the generator of x + 1
+			points.emplace_back(toUnit(owenScramble(reverseBits(i), hash(seed))),
+			                    toUnit(owenScramble(sobolSecondDimension(i), hash(seed + 1))));
+		}
+		break;
+	case SampleSet::BlueNoise:
+		points = bestCandidate(count, seed);
+		break;
+	default:
+		points.reserve(count);
+		for (int i = 0; i < count; ++i)
+			points.emplace_back(static_cast<float>(i) / count, reverseBits(i) / 4294967296.0f);
+		break;
+	}
+	return points;
+}
+
+glm::vec2 texelRotation(float fragX, float fragY)
+{
+	auto gradientNoise = [](float x, float y)
+	{
+		float inner = 0.06711056f * x + 0.00583715f * y;
+		float outer = 52.9829189f * (inner - std::floor(inner));
+		return outer - std::floor(outer);
+	};
+	return glm::vec2(gradientNoise(fragX, fragY), gradientNoise(fragX + 47.0f, fragY + 17.0f));
+}
+
+/*	Method bakes a few representative mip levels on the CPU with every sample set
+ *
+ *	env: the environment map that is baked
+ *	numOfPoints: the sample count the bake normally uses, budgets of 1, 1/4 and 1/8 of it are compared
+ *
+ *	The reference uses Hammersley points at 8 times numOfPoints
+ *	rmse is measured on Reinhard tonemapped values, blurred rmse after a 5x5 box filter of the error
+ *	noise mostly disappears under the blur, structured banding does not
+ */
+void compareSampleSets(const EnvironmentMap& env, int numOfPoints)
+{
+	const int faceSize = 64;
+	const int texels = faceSize * faceSize;
+	//specular exponents of mip 3, 5 and 7 of the default 9 level chain
+	const int mipLevels[] = {3, 5, 7};
+
+	struct Candidate
+	{
+		SampleSet set;
+		bool rotate;
+	};
+	const Candidate candidates[] = {
+		{SampleSet::Hammersley, false}, {SampleSet::Hammersley, true},
+		{SampleSet::OwenSobol, true}, {SampleSet::BlueNoise, true}
+	};
+
+	std::printf("%-4s %-11s %-6s %7s %9s %13s %9s\n", "mip", "set", "rotate", "samples", "rmse", "blurred rmse",
+	            "time ms");
+
+	for (int mipLevel : mipLevels)
+	{
+		float specular = std::pow(2.0f, 15.0f * (1.0f - mipLevel / 8.0f));
+
+		std::vector<glm::vec2> referencePoints = generateSamplePoints(SampleSet::Hammersley, numOfPoints * 8);
+		PrefilterSettings referenceSettings = {specular, numOfPoints * 8, 0.0f, referencePoints.data(), false};
+		std::vector<float> reference(6 * texels * 3);
+		for (int face = 0; face < 6; ++face)
+			prefilterFace(env, face, faceSize, referenceSettings, reference.data() + face * texels * 3);
+
+		for (const Candidate& candidate : candidates)
+		{
+			for (int divisor : {1, 4, 8})
+			{
+				int count = numOfPoints / divisor;
+				std::vector<glm::vec2> points = generateSamplePoints(candidate.set, count);
+				PrefilterSettings settings = {specular, count, 0.0f, points.data(), candidate.rotate};
+
+				std::vector<float> result(6 * texels * 3);
+				auto start = std::chrono::steady_clock::now();
+				for (int face = 0; face < 6; ++face)
+					prefilterFace(env, face, faceSize, settings, result.data() + face * texels * 3);
+				double milliseconds = std::chrono::duration<double, std::milli>(
+					std::chrono::steady_clock::now() - start).count();
+
+				std::vector<float> error(result.size());
+				double squared = 0.0;
+				for (size_t t = 0; t < result.size(); ++t)
+				{
+					error[t] = tonemap(result[t]) - tonemap(reference[t]);
+					squared += error[t] * error[t];
+				}
+
+				double blurredSquared = 0.0;
+				for (int face = 0; face < 6; ++face)
+				{
+					for (int y = 0; y < faceSize; ++y)
+					{
+						for (int x = 0; x < faceSize; ++x)
+						{
+							for (int c = 0; c < 3; ++c)
+							{
+								float sum = 0.0f;
+								int taps = 0;
+								for (int dy = -2; dy <= 2; ++dy)
+								{
+									for (int dx = -2; dx <= 2; ++dx)
+									{
+										int sx = x + dx;
+										int sy = y + dy;
+										if (sx < 0 || sy < 0 || sx >= faceSize || sy >= faceSize)
+											continue;
+										sum += error[((face * faceSize + sy) * faceSize + sx) * 3 + c];
+										++taps;
+									}
+								}
+								blurredSquared += (sum / taps) * (sum / taps);
+							}
+						}
+					}
+				}
+
+				std::printf("%-4d %-11s %-6s %7d %9.5f %13.5f %9.1f\n", mipLevel, sampleSetName(candidate.set),
+				            candidate.rotate ? "yes" : "no", count, std::sqrt(squared / result.size()),
+				            std::sqrt(blurredSquared / result.size()), milliseconds);
+			}
+		}
+	}
+}
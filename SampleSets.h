@@ -0,0 +1,30 @@
+#ifndef SAMPLE_SETS_H
+#define SAMPLE_SETS_H
+
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+
+struct EnvironmentMap;
+
+//2D point sets the prefilter can draw its samples from, the values match the sampleSet uniform of cubeMapFrag.frag
+enum class SampleSet
+{
+	Hammersley = 0,
+	OwenSobol = 1,
+	BlueNoise = 2
+};
+
+const char* sampleSetName(SampleSet set);
+bool parseSampleSet(const std::string& name, SampleSet& set);
+
+//precomputes count points in [0, 1)^2, every prefix of the Sobol and blue noise sets is well distributed on its own
+std::vector<glm::vec2> generateSamplePoints(SampleSet set, int count, unsigned int seed = 0x9E3779B9u);
+
+//per texel Cranley-Patterson offset, same interleaved gradient noise as texelRotation in cubeMapFrag.frag
+glm::vec2 texelRotation(float fragX, float fragY);
+
+//prefilters a few mip levels on the CPU with every set and sample budget and prints error and time against a reference
+void compareSampleSets(const EnvironmentMap& env, int numOfPoints);
+
+#endif
@@ -7,105 +7,477 @@
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <algorithm>
+#include <cstring>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 #include <glm/gtc/type_ptr.hpp>
+#include "GLExtensions.h"
+#include "ShaderSources.h"
+
+//name and value of a #define injected after the #version line of every stage
+typedef std::vector<std::pair<std::string, std::string>> ShaderDefines;
 
 class Shader
 {
 public:
 	unsigned int ID;
 
-	Shader(const GLchar* vertexPath, const GLchar* fragmentPath) {
+	//defines specialize the program, every set of defines is compiled and cached as its own program
+	Shader(const GLchar* vertexPath, const GLchar* fragmentPath, const ShaderDefines& defines = ShaderDefines()) {
 
 		// 1. retrieve the vertex/fragment source code from filePath
 		std::string vertexCode;
 		std::string fragmentCode;
-		std::ifstream vShaderFile;
-		std::ifstream fShaderFile;
-		// ensure ifstream objects can throw exceptions:
-		vShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-		fShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
 		try
 		{
-			// open files
-			vShaderFile.open(vertexPath);
-			fShaderFile.open(fragmentPath);
-			std::stringstream vShaderStream, fShaderStream;
-			// read file's buffer contents into streams
-			vShaderStream << vShaderFile.rdbuf();
-			fShaderStream << fShaderFile.rdbuf();
-			// close file handlers
-			vShaderFile.close();
-			fShaderFile.close();
-			// convert stream into string
-			vertexCode = vShaderStream.str();
-			fragmentCode = fShaderStream.str();
-		}
-		catch (std::ifstream::failure e)
+			vertexCode = readSource(vertexPath);
+			fragmentCode = readSource(fragmentPath);
+		}
+		catch (std::ifstream::failure& e)
 		{
 			std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ" << std::endl;
 		}
-		const char* vShaderCode = vertexCode.c_str();
-		const char* fShaderCode = fragmentCode.c_str();
+		injectDefines(vertexCode, defines);
+		injectDefines(fragmentCode, defines);
 
+		// 2. reuse the binary of an earlier run or compile the shaders
+		const Stage stages[] = {
+			{GL_VERTEX_SHADER, &vertexCode, "VERTEX"},
+			{GL_FRAGMENT_SHADER, &fragmentCode, "FRAGMENT"}
+		};
+		const GLchar* paths[] = {vertexPath, fragmentPath};
+		build(stages, 2, cacheFile(paths, 2, defines));
+	}
 
-		// 2. compile shaders
-		unsigned int vertex, fragment;
-		int success;
-		char infoLog[512];
+	//compute only program, needs a 4.3 context
+	explicit Shader(const GLchar* computePath, const ShaderDefines& defines = ShaderDefines()) {
 
-		//vertex
-		vertex = glCreateShader(GL_VERTEX_SHADER);
-		glShaderSource(vertex, 1, &vShaderCode, NULL);
-		glCompileShader(vertex);
-		//print errors
-		glGetShaderiv(vertex, GL_COMPILE_STATUS, &success);
-		if(!success)
+		std::string computeCode;
+		try
 		{
-			glGetShaderInfoLog(vertex, 512, NULL, infoLog);
-			std::cout << "ERROR::SHADER::VERTEX::COMPILATION_FAILED\n" << infoLog << std::endl;
-		};
+			computeCode = readSource(computePath);
+		}
+		catch (std::ifstream::failure& e)
+		{
+			std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ" << std::endl;
+		}
+		injectDefines(computeCode, defines);
 
-		//Fragment
-		fragment = glCreateShader(GL_FRAGMENT_SHADER);
-		glShaderSource(fragment, 1, &fShaderCode, NULL);
-		glCompileShader(fragment);
-		// print compile errors if any
-		glGetShaderiv(fragment, GL_COMPILE_STATUS, &success);
-		if (!success)
+		const Stage stages[] = {{GL_COMPUTE_SHADER, &computeCode, "COMPUTE"}};
+		build(stages, 1, cacheFile(&computePath, 1, defines));
+	}
+
+	//true if the program was restored from the binary cache instead of compiled
+	bool fromCache = false;
+
+	//false if the program failed to compile or link, only meaningful once ready returned true
+	bool linked = false;
+
+	//the file at path and every file it includes, as readSource resolves them
+	static std::vector<std::string> sourceFiles(const std::string& path)
+	{
+		std::vector<std::string> files;
+		try
 		{
-			glGetShaderInfoLog(fragment, 512, NULL, infoLog);
-			std::cout << "ERROR::SHADER::FRAGMENT::COMPILATION_FAILED\n" << infoLog << std::endl;
-		};
+			readSource(path, &files);
+		}
+		catch (std::ifstream::failure& e)
+		{
+		}
+		return files;
+	}
+
+	//true once the driver is done linking, only polls GL_COMPLETION_STATUS_KHR if the context compiles in parallel
+	//without parallel compilation this waits for the link like finish
+	bool ready()
+	{
+		if (!pending)
+			return true;
+		if (parallel)
+		{
+			int complete = 0;
+			glGetProgramiv(ID, GL_COMPLETION_STATUS_KHR, &complete);
+			if (!complete)
+				return false;
+		}
+		finish();
+		return true;
+	}
+
+	//waits for the link the constructor submitted, reports errors, looks the uniforms up and saves the binary
+	void finish()
+	{
+		if (!pending)
+			return;
+		pending = false;
+
+		linked = checkLink();
+		for (size_t i = 0; i < pendingStages.size(); ++i)
+		{
+			if (!linked)
+				checkStage(pendingStages[i], stageNames[i]);
+			glDetachShader(ID, pendingStages[i]);
+			glDeleteShader(pendingStages[i]);
+		}
+		pendingStages.clear();
+		stageNames.clear();
+
+		if (linked && binaries)
+			saveBinary(cachePath, hash);
+	}
+
+	//deletes the program and the stages a pending link still holds, without waiting for the driver
+	//deleting only the program would leak those stages, a Shader owns both until finish detached the stages
+	void release()
+	{
+		for (unsigned int stage : pendingStages)
+			glDeleteShader(stage);
+		pendingStages.clear();
+		stageNames.clear();
+		pending = false;
+		glDeleteProgram(ID);
+		ID = 0;
+	}
+
+	//the first use waits for the link
+	void use() {
+		finish();
+		glUseProgram(ID);
+	}
+
+	//location of an active uniform from the table built at link time, -1 if the program does not use it
+	//elements of arrays are found as name[i], the bare array name is its first element
+	int uniform(const std::string& name) const
+	{
+		auto found = uniforms.find(name);
+		return found == uniforms.end() ? -1 : found->second;
+	}
+
+	//connects a uniform block of the program to a buffer binding point, blocks the program lacks are ignored
+	void bindUniformBlock(const GLchar* name, unsigned int bindingPoint) const
+	{
+		unsigned int index = glGetUniformBlockIndex(ID, name);
+		if (index != GL_INVALID_INDEX)
+			glUniformBlockBinding(ID, index, bindingPoint);
+	}
+
+	//setters by location from uniform, the program has to be in use
+	void setInt(int location, int value) const
+	{
+		glUniform1i(location, value);
+	}
+
+	void setFloat(int location, float value) const
+	{
+		glUniform1f(location, value);
+	}
+
+	void setVec3(int location, const glm::vec3& value) const
+	{
+		glUniform3fv(location, 1, glm::value_ptr(value));
+	}
+
+	void setMat4(int location, const glm::mat4& value) const
+	{
+		glUniformMatrix4fv(location, 1, GL_FALSE, glm::value_ptr(value));
+	}
+
+	void setMat4(const std::string &name, glm::mat4 value) const
+	{
+		setMat4(uniform(name), value);
+	}
+
+private:
+	//source of a shader file with every #include "file" line replaced by that file, paths are relative to the including file
+	//the files come from the sources embedded at build time unless the shader directory overrides them
+	static std::string readSource(const std::string& path, std::vector<std::string>* files = nullptr)
+	{
+		if (files)
+			files->push_back(path);
+		std::stringstream shaderStream(shaderFileSource(path));
+
+		std::string directory;
+		size_t slash = path.find_last_of("/\\");
+		if (slash != std::string::npos)
+			directory = path.substr(0, slash + 1);
+
+		std::string code;
+		std::string line;
+		while (std::getline(shaderStream, line))
+		{
+			size_t directive = line.find_first_not_of(" \t");
+			if (directive != std::string::npos && line.compare(directive, 8, "#include") == 0)
+			{
+				size_t open = line.find('"', directive);
+				size_t close = line.find('"', open + 1);
+				if (open != std::string::npos && close != std::string::npos)
+				{
+					code += readSource(directory + line.substr(open + 1, close - open - 1), files);
+					continue;
+				}
+			}
+			code += line + '\n';
+		}
+		return code;
+	}
+
+	struct Stage
+	{
+		GLenum type;
+		const std::string* code;
+		const char* name;
+	};
+
+	//header in front of the driver's binary in a .programbin file
+	struct BinaryHeader
+	{
+		char magic[8];
+		unsigned long long hash;
+		unsigned int format;
+		unsigned int length;
+	};
 
-		//shader Pogram
+	/*	Method creates the program from its binary cache or submits compiling and linking the stages
+	 *
+	 *	stages: source of every stage after the includes were expanded
+	 *	count: number of stages
+	 *	cachePath: file the binary is loaded from and saved to
+	 *
+	 *	The cache is keyed by the sources and the driver, a binary another driver or older sources produced is
+	 *	ignored, as is one the driver rejects, and then replaced by the freshly linked program
+	 *	Compiling does not wait for the driver, finish collects the result, so several programs and other startup
+	 *	work overlap on drivers that compile in the background
+	 */
+	void build(const Stage* stages, int count, const std::string& cachePath)
+	{
 		ID = glCreateProgram();
-		glAttachShader(ID, vertex);
-		glAttachShader(ID, fragment);
+		this->cachePath = cachePath;
+
+		binaries = hasProgramBinarySupport();
+		hash = binaries ? sourceHash(stages, count) : 0;
+		if (binaries && loadBinary(cachePath, hash))
+		{
+			fromCache = true;
+			linked = true;
+			reflectUniforms();
+			return;
+		}
+
+		parallel = hasParallelShaderCompile();
+		for (int i = 0; i < count; ++i)
+		{
+			pendingStages.push_back(compileStage(stages[i].type, *stages[i].code));
+			stageNames.push_back(stages[i].name);
+			glAttachShader(ID, pendingStages.back());
+		}
+		if (binaries)
+			glProgramParameteri(ID, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
 		glLinkProgram(ID);
+		pending = true;
+	}
+
+	//FNV-1a over the stages and the strings that identify the driver, a driver update invalidates the binaries
+	static unsigned long long sourceHash(const Stage* stages, int count)
+	{
+		unsigned long long hash = 14695981039346656037ull;
+		auto add = [&hash](const void* data, size_t size) {
+			const unsigned char* bytes = static_cast<const unsigned char*>(data);
+			for (size_t i = 0; i < size; ++i)
+				hash = (hash ^ bytes[i]) * 1099511628211ull;
+		};
+
+		for (GLenum name : {GL_VENDOR, GL_RENDERER, GL_VERSION})
+		{
+			const GLubyte* value = glGetString(name);
+			if (value)
+				add(value, std::strlen(reinterpret_cast<const char*>(value)) + 1);
+		}
+		for (int i = 0; i < count; ++i)
+		{
+			add(&stages[i].type, sizeof(stages[i].type));
+			add(stages[i].code->data(), stages[i].code->size() + 1);
+		}
+		return hash;
+	}
+
+	bool loadBinary(const std::string& path, unsigned long long hash)
+	{
+		std::ifstream file(path, std::ios::binary);
+		BinaryHeader header;
+		if (!file.read(reinterpret_cast<char*>(&header), sizeof(header)) ||
+			std::memcmp(header.magic, "PROGBIN", 8) != 0 || header.hash != hash || header.length == 0)
+			return false;
+
+		std::vector<char> binary(header.length);
+		if (!file.read(binary.data(), binary.size()))
+			return false;
+
+		glProgramBinary(ID, header.format, binary.data(), static_cast<GLsizei>(binary.size()));
+		int success;
+		glGetProgramiv(ID, GL_LINK_STATUS, &success);
+		return success != 0;
+	}
+
+	void saveBinary(const std::string& path, unsigned long long hash) const
+	{
+		int length = 0;
+		glGetProgramiv(ID, GL_PROGRAM_BINARY_LENGTH, &length);
+		if (length <= 0)
+			return;
+
+		std::vector<char> binary(length);
+		GLenum format = 0;
+		glGetProgramBinary(ID, length, &length, &format, binary.data());
+
+		BinaryHeader header = {{'P', 'R', 'O', 'G', 'B', 'I', 'N', '\0'}, hash, format, static_cast<unsigned int>(length)};
+		std::ofstream file(path, std::ios::binary | std::ios::trunc);
+		file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		file.write(binary.data(), length);
+		if (!file)
+			std::cout << "Could not write the program binary " << path << std::endl;
+	}
+
+	//GLSL only allows comments and blank lines before #version, so the defines go right after it
+	static void injectDefines(std::string& code, const ShaderDefines& defines)
+	{
+		if (defines.empty())
+			return;
+
+		std::string lines;
+		for (const auto& define : defines)
+			lines += "#define " + define.first + " " + define.second + "\n";
+
+		size_t version = code.find("#version");
+		size_t lineEnd = version == std::string::npos ? std::string::npos : code.find('\n', version);
+		if (version == std::string::npos)
+			code.insert(0, lines);
+		else if (lineEnd == std::string::npos)
+			code += "\n" + lines;
+		else
+			code.insert(lineEnd + 1, lines);
+	}
+
+	//the binary is named after the last stage and saved in the program cache directory, tagged with a hash of the other
+	//stage paths and the defines so programs sharing a fragment shader and variants of one program keep their own file
+	static std::string cacheFile(const GLchar* const* paths, int count, const ShaderDefines& defines)
+	{
+		const std::string path = paths[count - 1];
+		if (count == 1 && defines.empty())
+			return programCachePath(path + ".programbin");
+
+		unsigned long long hash = 14695981039346656037ull;
+		for (int i = 0; i < count - 1; ++i)
+		{
+			for (const char* c = paths[i]; *c; ++c)
+				hash = (hash ^ static_cast<unsigned char>(*c)) * 1099511628211ull;
+			hash = (hash ^ static_cast<unsigned char>('|')) * 1099511628211ull;
+		}
+		for (const auto& define : defines)
+		{
+			for (char c : define.first + "=" + define.second + ";")
+				hash = (hash ^ static_cast<unsigned char>(c)) * 1099511628211ull;
+		}
+		std::ostringstream name;
+		name << path << "." << std::hex << hash << ".programbin";
+		return programCachePath(name.str());
+	}
+
+	static unsigned int compileStage(GLenum type, const std::string& code)
+	{
+		const char* shaderCode = code.c_str();
+
+		unsigned int shader = glCreateShader(type);
+		glShaderSource(shader, 1, &shaderCode, NULL);
+		glCompileShader(shader);
+		return shader;
+	}
+
+	static void checkStage(unsigned int shader, const char* stageName)
+	{
+		int success;
+		char infoLog[512];
+
+		//print errors
+		glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
+		if (!success)
+		{
+			glGetShaderInfoLog(shader, 512, NULL, infoLog);
+			std::cout << "ERROR::SHADER::" << stageName << "::COMPILATION_FAILED\n" << infoLog << std::endl;
+		}
+	}
+
+	bool checkLink()
+	{
+		int success;
+		char infoLog[512];
+
 		//print errors again
 		glGetProgramiv(ID, GL_LINK_STATUS, &success);
 		if (!success)
 		{
 			glGetProgramInfoLog(ID, 512, NULL, infoLog);
 			std::cout << "ERROR::SHADER::PROGRAM::LINKING_FAILED\n" << infoLog << std::endl;
+			return false;
 		}
-
-		//free Shader resources
-		glDeleteShader(vertex);
-		glDeleteShader(fragment);
-	}
-
-	void use() {
-		glUseProgram(ID);
+		reflectUniforms();
+		return true;
 	}
 
-	void setMat4(const std::string &name, glm::mat4 value) const
+	//looks every active uniform up once, so setting them later needs no string lookups in the driver
+	void reflectUniforms()
 	{
-		glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, glm::value_ptr(value));
-		
+		uniforms.clear();
+		int count = 0;
+		int maxLength = 0;
+		glGetProgramiv(ID, GL_ACTIVE_UNIFORMS, &count);
+		glGetProgramiv(ID, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+
+		std::string name(std::max(maxLength, 1), '\0');
+		for (int i = 0; i < count; ++i)
+		{
+			int length = 0;
+			int size = 0;
+			GLenum type;
+			glGetActiveUniform(ID, static_cast<GLuint>(i), maxLength, &length, &size, &type, &name[0]);
+			std::string uniformName = name.substr(0, length);
+
+			//members of uniform blocks have no location
+			int location = glGetUniformLocation(ID, uniformName.c_str());
+			if (location < 0)
+				continue;
+
+			//arrays are reported as name[0], the locations of their elements are not guaranteed to be consecutive
+			size_t bracket = uniformName.find('[');
+			if (bracket == std::string::npos)
+			{
+				uniforms[uniformName] = location;
+				continue;
+			}
+			std::string arrayName = uniformName.substr(0, bracket);
+			uniforms[arrayName] = location;
+			for (int element = 0; element < size; ++element)
+			{
+				std::string elementName = arrayName + "[" + std::to_string(element) + "]";
+				uniforms[elementName] = glGetUniformLocation(ID, elementName.c_str());
+			}
+		}
 	}
+
+	std::unordered_map<std::string, int> uniforms;
+
+	//state of a link that was submitted but not collected yet
+	bool pending = false;
+	bool parallel = false;
+	std::vector<unsigned int> pendingStages;
+	std::vector<const char*> stageNames;
+
+	bool binaries = false;
+	unsigned long long hash = 0;
+	std::string cachePath;
 };
 
 
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,95 @@
+#include "pch.h"
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+#include "ShaderSources.h"
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include "EmbeddedShaders.h"
+
+namespace
+{
+	std::string shaderDirectory;
+	std::string programCacheDirectory;
+
+	std::string withSeparator(const std::string& directory)
+	{
+		if (directory.empty() || directory.back() == '/' || directory.back() == '\\')
+			return directory;
+		return directory + '/';
+	}
+
+	bool readFile(const std::string& path, std::string& code, bool required)
+	{
+		std::ifstream file;
+		if (required)
+			file.exceptions(std::ifstream::failbit | std::ifstream::badbit);
+		file.open(path);
+		if (!file)
+			return false;
+		std::stringstream stream;
+		stream << file.rdbuf();
+		code = stream.str();
+		return true;
+	}
+}
+
+void setShaderDirectory(const std::string& directory)
+{
+	shaderDirectory = withSeparator(directory);
+}
+
+void setProgramCacheDirectory(const std::string& directory)
+{
+	programCacheDirectory = withSeparator(directory);
+}
+
+std::string programCachePath(const std::string& name)
+{
+	return programCacheDirectory + name;
+}
+
+std::string executableDirectory()
+{
+	std::string path(4096, '\0');
+#ifdef _WIN32
+	DWORD length = GetModuleFileNameA(nullptr, &path[0], static_cast<DWORD>(path.size()));
+	if (length == 0 || length >= path.size())
+		return std::string();
+#else
+	ssize_t length = readlink("/proc/self/exe", &path[0], path.size());
+	if (length <= 0 || length >= static_cast<ssize_t>(path.size()))
+		return std::string();
+#endif
+	path.resize(length);
+	size_t separator = path.find_last_of("/\\");
+	return separator == std::string::npos ? std::string() : path.substr(0, separator + 1);
+}
+
+/*	Method looks a shader file up where it is expected to be
+ *
+ *	path: name of the file as the program or an #include gives it
+ *
+ *	The shader directory comes first so edited shaders are picked up without a rebuild, then the table
+ *	embedded at build time, files that are not part of the table are read from the working directory as before
+ */
+std::string shaderFileSource(const std::string& path)
+{
+	std::string code;
+	if (!shaderDirectory.empty() && readFile(shaderDirectory + path, code, false))
+		return code;
+
+	for (size_t i = 0; i < embeddedShaderCount; ++i)
+	{
+		if (std::strcmp(embeddedShaders[i].name, path.c_str()) == 0)
+			return embeddedShaders[i].source;
+	}
+
+	readFile(path, code, true);
+	return code;
+}
@@ -0,0 +1,23 @@
+#ifndef SHADER_SOURCES_H
+#define SHADER_SOURCES_H
+
+#include <string>
+
+//the shader files are embedded in the executable at build time by embedShaders.ps1, so the baker runs from any
+//working directory without reading them, a shader directory set while developing takes precedence over them
+
+//directory whose shader files replace the embedded ones, empty uses only the embedded sources
+void setShaderDirectory(const std::string& directory);
+
+//directory the program binaries are cached in, empty caches them in the working directory
+void setProgramCacheDirectory(const std::string& directory);
+//file in the program cache directory for the cache file name
+std::string programCachePath(const std::string& name);
+//directory the running executable lives in, with a trailing separator, empty if it cannot be found
+std::string executableDirectory();
+
+//source of one shader file without expanding its includes
+//throws std::ifstream::failure if neither the shader directory, the embedded sources nor the working directory have it
+std::string shaderFileSource(const std::string& path);
+
+#endif
@@ -0,0 +1,163 @@
+#include "pch.h"
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#elif defined(__linux__)
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+#include "ShaderWatcher.h"
+#include <iostream>
+
+//a file counts as saved once no notification for it came in for this long
+#define settleMilliseconds 50
+
+//one change notification subscription, the platform parts of the watcher
+class DirectoryWatch
+{
+public:
+	~DirectoryWatch()
+	{
+#ifdef _WIN32
+		if (directory != INVALID_HANDLE_VALUE)
+		{
+			CancelIo(directory);
+			CloseHandle(directory);
+		}
+		if (overlapped.hEvent)
+			CloseHandle(overlapped.hEvent);
+#elif defined(__linux__)
+		if (descriptor >= 0)
+			close(descriptor);
+#endif
+	}
+
+	static std::unique_ptr<DirectoryWatch> open(const std::string& path)
+	{
+		std::unique_ptr<DirectoryWatch> watch(new DirectoryWatch());
+#ifdef _WIN32
+		watch->directory = CreateFileA(path.c_str(), FILE_LIST_DIRECTORY,
+		                               FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING,
+		                               FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED, nullptr);
+		if (watch->directory == INVALID_HANDLE_VALUE)
+			return nullptr;
+		watch->overlapped.hEvent = CreateEventA(nullptr, TRUE, FALSE, nullptr);
+		if (!watch->overlapped.hEvent || !watch->request())
+			return nullptr;
+#elif defined(__linux__)
+		watch->descriptor = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+		if (watch->descriptor < 0)
+			return nullptr;
+		//editors either write the file in place or write a copy and rename it over the old one
+		if (inotify_add_watch(watch->descriptor, path.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) < 0)
+			return nullptr;
+#else
+		return nullptr;
+#endif
+		return watch;
+	}
+
+	//appends the names of the files that changed since the last call, duplicates included
+	void poll(std::vector<std::string>& names)
+	{
+#ifdef _WIN32
+		DWORD bytes = 0;
+		if (!GetOverlappedResult(directory, &overlapped, &bytes, FALSE))
+			return;
+
+		//0 bytes means the buffer overflowed, the changes are lost until the next request
+		size_t offset = 0;
+		while (bytes > 0)
+		{
+			const FILE_NOTIFY_INFORMATION* info = reinterpret_cast<const FILE_NOTIFY_INFORMATION*>(buffer + offset);
+			int wideLength = static_cast<int>(info->FileNameLength / sizeof(WCHAR));
+			int length = WideCharToMultiByte(CP_UTF8, 0, info->FileName, wideLength, nullptr, 0, nullptr, nullptr);
+			std::string name(length, '\0');
+			WideCharToMultiByte(CP_UTF8, 0, info->FileName, wideLength, &name[0], length, nullptr, nullptr);
+			if (info->Action == FILE_ACTION_MODIFIED || info->Action == FILE_ACTION_ADDED ||
+				info->Action == FILE_ACTION_RENAMED_NEW_NAME)
+				names.push_back(name);
+
+			if (info->NextEntryOffset == 0)
+				break;
+			offset += info->NextEntryOffset;
+		}
+		ResetEvent(overlapped.hEvent);
+		request();
+#elif defined(__linux__)
+		alignas(inotify_event) char events[4096];
+		for (;;)
+		{
+			ssize_t bytes = read(descriptor, events, sizeof(events));
+			if (bytes <= 0)
+				return;
+			for (ssize_t offset = 0; offset < bytes;)
+			{
+				const inotify_event* event = reinterpret_cast<const inotify_event*>(events + offset);
+				if (event->len > 0)
+					names.push_back(event->name);
+				offset += sizeof(inotify_event) + event->len;
+			}
+		}
+#else
+		(void)names;
+#endif
+	}
+
+private:
+	DirectoryWatch() = default;
+
+#ifdef _WIN32
+	bool request()
+	{
+		return ReadDirectoryChangesW(directory, buffer, sizeof(buffer), FALSE,
+		                             FILE_NOTIFY_CHANGE_LAST_WRITE | FILE_NOTIFY_CHANGE_FILE_NAME, nullptr,
+		                             &overlapped, nullptr) != 0;
+	}
+
+	HANDLE directory = INVALID_HANDLE_VALUE;
+	OVERLAPPED overlapped = {};
+	//ReadDirectoryChangesW needs DWORD alignment
+	alignas(DWORD) unsigned char buffer[16384];
+#elif defined(__linux__)
+	int descriptor = -1;
+#endif
+};
+
+ShaderWatcher::ShaderWatcher() = default;
+
+ShaderWatcher::~ShaderWatcher() = default;
+
+bool ShaderWatcher::watch(const std::string& directory)
+{
+	directoryWatch = DirectoryWatch::open(directory.empty() ? "." : directory);
+	if (!directoryWatch)
+		std::cout << "Cannot watch the shader directory " << directory << std::endl;
+	return directoryWatch != nullptr;
+}
+
+std::vector<std::string> ShaderWatcher::changedFiles()
+{
+	std::vector<std::string> changed;
+	if (!directoryWatch)
+		return changed;
+
+	auto now = std::chrono::steady_clock::now();
+	std::vector<std::string> names;
+	directoryWatch->poll(names);
+	for (const std::string& name : names)
+		pending[name] = now;
+
+	for (auto file = pending.begin(); file != pending.end();)
+	{
+		if (now - file->second < std::chrono::milliseconds(settleMilliseconds))
+		{
+			++file;
+			continue;
+		}
+		changed.push_back(file->first);
+		file = pending.erase(file);
+	}
+	return changed;
+}
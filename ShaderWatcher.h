@@ -0,0 +1,35 @@
+#ifndef SHADER_WATCHER_H
+#define SHADER_WATCHER_H
+
+#include <chrono>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+class DirectoryWatch;
+
+//reports the files written in one directory, through ReadDirectoryChangesW on Windows and inotify on Linux
+//polled once per frame, it never blocks
+class ShaderWatcher
+{
+public:
+	ShaderWatcher();
+	~ShaderWatcher();
+	ShaderWatcher(const ShaderWatcher&) = delete;
+	ShaderWatcher& operator=(const ShaderWatcher&) = delete;
+
+	//starts watching directory, false if it cannot be opened or the platform has no change notifications
+	bool watch(const std::string& directory);
+
+	//names of the files written since the last call, relative to the directory and each only once
+	//a file is only reported once it was left alone for a moment, editors often write a save in several steps
+	std::vector<std::string> changedFiles();
+
+private:
+	std::unique_ptr<DirectoryWatch> directoryWatch;
+	//time of the last notification of every file that was not reported yet
+	std::map<std::string, std::chrono::steady_clock::time_point> pending;
+};
+
+#endif
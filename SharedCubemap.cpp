@@ -0,0 +1,419 @@
+#include "pch.h"
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#include "SharedCubemap.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <thread>
+#include "BakedCubemap.h"
+#include "Baker.h"
+
+//bump whenever the header below changes
+#define sharedCubemapVersion 1
+//enough for a 32768 base level
+#define maxSharedLevels 16
+
+static_assert(ATOMIC_INT_LOCK_FREE == 2 && ATOMIC_LLONG_LOCK_FREE == 2,
+              "the shared header needs address free atomics to work across processes");
+
+namespace
+{
+	/*	Protocol between the publisher and any number of consumers, no locks are involved:
+	 *	- generation is 0 until the publisher wrote the metadata the first time, odd while it rewrites it and even
+	 *	  otherwise, consumers copy the metadata and accept it if generation was even and did not change meanwhile
+	 *	- the publisher writes a level into the data and then sets its bit in readyLevels with release order,
+	 *	  a consumer that sees the bit with acquire order can read the level in place
+	 *	- a level that was read is only valid if generation is still the same afterwards
+	 *	- retired is set when the publisher goes away, no further levels follow
+	 */
+	struct SharedCubemapHeader
+	{
+		char magic[8];
+		unsigned int version;
+		std::atomic<unsigned int> generation;
+		std::atomic<unsigned int> readyLevels;
+		std::atomic<unsigned int> retired;
+
+		unsigned int size;
+		unsigned int mipLevels;
+		unsigned int internalFormat;
+		//0 for compressed formats
+		unsigned int format;
+		unsigned int type;
+		unsigned int padding;
+		unsigned long long settingsHash;
+		unsigned long long dataBytes;
+		//from the start of the data, which follows the header
+		unsigned long long levelOffset[maxSharedLevels];
+		//system clock time of every publish, so consumers in other processes can measure the latency
+		std::atomic<long long> publishedNanoseconds[maxSharedLevels];
+	};
+
+	const char sharedCubemapMagic[8] = {'C', 'U', 'B', 'E', 'S', 'H', 'M', '\0'};
+
+	long long systemNanoseconds()
+	{
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::system_clock::now().time_since_epoch()).count();
+	}
+
+	//metadata of the current generation, copied out of the header
+	struct SharedCubemapInfo
+	{
+		unsigned int generation;
+		unsigned int size;
+		unsigned int mipLevels;
+		unsigned long long settingsHash;
+		unsigned long long dataBytes;
+		unsigned long long levelOffset[maxSharedLevels];
+	};
+
+	//copies a consistent set of metadata, false while the publisher has not written any or is rewriting it
+	bool readSharedInfo(const SharedCubemapHeader* header, SharedCubemapInfo& info)
+	{
+		unsigned int generation = header->generation.load(std::memory_order_acquire);
+		if (generation == 0 || (generation & 1))
+			return false;
+
+		info.generation = generation;
+		info.size = header->size;
+		info.mipLevels = header->mipLevels;
+		info.settingsHash = header->settingsHash;
+		info.dataBytes = header->dataBytes;
+		std::memcpy(info.levelOffset, header->levelOffset, sizeof(info.levelOffset));
+
+		std::atomic_thread_fence(std::memory_order_acquire);
+		return header->generation.load(std::memory_order_relaxed) == generation;
+	}
+}
+
+//named shared memory, unix systems take POSIX shm names, Windows names live in the session namespace
+class SharedMemory
+{
+public:
+	~SharedMemory()
+	{
+#ifdef _WIN32
+		if (view)
+			UnmapViewOfFile(view);
+		if (mapping)
+			CloseHandle(mapping);
+#else
+		if (view)
+			munmap(view, bytes);
+#endif
+	}
+
+	//opens the segment of that name for writing, creating it zeroed if there is none
+	//an existing segment is reused so consumers that mapped it see the next generation, it only ever grows
+	static std::unique_ptr<SharedMemory> create(const std::string& name, size_t size)
+	{
+		std::unique_ptr<SharedMemory> memory(new SharedMemory());
+		memory->name = name;
+#ifdef _WIN32
+		unsigned long long size64 = size;
+		memory->mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE,
+		                                     static_cast<DWORD>(size64 >> 32), static_cast<DWORD>(size64),
+		                                     systemName(name).c_str());
+		if (!memory->mapping)
+			return nullptr;
+		memory->view = MapViewOfFile(memory->mapping, FILE_MAP_ALL_ACCESS, 0, 0, 0);
+		if (!memory->view || memory->mappedSize() < size)
+			return nullptr;
+#else
+		int file = shm_open(systemName(name).c_str(), O_RDWR | O_CREAT, 0600);
+		if (file < 0)
+			return nullptr;
+		//shrinking would cut pages out of the mappings of consumers still reading the last generation
+		struct stat info;
+		bool sized = fstat(file, &info) == 0 &&
+			(static_cast<size_t>(info.st_size) >= size || ftruncate(file, static_cast<off_t>(size)) == 0);
+		void* address = sized ? mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, file, 0) : MAP_FAILED;
+		close(file);
+		if (address == MAP_FAILED)
+			return nullptr;
+		memory->view = address;
+#endif
+		memory->bytes = size;
+		return memory;
+	}
+
+	//maps an existing segment, nullptr if there is none of that name
+	static std::unique_ptr<SharedMemory> open(const std::string& name)
+	{
+		std::unique_ptr<SharedMemory> memory(new SharedMemory());
+#ifdef _WIN32
+		memory->mapping = OpenFileMappingA(FILE_MAP_READ, FALSE, systemName(name).c_str());
+		if (!memory->mapping)
+			return nullptr;
+		memory->view = MapViewOfFile(memory->mapping, FILE_MAP_READ, 0, 0, 0);
+		if (!memory->view)
+			return nullptr;
+		memory->bytes = memory->mappedSize();
+#else
+		int file = shm_open(systemName(name).c_str(), O_RDONLY, 0);
+		if (file < 0)
+			return nullptr;
+		struct stat info;
+		void* address = MAP_FAILED;
+		if (fstat(file, &info) == 0 && info.st_size > 0)
+			address = mmap(nullptr, info.st_size, PROT_READ, MAP_SHARED, file, 0);
+		close(file);
+		if (address == MAP_FAILED)
+			return nullptr;
+		memory->view = address;
+		memory->bytes = static_cast<size_t>(info.st_size);
+#endif
+		return memory;
+	}
+
+	//removes the name, mappings stay valid until they are closed
+	void unlink()
+	{
+#ifndef _WIN32
+		shm_unlink(systemName(name).c_str());
+#endif
+	}
+
+	unsigned char* data() const { return static_cast<unsigned char*>(view); }
+	size_t size() const { return bytes; }
+
+private:
+	SharedMemory() = default;
+
+#ifdef _WIN32
+	static std::string systemName(const std::string& name) { return "Local\\" + name; }
+
+	size_t mappedSize() const
+	{
+		MEMORY_BASIC_INFORMATION info;
+		return VirtualQuery(view, &info, sizeof(info)) ? info.RegionSize : 0;
+	}
+
+	HANDLE mapping = nullptr;
+#else
+	static std::string systemName(const std::string& name) { return name[0] == '/' ? name : "/" + name; }
+#endif
+	std::string name;
+	void* view = nullptr;
+	size_t bytes = 0;
+};
+
+SharedCubemapPublisher::SharedCubemapPublisher() = default;
+
+SharedCubemapPublisher::~SharedCubemapPublisher()
+{
+	//consumers that mapped the segment still see it retire, Windows removes it with the last handle
+	if (memory)
+	{
+		reinterpret_cast<SharedCubemapHeader*>(memory->data())->retired.store(1, std::memory_order_release);
+		memory->unlink();
+	}
+}
+
+/*	Method creates the segment and writes the metadata of a bake into it
+ *
+ *	name: segment name without the platform prefix
+ *	config: the bake that is published, resolution, mip count and format decide the layout
+ *	settingsHash: bakeSettingsHash of the bake, consumers can compare it against their own settings
+ *	publisher: receives the mapped segment
+ *
+ *	The levels follow the header in the layout of a saved bake, coarsest level first
+ */
+bool beginSharedCubemap(const std::string& name, const BakeConfig& config, unsigned long long settingsHash,
+                        SharedCubemapPublisher& publisher)
+{
+	const int mipLevels = config.mipLevels();
+	if (name.empty() || mipLevels > maxSharedLevels)
+		return false;
+
+	const size_t dataBytes = storedDataBytes(config);
+	std::unique_ptr<SharedMemory> memory = SharedMemory::create(name, sizeof(SharedCubemapHeader) + dataBytes);
+	if (!memory)
+	{
+		std::cout << "Could not create the shared cubemap " << name << std::endl;
+		return false;
+	}
+
+	//a fresh segment is zeroed, which is a valid header of generation 0 for every consumer
+	//a reused one continues its generations, an odd one was left behind by a publisher that died while writing
+	SharedCubemapHeader* header = reinterpret_cast<SharedCubemapHeader*>(memory->data());
+	unsigned int generation = header->generation.load(std::memory_order_relaxed) & ~1u;
+	header->generation.store(generation + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+
+	header->readyLevels.store(0, std::memory_order_relaxed);
+	header->retired.store(0, std::memory_order_relaxed);
+	std::memcpy(header->magic, sharedCubemapMagic, sizeof(header->magic));
+	header->version = sharedCubemapVersion;
+
+	const StoredLayout layout = storedLayout(config.format);
+	header->size = config.cubeMapSize;
+	header->mipLevels = mipLevels;
+	header->internalFormat = storageInternalFormat(config.format);
+	header->format = layout.format;
+	header->type = layout.type;
+	header->settingsHash = settingsHash;
+	header->dataBytes = dataBytes;
+
+	unsigned long long offset = 0;
+	for (int mipLevel = mipLevels - 1; mipLevel >= 0; --mipLevel)
+	{
+		header->levelOffset[mipLevel] = offset;
+		header->publishedNanoseconds[mipLevel].store(0, std::memory_order_relaxed);
+		offset += storedLevelBytes(config, mipLevel);
+	}
+
+	header->generation.store(generation + 2, std::memory_order_release);
+
+	publisher.memory = std::move(memory);
+	publisher.config = config;
+	std::cout << "Publishing the cubemap as shared memory " << name << " (" << dataBytes / 1024 << " KB)" << std::endl;
+	return true;
+}
+
+void publishSharedLevel(SharedCubemapPublisher& publisher, int mipLevel, unsigned int cubeMapTexture)
+{
+	if (!publisher.memory)
+		return;
+
+	SharedCubemapHeader* header = reinterpret_cast<SharedCubemapHeader*>(publisher.memory->data());
+	unsigned char* data = publisher.memory->data() + sizeof(SharedCubemapHeader);
+
+	//the readback writes straight into the segment
+	readStoredLevel(publisher.config, mipLevel, cubeMapTexture, data + header->levelOffset[mipLevel]);
+
+	header->publishedNanoseconds[mipLevel].store(systemNanoseconds(), std::memory_order_relaxed);
+	header->readyLevels.fetch_or(1u << mipLevel, std::memory_order_release);
+}
+
+/*	Method follows a publisher from another process
+ *
+ *	name: segment name given to the publisher
+ *
+ *	Waits for the segment and for a complete header, then reports every level as soon as its ready bit is set
+ *	with the time since the publish and an FNV-1a checksum computed on the mapped memory
+ *	Starts over whenever the publisher begins a new generation
+ */
+int runSharedCubemapConsumer(const std::string& name)
+{
+	std::cout << "Waiting for the shared cubemap " << name << std::endl;
+
+	std::unique_ptr<SharedMemory> memory;
+	while (!(memory = SharedMemory::open(name)))
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+
+	const SharedCubemapHeader* header = reinterpret_cast<const SharedCubemapHeader*>(memory->data());
+	if (memory->size() < sizeof(SharedCubemapHeader))
+	{
+		std::cout << "Shared memory " << name << " is too small for a cubemap" << std::endl;
+		return -1;
+	}
+
+	while (true)
+	{
+		SharedCubemapInfo info;
+		while (!readSharedInfo(header, info))
+		{
+			if (header->retired.load(std::memory_order_acquire))
+			{
+				std::cout << "The publisher stopped before it wrote a cubemap" << std::endl;
+				return -1;
+			}
+			std::this_thread::yield();
+		}
+
+		//the publisher grew the segment for a larger generation than this mapping covers
+		if (memory->size() < sizeof(SharedCubemapHeader) + info.dataBytes)
+		{
+			std::unique_ptr<SharedMemory> grown = SharedMemory::open(name);
+			if (grown && grown->size() >= sizeof(SharedCubemapHeader) + info.dataBytes)
+			{
+				memory = std::move(grown);
+				header = reinterpret_cast<const SharedCubemapHeader*>(memory->data());
+				continue;
+			}
+		}
+
+		if (std::memcmp(header->magic, sharedCubemapMagic, sizeof(header->magic)) != 0
+			|| header->version != sharedCubemapVersion || info.mipLevels > maxSharedLevels
+			|| memory->size() < sizeof(SharedCubemapHeader) + info.dataBytes)
+		{
+			std::cout << "Shared memory " << name << " does not hold a cubemap of this version" << std::endl;
+			return -1;
+		}
+
+		std::cout << "Generation " << info.generation << ": " << info.size << "x" << info.size << " cubemap with "
+			<< info.mipLevels << " levels, settings " << std::hex << info.settingsHash << std::dec << std::endl;
+
+		const unsigned char* data = memory->data() + sizeof(SharedCubemapHeader);
+		const unsigned int allLevels = (1u << info.mipLevels) - 1;
+		unsigned int seenLevels = 0;
+		bool republished = false;
+		while (seenLevels != allLevels && !republished)
+		{
+			unsigned int readyLevels = header->readyLevels.load(std::memory_order_acquire);
+			unsigned int newLevels = readyLevels & ~seenLevels & allLevels;
+			if (!newLevels)
+			{
+				if (header->generation.load(std::memory_order_acquire) != info.generation)
+					republished = true;
+				else if (header->retired.load(std::memory_order_acquire))
+				{
+					std::cout << "The publisher stopped before every level was ready" << std::endl;
+					return -1;
+				}
+				std::this_thread::yield();
+				continue;
+			}
+
+			long long seen = systemNanoseconds();
+			for (int mipLevel = info.mipLevels - 1; mipLevel >= 0; --mipLevel)
+			{
+				if (!(newLevels & (1u << mipLevel)))
+					continue;
+
+				long long published = header->publishedNanoseconds[mipLevel].load(std::memory_order_relaxed);
+				unsigned long long end = mipLevel > 0 ? info.levelOffset[mipLevel - 1] : info.dataBytes;
+				unsigned long long bytes = end - info.levelOffset[mipLevel];
+
+				//the level is read where the publisher wrote it
+				unsigned long long checksum = 14695981039346656037ull;
+				const unsigned char* level = data + info.levelOffset[mipLevel];
+				for (unsigned long long i = 0; i < bytes; ++i)
+				{
+					checksum ^= level[i];
+					checksum *= 1099511628211ull;
+				}
+
+				std::cout << "  level " << mipLevel << " (" << std::max(1u, info.size >> mipLevel) << "x"
+					<< std::max(1u, info.size >> mipLevel) << ", " << bytes << " bytes) seen "
+					<< (seen - published) / 1000.0 << " us after its publish, checksum " << std::hex << checksum
+					<< std::dec << std::endl;
+			}
+			seenLevels |= newLevels;
+
+			//a level that changed generation while it was read is stale
+			if (header->generation.load(std::memory_order_acquire) != info.generation)
+				republished = true;
+		}
+
+		if (!republished)
+		{
+			std::cout << "Every level of generation " << info.generation << " arrived" << std::endl;
+			return 0;
+		}
+		std::cout << "The publisher started a new generation, starting over" << std::endl;
+	}
+}
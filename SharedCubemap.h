@@ -0,0 +1,36 @@
+#ifndef SHARED_CUBEMAP_H
+#define SHARED_CUBEMAP_H
+
+#include <memory>
+#include <string>
+#include "BakeConfig.h"
+
+class SharedMemory;
+
+//publishes the levels of a cubemap into a named shared memory segment as soon as each one is done
+//the segment holds a header and the levels in the layout of a saved bake, coarsest level first
+//other processes map it and read the levels in place, see runSharedCubemapConsumer for the protocol
+struct SharedCubemapPublisher
+{
+	SharedCubemapPublisher();
+	~SharedCubemapPublisher();
+	SharedCubemapPublisher(const SharedCubemapPublisher&) = delete;
+	SharedCubemapPublisher& operator=(const SharedCubemapPublisher&) = delete;
+
+	std::unique_ptr<SharedMemory> memory;
+	BakeConfig config;
+};
+
+//writes a new generation for a bake with config into the segment, creating it if there is none yet
+//consumers that mapped an older generation see the switch and start over
+bool beginSharedCubemap(const std::string& name, const BakeConfig& config, unsigned long long settingsHash,
+                        SharedCubemapPublisher& publisher);
+
+//reads one finished level of cubeMapTexture back into the segment and marks it ready
+void publishSharedLevel(SharedCubemapPublisher& publisher, int mipLevel, unsigned int cubeMapTexture);
+
+//maps the segment, waits for every level of the current bake and prints how long after the publish each one
+//was seen, the levels are checksummed in place without a copy, returns the process exit code
+int runSharedCubemapConsumer(const std::string& name);
+
+#endif
@@ -0,0 +1,442 @@
+#include "pch.h"
+#include "SphereMesh.h"
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define SPHERE_SSE2 1
+#endif
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <string>
+#include <thread>
+#include "MeshOptimizer.h"
+
+#define PI 3.14159265358979323846
+//rows of vertices a thread takes at once, smaller spheres are generated on the calling thread alone
+#define sphereRowsPerTask 32
+
+void encodeOctahedral(float x, float y, float z, short* encoded)
+{
+	float length = std::abs(x) + std::abs(y) + std::abs(z);
+	float u = x / length;
+	float v = y / length;
+
+	//the lower half folds over the diagonals onto the corners of the square
+	if (z < 0.0f)
+	{
+		float foldedU = (1.0f - std::abs(v)) * (u >= 0.0f ? 1.0f : -1.0f);
+		float foldedV = (1.0f - std::abs(u)) * (v >= 0.0f ? 1.0f : -1.0f);
+		u = foldedU;
+		v = foldedV;
+	}
+
+	encoded[0] = static_cast<short>(std::lround(std::max(-1.0f, std::min(u, 1.0f)) * 32767.0f));
+	encoded[1] = static_cast<short>(std::lround(std::max(-1.0f, std::min(v, 1.0f)) * 32767.0f));
+}
+
+/*	Method packs the sphere into the compact vertex format
+ *
+ *	vertices: position and normal of every vertex as 6 floats, only the normals are kept
+ *	indices: triangle list into vertices
+ *	mesh: receives one encoded normal per vertex and the indices as 16 bit
+ *
+ *	4 bytes per vertex instead of 24 and 2 per index instead of 4, the snorm16 grid of the octahedral square keeps
+ *	the rebuilt directions within about 1e-4 radians of the originals
+ */
+bool packCompactMesh(const std::vector<float>& vertices, const std::vector<unsigned int>& indices, CompactMesh& mesh)
+{
+	size_t vertexCount = vertices.size() / 6;
+	if (vertexCount > std::numeric_limits<unsigned short>::max())
+		return false;
+
+	mesh.normals.resize(2 * vertexCount);
+	for (size_t vertex = 0; vertex < vertexCount; ++vertex)
+	{
+		const float* normal = &vertices[6 * vertex + 3];
+		encodeOctahedral(normal[0], normal[1], normal[2], &mesh.normals[2 * vertex]);
+	}
+
+	mesh.indices.assign(indices.begin(), indices.end());
+	return true;
+}
+
+/*	Method takes the sphere radius as first input
+ *	Calculation happens based on the sector and stacks principle where the Sphere is divided into tinier spaces
+ *	Then we can approximate the vertices of those spaces
+ *
+ *	radius: the radius of the sphere
+ *	sectors: number of pieces along the x-axis
+ *	stacks: number of pieces along the y-axis
+ *	EBO: the EBO in which the indices should be written into to draw the sphere later
+ *	buffer: the VAO into which the coordinates should be written
+ *	
+ *	Writes the indices into the specified EBO and the coordinates, normals as well as texture coordinates into the buffer
+ */
+void createSphereCoordinates(float radius, float sectors, float stacks, std::vector<unsigned int>& EBO,
+                             std::vector<float>& buffer)
+{
+	float x, y, z;
+
+	//helper variables for normal calculation
+	float nx, ny, nz;
+
+	float s, t;
+
+	//declared for the normal calculation:
+	//multiplying a given coordinate by the length Inverse results 
+	float lengthInv = 1.0f / radius;
+
+	float sectorAngle, stackAngle;
+
+	//some helper values
+	float cosStack, sinStack;
+
+	//compute coordinates, normals and texCoords in this order, using the known formulas to compute each point on a sphere
+	for (float i = 0; i <= stacks; ++i)
+	{
+		stackAngle = (PI / 2) - PI * (i / stacks);
+		cosStack = cosf(stackAngle);
+		z = radius * sinf(stackAngle);
+
+		for (float j = 0; j <= sectors; ++j)
+		{
+			sectorAngle = 2 * PI * (j / sectors);
+
+			x = (radius * cosStack) * cosf(sectorAngle);
+			y = (radius * cosStack) * sinf(sectorAngle);
+			buffer.push_back(x);
+			buffer.push_back(y);
+			buffer.push_back(z);
+
+			nx = x * lengthInv;
+			ny = y * lengthInv;
+			nz = z * lengthInv;
+			buffer.push_back(nx);
+			buffer.push_back(ny);
+			buffer.push_back(nz);
+		}
+	}
+
+	int s1, s2;
+	// logic to create the index buffer
+	for (int i = 0; i < stacks; ++i)
+	{
+		// determine our current stack and next stack
+		s1 = i * (sectors + 1);
+		s2 = s1 + sectors + 1;
+
+		/* iterate through the two stacks, adding two triangles each iteration for every stack except the top and bottom one
+		 * since we have to draw counter clockwise in order to make the face appear outside:
+		 * k1 -> k2 -> k1+1 gives us a triangle with the center at the bottom
+		 * s1+1 -> s2 -> s2+1 creates a triangle with the center at the top
+		 */
+		for (int j = 0; j < sectors; ++j, ++s1, ++s2)
+		{
+			//we need 2 vertices from first sector and 1 from next sector
+			if (i != 0)
+			{
+				EBO.push_back(s1);
+				EBO.push_back(s2);
+				EBO.push_back(s1 + 1);
+			}
+
+			//we need 1 vertices from first sector and 2 from next sector
+			if (i != (stacks - 1))
+			{
+				EBO.push_back(s1 + 1);
+				EBO.push_back(s2);
+				EBO.push_back(s2 + 1);
+			}
+		}
+	}
+}
+
+namespace
+{
+	//triangles of the stacks above stack, the first and the last stack only have one triangle per sector
+	size_t trianglesBefore(int stack, int sectors)
+	{
+		return static_cast<size_t>(sectors) * (2 * static_cast<size_t>(stack) - (stack > 0 ? 1 : 0));
+	}
+
+	//vertices of one row, every vertex is its position followed by the position divided by the radius
+	void fillRow(float radius, float z, float ringRadius, const float* cosTable, const float* sinTable, int sectors,
+	             float* out)
+	{
+		const float lengthInv = 1.0f / radius;
+		const float nz = z * lengthInv;
+		int j = 0;
+#ifdef SPHERE_SSE2
+		//four vertices at once, transposed from one register per component into six interleaved stores
+		const __m128 ring = _mm_set1_ps(ringRadius);
+		const __m128 inverse = _mm_set1_ps(lengthInv);
+		const __m128 zs = _mm_set1_ps(z);
+		const __m128 nzs = _mm_set1_ps(nz);
+		for (; j + 4 <= sectors + 1; j += 4, out += 24)
+		{
+			__m128 x = _mm_mul_ps(ring, _mm_loadu_ps(cosTable + j));
+			__m128 y = _mm_mul_ps(ring, _mm_loadu_ps(sinTable + j));
+			__m128 nx = _mm_mul_ps(x, inverse);
+			__m128 ny = _mm_mul_ps(y, inverse);
+
+			__m128 a0 = x, a1 = y, a2 = zs, a3 = nx;
+			_MM_TRANSPOSE4_PS(a0, a1, a2, a3);
+			__m128 normalLow = _mm_unpacklo_ps(ny, nzs);
+			__m128 normalHigh = _mm_unpackhi_ps(ny, nzs);
+
+			_mm_storeu_ps(out, a0);
+			_mm_storeu_ps(out + 4, _mm_movelh_ps(normalLow, a1));
+			_mm_storeu_ps(out + 8, _mm_shuffle_ps(a1, normalLow, _MM_SHUFFLE(3, 2, 3, 2)));
+			_mm_storeu_ps(out + 12, a2);
+			_mm_storeu_ps(out + 16, _mm_movelh_ps(normalHigh, a3));
+			_mm_storeu_ps(out + 20, _mm_shuffle_ps(a3, normalHigh, _MM_SHUFFLE(3, 2, 3, 2)));
+		}
+#endif
+		for (; j <= sectors; ++j, out += 6)
+		{
+			float x = ringRadius * cosTable[j];
+			float y = ringRadius * sinTable[j];
+			out[0] = x;
+			out[1] = y;
+			out[2] = z;
+			out[3] = x * lengthInv;
+			out[4] = y * lengthInv;
+			out[5] = nz;
+		}
+	}
+
+	//the triangles between row stack and the row below it, in the order createSphereCoordinates emits them
+	void fillStack(int stack, int stacks, int sectors, unsigned int* out)
+	{
+		unsigned int s1 = static_cast<unsigned int>(stack * (sectors + 1));
+		unsigned int s2 = s1 + sectors + 1;
+		for (int j = 0; j < sectors; ++j, ++s1, ++s2)
+		{
+			if (stack != 0)
+			{
+				*out++ = s1;
+				*out++ = s2;
+				*out++ = s1 + 1;
+			}
+			if (stack != stacks - 1)
+			{
+				*out++ = s1 + 1;
+				*out++ = s2;
+				*out++ = s2 + 1;
+			}
+		}
+	}
+}
+
+/*	Method builds the same sphere as createSphereCoordinates without growing the vectors
+ *
+ *	radius: the radius of the sphere
+ *	sectors: number of pieces around the z-axis
+ *	stacks: number of pieces from pole to pole
+ *	indices: receives the triangle list
+ *	vertices: receives position and normal of every vertex, 6 floats each
+ *
+ *	Both vectors are sized once, sin and cos of the sector angles are computed once for all rows, and the rows
+ *	are filled by all hardware threads, four vertices at a time with SSE2
+ *	The output is identical to createSphereCoordinates, the angles are rounded the same way
+ */
+void generateSphere(float radius, int sectors, int stacks, std::vector<unsigned int>& indices,
+                    std::vector<float>& vertices)
+{
+	vertices.resize(static_cast<size_t>(stacks + 1) * (sectors + 1) * 6);
+	indices.resize(stacks > 0 ? trianglesBefore(stacks - 1, sectors) * 3 + (stacks > 1 ? 3 * sectors : 0) : 0);
+
+	//padded so the last SSE load of a row stays inside
+	std::vector<float> cosTable(sectors + 4);
+	std::vector<float> sinTable(sectors + 4);
+	for (int j = 0; j <= sectors; ++j)
+	{
+		float sectorAngle = 2 * PI * (static_cast<float>(j) / sectors);
+		cosTable[j] = cosf(sectorAngle);
+		sinTable[j] = sinf(sectorAngle);
+	}
+
+	std::atomic<int> nextRow(0);
+	auto worker = [&]()
+	{
+		for (int first = nextRow.fetch_add(sphereRowsPerTask); first <= stacks;
+		     first = nextRow.fetch_add(sphereRowsPerTask))
+		{
+			int last = std::min(first + sphereRowsPerTask, stacks + 1);
+			for (int i = first; i < last; ++i)
+			{
+				float stackAngle = (PI / 2) - PI * (static_cast<float>(i) / stacks);
+				float ringRadius = radius * cosf(stackAngle);
+				float z = radius * sinf(stackAngle);
+				fillRow(radius, z, ringRadius, cosTable.data(), sinTable.data(), sectors,
+				        vertices.data() + static_cast<size_t>(i) * (sectors + 1) * 6);
+				if (i < stacks)
+					fillStack(i, stacks, sectors, indices.data() + trianglesBefore(i, sectors) * 3);
+			}
+		}
+	};
+
+	std::vector<std::thread> threads;
+	unsigned int threadCount = std::min(std::max(1u, std::thread::hardware_concurrency()),
+	                                    static_cast<unsigned int>(stacks / sphereRowsPerTask + 1));
+	for (unsigned int t = 1; t < threadCount; ++t)
+		threads.emplace_back(worker);
+	worker();
+	for (std::thread& thread : threads)
+		thread.join();
+}
+
+int runSphereBenchmark(int sectors, int stacks)
+{
+	const int runs = 3;
+	double referenceMilliseconds = 0.0;
+	double generatedMilliseconds = 0.0;
+	std::vector<unsigned int> referenceIndices, indices;
+	std::vector<float> referenceVertices, vertices;
+	for (int run = 0; run < runs; ++run)
+	{
+		referenceIndices.clear();
+		referenceVertices.clear();
+		referenceIndices.shrink_to_fit();
+		referenceVertices.shrink_to_fit();
+		auto start = std::chrono::steady_clock::now();
+		createSphereCoordinates(1.0f, static_cast<float>(sectors), static_cast<float>(stacks), referenceIndices,
+		                        referenceVertices);
+		double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		referenceMilliseconds = run == 0 ? milliseconds : std::min(referenceMilliseconds, milliseconds);
+
+		indices = std::vector<unsigned int>();
+		vertices = std::vector<float>();
+		start = std::chrono::steady_clock::now();
+		generateSphere(1.0f, sectors, stacks, indices, vertices);
+		milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		generatedMilliseconds = run == 0 ? milliseconds : std::min(generatedMilliseconds, milliseconds);
+	}
+
+	bool identical = indices == referenceIndices && vertices.size() == referenceVertices.size() &&
+		std::memcmp(vertices.data(), referenceVertices.data(), vertices.size() * sizeof(float)) == 0;
+	std::cout << "Sphere " << sectors << "x" << stacks << ", " << vertices.size() / 6 << " vertices and "
+		<< indices.size() / 3 << " triangles, best of " << runs << " runs" << std::endl;
+	std::cout << "createSphereCoordinates: " << referenceMilliseconds << " ms, generateSphere: " << generatedMilliseconds
+		<< " ms on " << std::max(1u, std::thread::hardware_concurrency()) << " threads, "
+		<< referenceMilliseconds / std::max(generatedMilliseconds, 1e-6) << "x faster, output "
+		<< (identical ? "identical" : "DIFFERENT") << std::endl;
+	return identical ? 0 : -1;
+}
+
+/*	Method builds every level of detail into the buffers of chain
+ *
+ *	radius: the radius of the spheres
+ *	coarsestSectors: sectors of the first level, it has half as many stacks
+ *	levels: number of levels, each with twice the sectors and stacks of the one before
+ *	compact: also pack the levels into the compact format
+ *	chain: receives the levels, their vertices and their indices
+ *
+ *	Indices start at 0 in every level, a draw adds baseVertex, so the compact format keeps 16 bit indices as long as
+ *	each level on its own fits them
+ */
+void buildSphereLodChain(float radius, int coarsestSectors, int levels, bool compact, SphereLodChain& chain)
+{
+	chain = SphereLodChain();
+	bool packed = compact;
+	std::vector<unsigned int> indices;
+	std::vector<float> vertices;
+	CompactMesh level;
+	for (int lod = 0; lod < levels; ++lod)
+	{
+		int sectors = coarsestSectors << lod;
+		int stacks = std::max(sectors / 2, 1);
+		generateSphere(radius, sectors, stacks, indices, vertices);
+
+		std::string name = "sphere " + std::to_string(sectors) + "x" + std::to_string(stacks);
+		size_t vertexCount = optimizeMesh(name.c_str(), vertices.data(), 6 * sizeof(float), vertices.size() / 6,
+		                                  indices.data(), indices.size());
+		vertices.resize(vertexCount * 6);
+
+		SphereLod sphereLod = {sectors, stacks, static_cast<int>(chain.vertices.size() / 6), chain.indices.size(),
+		                       indices.size()};
+		chain.lods.push_back(sphereLod);
+		chain.vertices.insert(chain.vertices.end(), vertices.begin(), vertices.end());
+		chain.indices.insert(chain.indices.end(), indices.begin(), indices.end());
+
+		if (packed && packCompactMesh(vertices, indices, level))
+		{
+			chain.compact.normals.insert(chain.compact.normals.end(), level.normals.begin(), level.normals.end());
+			chain.compact.indices.insert(chain.compact.indices.end(), level.indices.begin(), level.indices.end());
+		}
+		else
+			packed = false;
+	}
+	if (!packed)
+		chain.compact = CompactMesh();
+}
+
+float projectedSphereRadius(const glm::mat4& projection, const glm::mat4& view, const glm::mat4& model, float radius,
+                            float viewportHeight)
+{
+	glm::vec3 center = glm::vec3(view * model * glm::vec4(0.0f, 0.0f, 0.0f, 1.0f));
+	float scale = std::max(glm::length(glm::vec3(model[0])), std::max(glm::length(glm::vec3(model[1])),
+	                                                                  glm::length(glm::vec3(model[2]))));
+	float worldRadius = radius * scale;
+	float distanceSquared = glm::dot(center, center);
+	if (distanceSquared <= worldRadius * worldRadius)
+		return std::numeric_limits<float>::infinity();
+
+	//the cone from the camera touching the sphere, its tangent scaled like the projection scales y
+	float tangent = worldRadius / std::sqrt(distanceSquared - worldRadius * worldRadius);
+	return tangent * projection[1][1] * 0.5f * viewportHeight;
+}
+
+/*	Method picks the level of detail for a sphere covering pixelRadius pixels
+ *
+ *	A segment spanning the angle pi / sectors of a half circle cuts pixelRadius * (1 - cos(pi / sectors)) pixels
+ *	into the silhouette, which is about pixelRadius * pi^2 / (2 * sectors^2)
+ */
+int selectSphereLod(const SphereLodChain& chain, float pixelRadius, float maxPixelError)
+{
+	float neededSectors = static_cast<float>(PI) * std::sqrt(pixelRadius / (2.0f * maxPixelError));
+	for (size_t lod = 0; lod < chain.lods.size(); ++lod)
+	{
+		if (chain.lods[lod].sectors >= neededSectors)
+			return static_cast<int>(lod);
+	}
+	return static_cast<int>(chain.lods.size()) - 1;
+}
+
+/*	Method builds the instances of the material preview grid
+ *
+ *	count: number of spheres, the grid has ceil(sqrt(count)) columns and as many rows as they fill
+ *	radius: radius of the sphere mesh the instances scale
+ *	halfExtent: the grid fills [-halfExtent, halfExtent] in x and y
+ *	minExposure, maxExposure: exposure of the bottom and the top row
+ *	instances: resized to count
+ */
+float buildPreviewGrid(int count, float radius, float halfExtent, float minExposure, float maxExposure,
+                       std::vector<SphereInstance>& instances)
+{
+	instances.resize(std::max(count, 0));
+	if (count <= 0)
+		return 1.0f;
+
+	int columns = static_cast<int>(std::ceil(std::sqrt(static_cast<float>(count))));
+	int rows = (count + columns - 1) / columns;
+	float cell = 2.0f * halfExtent / columns;
+	float scale = 0.4f * cell / radius;
+
+	for (int i = 0; i < count; ++i)
+	{
+		int column = i % columns;
+		int row = i / columns;
+		SphereInstance& instance = instances[i];
+		instance.transform = glm::mat4(scale);
+		instance.transform[3] = glm::vec4(-halfExtent + (column + 0.5f) * cell,
+		                                  -0.5f * rows * cell + (row + 0.5f) * cell, 0.0f, 1.0f);
+		instance.roughness = columns > 1 ? static_cast<float>(column) / (columns - 1) : 0.0f;
+		instance.exposure = rows > 1 ? minExposure + (maxExposure - minExposure) * row / (rows - 1) : 1.0f;
+	}
+	return scale;
+}
@@ -0,0 +1,95 @@
+#ifndef SPHERE_MESH_H
+#define SPHERE_MESH_H
+
+#include <cstddef>
+#include <vector>
+#include <glm/glm.hpp>
+
+//the original generator, stack by stack with push_back, kept as reference for generateSphere
+//sectors and stacks are floats because its loop counters are
+void createSphereCoordinates(float radius, float sectors, float stacks, std::vector<unsigned int>& EBO,
+                             std::vector<float>& buffer);
+
+//builds the same sphere in place: the outputs are sized up front, the sector angles go through sin and cos once
+//and the rows are filled in parallel with SSE2 where the target has it
+//every vertex is its position followed by its normal, 6 floats
+void generateSphere(float radius, int sectors, int stacks, std::vector<unsigned int>& indices,
+                    std::vector<float>& vertices);
+
+//times both generators on a sphere of the given segments and checks their outputs match, returns the exit code
+int runSphereBenchmark(int sectors, int stacks);
+
+//sphere vertices as one octahedral encoded normal each, two snorm16 components
+//vert.vs compiled with COMPACT_MESH decodes the normal and scales it by SPHERE_RADIUS for the position
+struct CompactMesh
+{
+	std::vector<short> normals;
+	std::vector<unsigned short> indices;
+
+	size_t vertexBytes() const
+	{
+		return normals.size() * sizeof(short);
+	}
+
+	size_t indexBytes() const
+	{
+		return indices.size() * sizeof(unsigned short);
+	}
+};
+
+//maps a unit vector onto the octahedron and unfolds it into the square [-1, 1]^2, rounded to snorm16
+void encodeOctahedral(float x, float y, float z, short* encoded);
+
+//packs a mesh of position and normal floats, 6 per vertex, whose positions are its normals times the radius
+//returns false if the mesh has more vertices than 16 bit indices reach
+bool packCompactMesh(const std::vector<float>& vertices, const std::vector<unsigned int>& indices, CompactMesh& mesh);
+
+//one level of detail in the shared buffers of a SphereLodChain
+struct SphereLod
+{
+	int sectors;
+	int stacks;
+	//offset of its first vertex, its indices count from there
+	int baseVertex;
+	size_t firstIndex;
+	size_t indexCount;
+};
+
+//spheres of rising detail in one vertex and one index buffer, in the float and, if asked for, the compact format
+struct SphereLodChain
+{
+	std::vector<SphereLod> lods;
+	std::vector<float> vertices;
+	std::vector<unsigned int> indices;
+	//empty if the compact format was not asked for or a level has too many vertices for it
+	CompactMesh compact;
+};
+
+//builds levels spheres from coarsestSectors x coarsestSectors / 2 on, every level twice as fine as the one before
+//each level is optimized for the vertex cache on its own
+void buildSphereLodChain(float radius, int coarsestSectors, int levels, bool compact, SphereLodChain& chain);
+
+//radius in pixels of a sphere around the model space origin, infinite if the camera is inside it
+float projectedSphereRadius(const glm::mat4& projection, const glm::mat4& view, const glm::mat4& model, float radius,
+                            float viewportHeight);
+
+//coarsest level whose silhouette stays within maxPixelError of the true sphere at pixelRadius, else the finest
+int selectSphereLod(const SphereLodChain& chain, float pixelRadius, float maxPixelError);
+
+//one sphere of the material preview grid as vert.vs compiled with INSTANCED reads it, advanced once per instance
+struct SphereInstance
+{
+	//placed in front of the model matrix, so every sphere still turns around its own center
+	glm::mat4 transform;
+	float roughness;
+	//multiplies the exposure of the frame
+	float exposure;
+};
+
+//lays count spheres out row by row in a square of side 2 * halfExtent around the origin of the xy plane
+//roughness rises from 0 to 1 along a row and exposure from minExposure to maxExposure from the bottom row to the top
+//returns the scale of the spheres, which leaves a gap of a fifth of a cell between neighbours
+float buildPreviewGrid(int count, float radius, float halfExtent, float minExposure, float maxExposure,
+                       std::vector<SphereInstance>& instances);
+
+#endif
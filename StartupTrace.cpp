@@ -0,0 +1,81 @@
+#include "pch.h"
+#include "StartupTrace.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace
+{
+	struct Span
+	{
+		const char* lane;
+		const char* name;
+		double start;
+		double end;
+	};
+
+	std::chrono::steady_clock::time_point origin = std::chrono::steady_clock::now();
+	std::mutex spansMutex;
+	std::vector<Span> spans;
+
+	//columns of the bar that covers the whole startup
+	const int barWidth = 48;
+}
+
+void beginStartupTrace()
+{
+	origin = std::chrono::steady_clock::now();
+	std::lock_guard<std::mutex> lock(spansMutex);
+	spans.clear();
+}
+
+double traceNow()
+{
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - origin).count();
+}
+
+void traceSpan(const char* lane, const char* name, double start, double end)
+{
+	std::lock_guard<std::mutex> lock(spansMutex);
+	spans.push_back({lane, name, start, end});
+}
+
+void printStartupTrace()
+{
+	std::vector<Span> sorted;
+	{
+		std::lock_guard<std::mutex> lock(spansMutex);
+		sorted = spans;
+	}
+	if (sorted.empty())
+		return;
+
+	std::sort(sorted.begin(), sorted.end(), [](const Span& a, const Span& b) { return a.start < b.start; });
+	double total = 0.0;
+	for (const Span& span : sorted)
+		total = std::max(total, span.end);
+	total = std::max(total, 1e-3);
+
+	std::printf("Startup trace, %.1f ms:\n", total);
+	for (const Span& span : sorted)
+	{
+		int first = std::min(static_cast<int>(span.start / total * barWidth), barWidth - 1);
+		int last = std::max(first + 1, std::min(static_cast<int>(span.end / total * barWidth + 0.5), barWidth));
+		std::string bar(barWidth, ' ');
+		bar.replace(first, last - first, last - first, '#');
+		std::printf("  %-7s %-24s %8.1f - %8.1f ms |%s|\n", span.lane, span.name, span.start, span.end, bar.c_str());
+	}
+}
+
+TraceScope::TraceScope(const char* lane, const char* name)
+	: lane(lane), name(name), start(traceNow())
+{
+}
+
+TraceScope::~TraceScope()
+{
+	traceSpan(lane, name, start, traceNow());
+}
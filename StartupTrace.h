@@ -0,0 +1,29 @@
+#ifndef STARTUP_TRACE_H
+#define STARTUP_TRACE_H
+
+//spans of the startup on every thread, printed as one timeline so overlapping work lines up
+
+//sets the origin of the trace, the spans are measured in milliseconds from here
+void beginStartupTrace();
+double traceNow();
+
+//records that name ran on lane from start to end, safe to call from any thread
+void traceSpan(const char* lane, const char* name, double start, double end);
+
+//prints every span sorted by start with a bar over the whole startup
+void printStartupTrace();
+
+//records the span of its own lifetime
+class TraceScope
+{
+public:
+	TraceScope(const char* lane, const char* name);
+	~TraceScope();
+
+private:
+	const char* lane;
+	const char* name;
+	double start;
+};
+
+#endif
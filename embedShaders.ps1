@@ -0,0 +1,70 @@
+# writes every shader of the project into a header as constexpr strings, run as pre-build event of the project
+# the header is only rewritten if a shader changed, so an unchanged tree does not recompile Shader.h users
+param(
+	[string]$Output = "EmbeddedShaders.h"
+)
+
+$shaders = @(
+	"cubeMapVert.vs",
+	"cubeMapFrag.frag",
+	"cubeMapCompute.comp",
+	"prefilter.glsl",
+	"vert.vs",
+	"impostor.vs",
+	"envFrag.fs",
+	"frameData.glsl"
+)
+
+# MSVC limits a single string literal to 16380 bytes, so every shader is split into pieces the compiler concatenates
+$pieceLength = 8192
+$delimiter = ")glsl"
+
+$lines = New-Object System.Collections.Generic.List[string]
+$lines.Add("//generated by embedShaders.ps1 from the shader files of the project, do not edit")
+$lines.Add("#ifndef EMBEDDED_SHADERS_H")
+$lines.Add("#define EMBEDDED_SHADERS_H")
+$lines.Add("")
+$lines.Add("#include <cstddef>")
+$lines.Add("")
+$lines.Add("struct EmbeddedShader")
+$lines.Add("{")
+$lines.Add("`tconst char* name;")
+$lines.Add("`tconst char* source;")
+$lines.Add("};")
+$lines.Add("")
+$lines.Add("constexpr EmbeddedShader embeddedShaders[] = {")
+foreach ($shader in $shaders)
+{
+	$source = [System.IO.File]::ReadAllText((Join-Path $PSScriptRoot $shader)) -replace "`r`n", "`n"
+	if ($source.Contains($delimiter + '"'))
+	{
+		Write-Error "$shader contains the raw string delimiter $delimiter"
+		exit 1
+	}
+
+	$lines.Add("`t{`"$shader`",")
+	for ($offset = 0; $offset -lt $source.Length; $offset += $pieceLength)
+	{
+		$piece = $source.Substring($offset, [Math]::Min($pieceLength, $source.Length - $offset))
+		$lines.Add("`t R`"glsl($piece)glsl`"")
+	}
+	if ($source.Length -eq 0)
+	{
+		$lines.Add("`t `"`"")
+	}
+	$lines.Add("`t},")
+}
+$lines.Add("};")
+$lines.Add("")
+$lines.Add("constexpr size_t embeddedShaderCount = sizeof(embeddedShaders) / sizeof(embeddedShaders[0]);")
+$lines.Add("")
+$lines.Add("#endif")
+
+$header = ($lines -join "`n") + "`n"
+$outputPath = if ([System.IO.Path]::IsPathRooted($Output)) { $Output } else { Join-Path $PSScriptRoot $Output }
+if ((Test-Path $outputPath) -and ([System.IO.File]::ReadAllText($outputPath) -eq $header))
+{
+	exit 0
+}
+[System.IO.File]::WriteAllText($outputPath, $header)
+Write-Host "Embedded $($shaders.Count) shaders in $Output"
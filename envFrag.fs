@@ -1,17 +1,86 @@
 #version 400 core
+#define MAX_LIGHTS 4
+#define PI 3.14159265358979323846
+
 out vec4 FragColor;
 
+#ifdef IMPOSTOR
+//quad around the sphere from impostor.vs, the sphere itself is traced per pixel
+in vec3 viewPosition;
+flat in vec3 sphereCenter;
+flat in float sphereRadius;
+flat in mat3 viewToModel;
+#else
 in vec3 cubeMapCoords;
+#endif
+
+#ifdef INSTANCED
+//roughness and exposure factor of this sphere of the preview grid
+flat in vec2 instanceMaterial;
+#endif
+
+#include "frameData.glsl"
 
 uniform samplerCube cubeMap;
-uniform float roughness;
-uniform int mipLevels;
-uniform float exposure;
+
+//dominant lights that were cut out of the environment before baking, added back analytically
+uniform int numLights;
+uniform vec3 lightDirection[MAX_LIGHTS];
+uniform vec3 lightColor[MAX_LIGHTS];
+uniform float lightSolidAngle[MAX_LIGHTS];
+
+//evaluates the same normalized lobe the bake convolves with for a light of finite size
+vec3 dominantLights(vec3 normal, float mipLevel)
+{
+	//the bake weights samples drawn from cos^specular by cos^specular again, so the kernel is cos^(2*specular)
+	float lobeExponent = 2.0 * pow(2.0, 15.0 * (1.0 - mipLevel / float(mipLevels)));
+	vec3 result = vec3(0.0);
+
+	for(int i = 0; i < numLights; ++i)
+	{
+		//treat the light as a lobe of equal solid angle and widen the kernel by it
+		float lightExponent = max(2.0 * PI / lightSolidAngle[i] - 1.0, 0.0);
+		float exponent = 1.0 / (1.0 / lobeExponent + 1.0 / max(lightExponent, 1e-4));
+
+		float NoL = max(dot(normal, lightDirection[i]), 0.0);
+		result += lightColor[i] * (exponent + 1.0) / (2.0 * PI) * pow(NoL, exponent);
+	}
+	return result;
+}
 
 void main()
 {	
+#ifdef IMPOSTOR
+	//the eye is the origin of view space, find where its ray through this pixel enters the sphere
+	vec3 direction = normalize(viewPosition);
+	float along = dot(direction, sphereCenter);
+	float discriminant = along * along - dot(sphereCenter, sphereCenter) + sphereRadius * sphereRadius;
+	if (discriminant < 0.0)
+		discard;
+	float root = sqrt(discriminant);
+	//from inside the sphere only the far intersection lies in front of the eye
+	float hitDistance = along - root > 0.0 ? along - root : along + root;
+	if (hitDistance <= 0.0)
+		discard;
+
+	vec3 hit = direction * hitDistance;
+	vec3 cubeMapCoords = viewToModel * ((hit - sphereCenter) / sphereRadius);
+	vec4 clipPosition = projMatrix * vec4(hit, 1.0);
+	gl_FragDepth = (gl_DepthRange.diff * clipPosition.z / clipPosition.w + gl_DepthRange.near + gl_DepthRange.far) * 0.5;
+#endif
+
+#ifdef INSTANCED
+	float sphereRoughness = instanceMaterial.x;
+	float sphereExposure = instanceMaterial.y * exposure;
+#else
+	float sphereRoughness = roughness;
+	float sphereExposure = exposure;
+#endif
+
 	//offset to switch between mipmaps as each of them is filtered to be rougher than the previous one
-	float offset = roughness * float(mipLevels);
+	float offset = sphereRoughness * float(mipLevels);
 
-	FragColor = textureLod(cubeMap, cubeMapCoords, offset) * exposure;
-} 
\ No newline at end of file
+	vec3 light = dominantLights(normalize(cubeMapCoords), offset);
+	//the lod counts from the base level, so levels that have not arrived yet are replaced by the finest one that has
+	FragColor = (textureLod(cubeMap, cubeMapCoords, max(offset - float(baseLevel), 0.0)) + vec4(light, 0.0)) * sphereExposure;
+} 
@@ -0,0 +1,12 @@
+//per frame values of the display shaders, written into a ring of uniform buffer regions, see FrameUniforms.h
+layout(std140) uniform FrameData
+{
+	mat4 transMat;
+	mat4 projMatrix;
+	mat4 viewMatrix;
+	float roughness;
+	float exposure;
+	int mipLevels;
+	//finest level that has arrived yet, sampling starts there while the cubemap streams in
+	int baseLevel;
+};
@@ -0,0 +1,42 @@
+#version 400 core
+//draws the sphere of radius SPHERE_RADIUS around the model origin as one quad facing the camera, no vertex buffer
+//is read, envFrag.fs compiled with IMPOSTOR intersects the ray of every pixel with the sphere
+
+out vec3 viewPosition;
+flat out vec3 sphereCenter;
+flat out float sphereRadius;
+//turns view space directions back into the model space the cubemap is looked up in
+flat out mat3 viewToModel;
+
+#include "frameData.glsl"
+
+void main()
+{
+	mat4 modelView = viewMatrix * transMat;
+	sphereCenter = (modelView * vec4(0.0, 0.0, 0.0, 1.0)).xyz;
+	sphereRadius = SPHERE_RADIUS * length(modelView[0].xyz);
+	viewToModel = inverse(mat3(modelView));
+
+	//triangle strip over the corners (-1, -1), (1, -1), (-1, 1), (1, 1)
+	vec2 corner = vec2(gl_VertexID & 1, gl_VertexID >> 1) * 2.0 - 1.0;
+
+	//from inside the sphere it covers the whole screen, the rays start on the near plane
+	float distance = length(sphereCenter);
+	if (distance <= sphereRadius * 1.001)
+	{
+		vec4 nearPoint = inverse(projMatrix) * vec4(corner, -1.0, 1.0);
+		viewPosition = nearPoint.xyz / nearPoint.w;
+		gl_Position = vec4(corner, -1.0, 1.0);
+		return;
+	}
+
+	//a square through the center facing the camera, just large enough to contain the cone of rays touching the sphere
+	vec3 forward = sphereCenter / distance;
+	vec3 up = abs(forward.y) < 0.999 ? vec3(0.0, 1.0, 0.0) : vec3(1.0, 0.0, 0.0);
+	vec3 right = normalize(cross(forward, up));
+	up = cross(right, forward);
+	float halfSize = sphereRadius * distance / sqrt(distance * distance - sphereRadius * sphereRadius);
+
+	viewPosition = sphereCenter + (corner.x * right + corner.y * up) * halfSize;
+	gl_Position = projMatrix * vec4(viewPosition, 1.0);
+}
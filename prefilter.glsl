@@ -0,0 +1,175 @@
+//shared prefilter of cubeMapFrag.frag and cubeMapCompute.comp, included by the Shader class after the #version line
+//the including stage sets rotation before calling filterMap
+
+#define PI 3.14159265358979323846
+
+uniform sampler2D envMap;
+
+//the baker compiles a variant per level with the sample cap and specular exponent as constants,
+//so the loop bound and the exponent are known to the compiler, the generic program reads them as uniforms
+#ifdef NUM_OF_POINTS
+const uint numOfPoints = NUM_OF_POINTS;
+#else
+uniform uint numOfPoints;
+#endif
+#ifdef SPECULAR
+const float specular = SPECULAR;
+#else
+uniform float specular;
+#endif
+//relative standard error at which a texel stops sampling, 0 always takes numOfPoints samples
+uniform float errorThreshold;
+//0 computes Hammersley points in place, otherwise the points are read from samplePoints (see SampleSets.h)
+uniform int sampleSet;
+uniform sampler2D samplePoints;
+//offset the points of every texel by its own Cranley-Patterson rotation
+uniform bool rotateSamples;
+
+//rotation of the current texel, set once in main
+vec2 rotation;
+
+//samples taken before the error estimate is trusted and how often it is checked afterwards
+#define MIN_ADAPTIVE_SAMPLES 32u
+#define ADAPTIVE_CHECK_INTERVAL 16u
+
+/*Prefilter takes in an environment Map in longitute latitude form and filters it based on the texel direction
+* Process is based on the concept of Importance Sampling with Hammersley, Sobol or blue noise points being used to compute the light at the points around the fragment
+* Each miplevel is filtered to appear rougher based on the specular exponent and decreasing resolution
+*/
+
+
+//second dimension of the Sobol sequence, paired with the radical inverse every power of two prefix is stratified
+float sobolSecondDimension(uint i)
+{
+	uint result = 0u;
+	for(uint v = 1u << 31; i != 0u; i >>= 1, v ^= v >> 1)
+	{
+		if((i & 1u) != 0u)
+			result ^= v;
+	}
+	return float(result) / float(pow(2, 32));
+}
+
+//interleaved gradient noise, neighbouring texels get offsets far apart so the error turns into fine grained noise
+vec2 texelRotation(vec2 fragCoord)
+{
+	vec2 magic = vec2(0.06711056, 0.00583715);
+	return vec2(fract(52.9829189 * fract(dot(fragCoord, magic))),
+	            fract(52.9829189 * fract(dot(fragCoord + vec2(47.0, 17.0), magic))));
+}
+
+//compute the sample points in spherical coordinates
+vec2 computeSamplePoint(uint i) 
+{
+	vec2 H;
+	if(sampleSet == 0)
+	{
+		//temporary Hammersley point 
+		//i / numOfPoints only covers the whole circle once all points are taken, so adaptive sampling needs a progressive sequence
+		H = vec2(float(i) / float(numOfPoints), bitfieldReverse(i) / float(pow(2, 32)));
+		if(errorThreshold > 0.0)
+			H.x = sobolSecondDimension(i);
+	}
+	else
+		H = texelFetch(samplePoints, ivec2(i, 0), 0).xy;
+
+	if(rotateSamples)
+		H = fract(H + rotation);
+	
+	//the final vector in spherical coordinates
+	//specular exponent is considered due to the importance sampling
+	//divided into two steps to make it more readable
+	vec2 sphereC;
+	sphereC.x = acos(pow(H.y, 1.0/(specular + 1)));
+	sphereC.y = 2 * PI * H.x;
+	
+	return sphereC;
+}
+
+//Transform a vector into the carthesian coordinate system
+vec3 computeKarthesian(vec2 hVector) {
+	
+	vec3 karthesianVec;
+	float sineTheta = sin(hVector.x);
+
+	karthesianVec.x = sineTheta * cos(hVector.y);
+	karthesianVec.y = sineTheta * sin(hVector.y);
+	karthesianVec.z = cos(hVector.x);
+
+	return karthesianVec;
+}
+
+//Main function to generate a sample vector from the selected point set
+vec3 randomSample(uint i, vec3 normal) {
+
+	vec3 randPoints;
+	vec3 sampleVec;
+	vec3 norm = normalize(normal);
+	//any vector that is not parallel to the normal spans the tangent frame
+	vec3 up        = abs(norm.z) < 0.999 ? vec3(0, 0, 1) : vec3(1, 0, 0);
+	vec3 tangent   = normalize(cross(up, norm));
+	vec3 bitangent = cross(norm, tangent);
+
+	randPoints.xy = computeSamplePoint(i);
+	randPoints = computeKarthesian(randPoints.xy);
+	sampleVec = (randPoints.x * tangent) + (randPoints.y * bitangent) + (randPoints.z * norm);
+	
+	return sampleVec;
+}
+
+vec3 sampleEnvMap(vec3 vector) {
+	//Let's transform the points into vectors 
+	//Done through transforming them to spehrical coordinates
+	vec3 norm = normalize(vector);
+
+	//transformation of the cube Map Coordinates into spherical coordinates to sample the environemnt Map
+	vec2 uv;
+	uv.x = (atan(norm.x, norm.z)) / (2 * PI) + 0.5;
+	uv.y = (norm.y) * 0.5 + 0.5;
+	return texture(envMap, uv).rgb;
+}
+
+//Main function to sample the environment map through Importance Sampling and filter it accordint to miplevel
+//the running mean and variance of the weighted luminance decide when a texel has converged
+//samplesFraction receives the share of numOfPoints the texel needed
+vec3 filterMap(vec3 normal, out float samplesFraction) {
+	//the interpolated face coordinates are not unit length, which would push NoL above 1
+	normal = normalize(normal);
+	float sum = 0.0;
+	float sumSquared = 0.0;
+	float mean = 0.0;
+	float m2 = 0.0;
+	vec3 result = vec3(0.0);
+	uint i = 0u;
+
+	while(i < numOfPoints) 
+	{
+		vec3 L = randomSample(i, normal);
+		float NoL = max(dot(normal, L), 0);
+
+		float pNoL = pow(NoL, specular);
+		vec3 envSample = sampleEnvMap(L);
+		
+		result += envSample * pNoL;
+		sum += pNoL;
+		++i;
+
+		//weighted incremental variance (West 1979)
+		float lum = dot(envSample, vec3(0.2126, 0.7152, 0.0722));
+		float delta = lum - mean;
+		sumSquared += pNoL * pNoL;
+		mean += sum > 0.0 ? (pNoL / sum) * delta : 0.0;
+		m2 += pNoL * delta * (lum - mean);
+
+		if(errorThreshold > 0.0 && i >= MIN_ADAPTIVE_SAMPLES && (i % ADAPTIVE_CHECK_INTERVAL) == 0u && sum > 0.0)
+		{
+			//variance of the weighted mean relative to the mean itself
+			float meanVariance = (m2 / sum) * sumSquared / (sum * sum);
+			if(sqrt(meanVariance) <= errorThreshold * max(mean, 1e-4))
+				break;
+		}
+	}
+
+	samplesFraction = float(i) / float(numOfPoints);
+	return result/sum;
+}
@@ -1,5 +1,33 @@
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
 
+//lets stb_image_write encode independent scanlines and PNG bands on all hardware threads
+static void stbiwParallelFor(int count, void (*func)(void*, int), void* context)
+{
+	std::atomic<int> next(0);
+	auto worker = [&]()
+	{
+		for (int i = next++; i < count; i = next++)
+			func(context, i);
+	};
+
+	std::vector<std::thread> threads;
+	unsigned int threadCount = std::min(std::max(1u, std::thread::hardware_concurrency()),
+	                                    static_cast<unsigned int>(std::max(count, 1)));
+	for (unsigned int t = 1; t < threadCount; ++t)
+		threads.emplace_back(worker);
+	worker();
+	for (std::thread& thread : threads)
+		thread.join();
+}
+
+#define STBIW_PARALLEL_FOR(count, func, context) stbiwParallelFor(count, func, context)
+//PNGs are deflated in bands of 64 rows, the heatmaps are 6 faces tall so even small bakes get several bands
+#define STBIW_PNG_BAND_ROWS 64
 #define STB_IMAGE_WRITE_IMPLEMENTATION
-#include "stb_image_write.h"
\ No newline at end of file
+#include "stb_image_write.h"
@@ -26,6 +26,11 @@ BUILDING:
    You can #define STBIW_MALLOC(), STBIW_REALLOC(), and STBIW_FREE() to replace
    malloc,realloc,free.
    You can #define STBIW_MEMMOVE() to replace memmove()
+   You can #define STBIW_PARALLEL_FOR(count, func, context) to run independent work
+   items on several threads. It has to call func(context, i) once for every i in
+   [0, count) and return after all calls finished; the default is a plain loop.
+   The HDR writer encodes its scanlines through it.
+   You can #define STBIW_NO_SIMD to disable the SSE2 RGBE conversion.
    You can #define STBIW_ZLIB_COMPRESS to use a custom zlib-style compress function
    for PNG compression (instead of the builtin one), it must have the following signature:
    unsigned char * my_compress(unsigned char *data, int data_len, int *out_len, int quality);
@@ -64,10 +69,23 @@ USAGE:
    where the callback is:
       void stbi_write_func(void *context, void *data, int size);
 
+   HDR images can also be streamed a few rows at a time, so the whole image never
+   has to be in memory:
+
+     stbi_write_hdr_stream *stbi_write_hdr_begin(char const *filename, int w, int h, int comp);
+     stbi_write_hdr_stream *stbi_write_hdr_begin_to_func(stbi_write_func *func, void *context, int w, int h, int comp);
+     int stbi_write_hdr_rows(stbi_write_hdr_stream *stream, const float *rows, int num_rows);
+     int stbi_write_hdr_end(stbi_write_hdr_stream *stream);
+
+   Rows are written in the order they are passed, stbi_flip_vertically_on_write is
+   ignored. stbi_write_hdr_end frees the stream and returns 0 if fewer than h rows
+   were written.
+
    You can configure it with these global variables:
       int stbi_write_tga_with_rle;             // defaults to true; set to 0 to disable RLE
       int stbi_write_png_compression_level;    // defaults to 8; set to higher for more compression
       int stbi_write_force_png_filter;         // defaults to -1; set to 0..5 to force a filter mode
+      int stbi_write_png_band_rows;            // defaults to STBIW_PNG_BAND_ROWS or 0; rows per deflate band
 
 
    You can define STBI_WRITE_NO_STDIO to disable the file variant of these
@@ -99,6 +117,14 @@ USAGE:
    PNG allows you to set the deflate compression level by setting the global
    variable 'stbi_write_png_compression_level' (it defaults to 8).
 
+   PNG can deflate the image in bands of 'stbi_write_png_band_rows' rows that are
+   compressed independently through STBIW_PARALLEL_FOR and joined into a single
+   zlib stream, any PNG reader decodes it to the same pixels. Matches do not reach
+   across bands, which costs a little compression. The default of 0 deflates the
+   whole image as one band, define STBIW_PNG_BAND_ROWS to change the default.
+   The row filters are always chosen through STBIW_PARALLEL_FOR, the chosen
+   filters do not depend on it.
+
    HDR expects linear float data. Since the format is always 32-bit rgb(e)
    data, alpha (if provided) is discarded, and for monochrome data it is
    replicated across all three channels.
@@ -169,6 +195,7 @@ LICENSE
 extern int stbi_write_tga_with_rle;
 extern int stbi_write_png_compression_level;
 extern int stbi_write_force_png_filter;
+extern int stbi_write_png_band_rows;
 #endif
 
 #ifndef STBI_WRITE_NO_STDIO
@@ -191,6 +218,14 @@ STBIWDEF int stbi_write_tga_to_func(stbi_write_func *func, void *context, int w,
 STBIWDEF int stbi_write_hdr_to_func(stbi_write_func *func, void *context, int w, int h, int comp, const float *data);
 STBIWDEF int stbi_write_jpg_to_func(stbi_write_func *func, void *context, int x, int y, int comp, const void  *data, int quality);
 
+typedef struct stbi_write_hdr_stream stbi_write_hdr_stream;
+#ifndef STBI_WRITE_NO_STDIO
+STBIWDEF stbi_write_hdr_stream *stbi_write_hdr_begin(char const *filename, int w, int h, int comp);
+#endif
+STBIWDEF stbi_write_hdr_stream *stbi_write_hdr_begin_to_func(stbi_write_func *func, void *context, int w, int h, int comp);
+STBIWDEF int stbi_write_hdr_rows(stbi_write_hdr_stream *stream, const float *rows, int num_rows);
+STBIWDEF int stbi_write_hdr_end(stbi_write_hdr_stream *stream);
+
 STBIWDEF void stbi_flip_vertically_on_write(int flip_boolean);
 
 #endif//INCLUDE_STB_IMAGE_WRITE_H
@@ -211,10 +246,16 @@ STBIWDEF void stbi_flip_vertically_on_write(int flip_boolean);
 #endif // STBI_WRITE_NO_STDIO
 
 #include <stdarg.h>
+#include <stddef.h>
 #include <stdlib.h>
 #include <string.h>
 #include <math.h>
 
+#if !defined(STBIW_NO_SIMD) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define STBIW_SSE2
+#include <emmintrin.h>
+#endif
+
 #if defined(STBIW_MALLOC) && defined(STBIW_FREE) && (defined(STBIW_REALLOC) || defined(STBIW_REALLOC_SIZED))
 // ok
 #elif !defined(STBIW_MALLOC) && !defined(STBIW_FREE) && !defined(STBIW_REALLOC) && !defined(STBIW_REALLOC_SIZED)
@@ -244,16 +285,27 @@ STBIWDEF void stbi_flip_vertically_on_write(int flip_boolean);
 #define STBIW_ASSERT(x) assert(x)
 #endif
 
+#ifndef STBIW_PARALLEL_FOR
+#define STBIW_PARALLEL_FOR(count, func, context) \
+   do { int stbiw__i; for (stbiw__i = 0; stbiw__i < (count); ++stbiw__i) func(context, stbiw__i); } while (0)
+#endif
+
+#ifndef STBIW_PNG_BAND_ROWS
+#define STBIW_PNG_BAND_ROWS 0
+#endif
+
 #define STBIW_UCHAR(x) (unsigned char) ((x) & 0xff)
 
 #ifdef STB_IMAGE_WRITE_STATIC
 static int stbi_write_png_compression_level = 8;
 static int stbi_write_tga_with_rle = 1;
 static int stbi_write_force_png_filter = -1;
+static int stbi_write_png_band_rows = STBIW_PNG_BAND_ROWS;
 #else
 int stbi_write_png_compression_level = 8;
 int stbi_write_tga_with_rle = 1;
 int stbi_write_force_png_filter = -1;
+int stbi_write_png_band_rows = STBIW_PNG_BAND_ROWS;
 #endif
 
 static int stbi__flip_vertically_on_write = 0;
@@ -598,6 +650,26 @@ STBIWDEF int stbi_write_tga(char const *filename, int x, int y, int comp, const
 
 #define stbiw__max(a, b)  ((a) > (b) ? (a) : (b))
 
+// rows encoded together before they are written out; each one gets its own buffer so
+// STBIW_PARALLEL_FOR can encode them at the same time
+#define STBIW__HDR_BATCH 32
+
+// worst case of one RLE scanline: header, and per component every 128 literal bytes
+// cost one count byte, runs never cost more than the bytes they replace
+#define stbiw__hdr_row_bound(w)  (4 + 4*((w) + (w)/128 + 2))
+
+static float stbiw__rgbe_scale(float maxcomp, int *exponent)
+{
+   // same result as frexp: maxcomp is in [2^(e-1), 2^e), the scale is 256 / 2^e, built from the exponent bits
+   stbiw_uint32 bits, scale_bits;
+   float scale;
+   memcpy(&bits, &maxcomp, 4);
+   *exponent = (int) ((bits >> 23) & 0xff) - 126;
+   scale_bits = (stbiw_uint32) (127 + 8 - *exponent) << 23;
+   memcpy(&scale, &scale_bits, 4);
+   return scale;
+}
+
 static void stbiw__linear_to_rgbe(unsigned char *rgbe, float *linear)
 {
    int exponent;
@@ -606,79 +678,122 @@ static void stbiw__linear_to_rgbe(unsigned char *rgbe, float *linear)
    if (maxcomp < 1e-32f) {
       rgbe[0] = rgbe[1] = rgbe[2] = rgbe[3] = 0;
    } else {
-      float normalize = (float) frexp(maxcomp, &exponent) * 256.0f/maxcomp;
+      float normalize = stbiw__rgbe_scale(maxcomp, &exponent);
 
-      rgbe[0] = (unsigned char)(linear[0] * normalize);
-      rgbe[1] = (unsigned char)(linear[1] * normalize);
-      rgbe[2] = (unsigned char)(linear[2] * normalize);
+      rgbe[0] = (unsigned char)(stbiw__max(linear[0], 0.0f) * normalize);
+      rgbe[1] = (unsigned char)(stbiw__max(linear[1], 0.0f) * normalize);
+      rgbe[2] = (unsigned char)(stbiw__max(linear[2], 0.0f) * normalize);
       rgbe[3] = (unsigned char)(exponent + 128);
    }
 }
 
-static void stbiw__write_run_data(stbi__write_context *s, int length, unsigned char databyte)
+// converts a scanline into four planes of width bytes, R, G, B and E
+static void stbiw__encode_rgbe_planes(unsigned char *planes, int width, int ncomp, const float *scanline)
+{
+   unsigned char rgbe[4];
+   float linear[3];
+   int x = 0;
+
+#ifdef STBIW_SSE2
+   // 4 pixels at once, bit identical to stbiw__linear_to_rgbe
+   {
+      const __m128 tiny = _mm_set1_ps(1e-32f);
+      const __m128i exponent_mask = _mm_set1_epi32(0xff);
+      const __m128i scale_bias = _mm_set1_epi32(127 + 8 + 126);
+      const __m128i exponent_bias = _mm_set1_epi32(128 - 126);
+      for (; x + 4 <= width; x += 4) {
+         __m128 r, g, b, maxcomp, scale, valid;
+         __m128i biased, out;
+         const float *p = scanline + x*ncomp;
+         if (ncomp >= 3) {
+            r = _mm_setr_ps(p[0], p[ncomp], p[2*ncomp], p[3*ncomp]);
+            g = _mm_setr_ps(p[1], p[ncomp+1], p[2*ncomp+1], p[3*ncomp+1]);
+            b = _mm_setr_ps(p[2], p[ncomp+2], p[2*ncomp+2], p[3*ncomp+2]);
+         } else {
+            r = g = b = _mm_setr_ps(p[0], p[ncomp], p[2*ncomp], p[3*ncomp]);
+         }
+         maxcomp = _mm_max_ps(r, _mm_max_ps(g, b));
+         valid = _mm_cmpge_ps(maxcomp, tiny);
+
+         biased = _mm_and_si128(_mm_srli_epi32(_mm_castps_si128(maxcomp), 23), exponent_mask);
+         scale = _mm_castsi128_ps(_mm_slli_epi32(_mm_sub_epi32(scale_bias, biased), 23));
+         scale = _mm_and_ps(scale, valid);
+
+         // negative channels saturate to 0 in the pack
+         out = _mm_packs_epi32(_mm_cvttps_epi32(_mm_mul_ps(r, scale)), _mm_cvttps_epi32(_mm_mul_ps(g, scale)));
+         out = _mm_packus_epi16(out, _mm_packs_epi32(_mm_cvttps_epi32(_mm_mul_ps(b, scale)),
+               _mm_and_si128(_mm_add_epi32(biased, exponent_bias), _mm_castps_si128(valid))));
+         {
+            // bytes are R0..R3 G0..G3 B0..B3 E0..E3
+            unsigned char bytes[16];
+            _mm_storeu_si128((__m128i *) bytes, out);
+            memcpy(&planes[x + width*0], bytes + 0, 4);
+            memcpy(&planes[x + width*1], bytes + 4, 4);
+            memcpy(&planes[x + width*2], bytes + 8, 4);
+            memcpy(&planes[x + width*3], bytes + 12, 4);
+         }
+      }
+   }
+#endif
+
+   for (; x < width; x++) {
+      switch (ncomp) {
+         case 4: /* fallthrough */
+         case 3: linear[2] = scanline[x*ncomp + 2];
+                 linear[1] = scanline[x*ncomp + 1];
+                 linear[0] = scanline[x*ncomp + 0];
+                 break;
+         default:
+                 linear[0] = linear[1] = linear[2] = scanline[x*ncomp + 0];
+                 break;
+      }
+      stbiw__linear_to_rgbe(rgbe, linear);
+      planes[x + width*0] = rgbe[0];
+      planes[x + width*1] = rgbe[1];
+      planes[x + width*2] = rgbe[2];
+      planes[x + width*3] = rgbe[3];
+   }
+}
+
+static unsigned char *stbiw__write_run_data(unsigned char *out, int length, unsigned char databyte)
 {
-   unsigned char lengthbyte = STBIW_UCHAR(length+128);
    STBIW_ASSERT(length+128 <= 255);
-   s->func(s->context, &lengthbyte, 1);
-   s->func(s->context, &databyte, 1);
+   *out++ = STBIW_UCHAR(length+128);
+   *out++ = databyte;
+   return out;
 }
 
-static void stbiw__write_dump_data(stbi__write_context *s, int length, unsigned char *data)
+static unsigned char *stbiw__write_dump_data(unsigned char *out, int length, unsigned char *data)
 {
-   unsigned char lengthbyte = STBIW_UCHAR(length);
    STBIW_ASSERT(length <= 128); // inconsistent with spec but consistent with official code
-   s->func(s->context, &lengthbyte, 1);
-   s->func(s->context, data, length);
+   *out++ = STBIW_UCHAR(length);
+   memcpy(out, data, length);
+   return out + length;
 }
 
-static void stbiw__write_hdr_scanline(stbi__write_context *s, int width, int ncomp, unsigned char *scratch, float *scanline)
+// encodes one scanline into out, which has to hold stbiw__hdr_row_bound(width) bytes, and returns the bytes used
+// only touches out and scratch, so several scanlines can be encoded at the same time
+static int stbiw__encode_hdr_scanline(unsigned char *out, int width, int ncomp, unsigned char *scratch, const float *scanline)
 {
-   unsigned char scanlineheader[4] = { 2, 2, 0, 0 };
-   unsigned char rgbe[4];
-   float linear[3];
+   unsigned char *start = out;
    int x;
 
-   scanlineheader[2] = (width&0xff00)>>8;
-   scanlineheader[3] = (width&0x00ff);
+   stbiw__encode_rgbe_planes(scratch, width, ncomp, scanline);
 
    /* skip RLE for images too small or large */
    if (width < 8 || width >= 32768) {
       for (x=0; x < width; x++) {
-         switch (ncomp) {
-            case 4: /* fallthrough */
-            case 3: linear[2] = scanline[x*ncomp + 2];
-                    linear[1] = scanline[x*ncomp + 1];
-                    linear[0] = scanline[x*ncomp + 0];
-                    break;
-            default:
-                    linear[0] = linear[1] = linear[2] = scanline[x*ncomp + 0];
-                    break;
-         }
-         stbiw__linear_to_rgbe(rgbe, linear);
-         s->func(s->context, rgbe, 4);
+         *out++ = scratch[x + width*0];
+         *out++ = scratch[x + width*1];
+         *out++ = scratch[x + width*2];
+         *out++ = scratch[x + width*3];
       }
    } else {
       int c,r;
-      /* encode into scratch buffer */
-      for (x=0; x < width; x++) {
-         switch(ncomp) {
-            case 4: /* fallthrough */
-            case 3: linear[2] = scanline[x*ncomp + 2];
-                    linear[1] = scanline[x*ncomp + 1];
-                    linear[0] = scanline[x*ncomp + 0];
-                    break;
-            default:
-                    linear[0] = linear[1] = linear[2] = scanline[x*ncomp + 0];
-                    break;
-         }
-         stbiw__linear_to_rgbe(rgbe, linear);
-         scratch[x + width*0] = rgbe[0];
-         scratch[x + width*1] = rgbe[1];
-         scratch[x + width*2] = rgbe[2];
-         scratch[x + width*3] = rgbe[3];
-      }
-
-      s->func(s->context, scanlineheader, 4);
+      *out++ = 2;
+      *out++ = 2;
+      *out++ = STBIW_UCHAR((width&0xff00)>>8);
+      *out++ = STBIW_UCHAR(width&0x00ff);
 
       /* RLE each component separately */
       for (c=0; c < 4; c++) {
@@ -699,7 +814,7 @@ static void stbiw__write_hdr_scanline(stbi__write_context *s, int width, int nco
             while (x < r) {
                int len = r-x;
                if (len > 128) len = 128;
-               stbiw__write_dump_data(s, len, &comp[x]);
+               out = stbiw__write_dump_data(out, len, &comp[x]);
                x += len;
             }
             // if there's a run, output it
@@ -711,37 +826,91 @@ static void stbiw__write_hdr_scanline(stbi__write_context *s, int width, int nco
                while (x < r) {
                   int len = r-x;
                   if (len > 127) len = 127;
-                  stbiw__write_run_data(s, len, comp[x]);
+                  out = stbiw__write_run_data(out, len, comp[x]);
                   x += len;
                }
             }
          }
       }
    }
+   return (int) (out - start);
 }
 
-static int stbi_write_hdr_core(stbi__write_context *s, int x, int y, int comp, float *data)
+static void stbiw__write_hdr_header(stbi__write_context *s, int x, int y)
 {
-   if (y <= 0 || x <= 0 || data == NULL)
-      return 0;
-   else {
-      // Each component is stored separately. Allocate scratch space for full output scanline.
-      unsigned char *scratch = (unsigned char *) STBIW_MALLOC(x*4);
-      int i, len;
-      char buffer[128];
-      char header[] = "#?RADIANCE\n# Written by stb_image_write.h\nFORMAT=32-bit_rle_rgbe\n";
-      s->func(s->context, header, sizeof(header)-1);
+   char buffer[128];
+   int len;
+   char header[] = "#?RADIANCE\n# Written by stb_image_write.h\nFORMAT=32-bit_rle_rgbe\n";
+   s->func(s->context, header, sizeof(header)-1);
 
 #ifdef __STDC_WANT_SECURE_LIB__
-      len = sprintf_s(buffer, sizeof(buffer), "EXPOSURE=          1.0000000000000\n\n-Y %d +X %d\n", y, x);
+   len = sprintf_s(buffer, sizeof(buffer), "EXPOSURE=          1.0000000000000\n\n-Y %d +X %d\n", y, x);
 #else
-      len = sprintf(buffer, "EXPOSURE=          1.0000000000000\n\n-Y %d +X %d\n", y, x);
+   len = sprintf(buffer, "EXPOSURE=          1.0000000000000\n\n-Y %d +X %d\n", y, x);
 #endif
-      s->func(s->context, buffer, len);
+   s->func(s->context, buffer, len);
+}
+
+// one batch of scanlines, row i starts at first + i*stride floats
+typedef struct
+{
+   const float *first;
+   int stride;
+   int width, ncomp;
+   unsigned char *buffer;
+   int *lengths;
+} stbiw__hdr_batch;
+
+// per row the buffer holds the encoded scanline followed by the scratch planes
+#define stbiw__hdr_slot(w)  (stbiw__hdr_row_bound(w) + 4*(w))
+
+static void stbiw__encode_hdr_batch_row(void *context, int i)
+{
+   stbiw__hdr_batch *batch = (stbiw__hdr_batch *) context;
+   unsigned char *out = batch->buffer + (size_t) i * stbiw__hdr_slot(batch->width);
+   batch->lengths[i] = stbiw__encode_hdr_scanline(out, batch->width, batch->ncomp, out + stbiw__hdr_row_bound(batch->width),
+                                                  batch->first + (ptrdiff_t) i * batch->stride);
+}
+
+// encodes count scanlines batch by batch and writes them in order, buffer and lengths hold STBIW__HDR_BATCH rows
+static void stbiw__write_hdr_rows(stbi__write_context *s, int x, int comp, const float *first, int stride, int count,
+                                  unsigned char *buffer, int *lengths)
+{
+   int row, i;
+   for (row = 0; row < count; row += STBIW__HDR_BATCH) {
+      stbiw__hdr_batch batch;
+      int batch_rows = count - row < STBIW__HDR_BATCH ? count - row : STBIW__HDR_BATCH;
+      batch.first = first + (ptrdiff_t) row * stride;
+      batch.stride = stride;
+      batch.width = x;
+      batch.ncomp = comp;
+      batch.buffer = buffer;
+      batch.lengths = lengths;
+
+      STBIW_PARALLEL_FOR(batch_rows, stbiw__encode_hdr_batch_row, &batch);
+
+      for (i = 0; i < batch_rows; ++i)
+         s->func(s->context, buffer + (size_t) i * stbiw__hdr_slot(x), lengths[i]);
+   }
+}
 
-      for(i=0; i < y; i++)
-         stbiw__write_hdr_scanline(s, x, comp, scratch, data + comp*x*(stbi__flip_vertically_on_write ? y-1-i : i));
-      STBIW_FREE(scratch);
+static int stbi_write_hdr_core(stbi__write_context *s, int x, int y, int comp, float *data)
+{
+   if (y <= 0 || x <= 0 || data == NULL)
+      return 0;
+   else {
+      // every row of a batch gets room for its encoded scanline and its scratch planes
+      unsigned char *buffer = (unsigned char *) STBIW_MALLOC((size_t) STBIW__HDR_BATCH * stbiw__hdr_slot(x));
+      int lengths[STBIW__HDR_BATCH];
+      if (!buffer)
+         return 0;
+
+      stbiw__write_hdr_header(s, x, y);
+      if (stbi__flip_vertically_on_write)
+         stbiw__write_hdr_rows(s, x, comp, data + (size_t) comp*x*(y-1), -comp*x, y, buffer, lengths);
+      else
+         stbiw__write_hdr_rows(s, x, comp, data, comp*x, y, buffer, lengths);
+      STBIW_FREE(buffer);
       return 1;
    }
 }
@@ -766,6 +935,84 @@ STBIWDEF int stbi_write_hdr(char const *filename, int x, int y, int comp, const
 }
 #endif // STBI_WRITE_NO_STDIO
 
+struct stbi_write_hdr_stream
+{
+   stbi__write_context s;
+   int x, y, comp;
+   int rows_written;
+   int owns_file;
+   unsigned char *buffer;
+   int lengths[STBIW__HDR_BATCH];
+};
+
+static stbi_write_hdr_stream *stbiw__begin_hdr_stream(stbi__write_context *s, int x, int y, int comp, int owns_file)
+{
+   stbi_write_hdr_stream *stream = (stbi_write_hdr_stream *) STBIW_MALLOC(sizeof(stbi_write_hdr_stream));
+   if (!stream)
+      return NULL;
+   stream->buffer = (unsigned char *) STBIW_MALLOC((size_t) STBIW__HDR_BATCH * stbiw__hdr_slot(x));
+   if (!stream->buffer) {
+      STBIW_FREE(stream);
+      return NULL;
+   }
+   stream->s = *s;
+   stream->x = x;
+   stream->y = y;
+   stream->comp = comp;
+   stream->rows_written = 0;
+   stream->owns_file = owns_file;
+   stbiw__write_hdr_header(&stream->s, x, y);
+   return stream;
+}
+
+STBIWDEF stbi_write_hdr_stream *stbi_write_hdr_begin_to_func(stbi_write_func *func, void *context, int w, int h, int comp)
+{
+   stbi__write_context s;
+   if (w <= 0 || h <= 0)
+      return NULL;
+   stbi__start_write_callbacks(&s, func, context);
+   return stbiw__begin_hdr_stream(&s, w, h, comp, 0);
+}
+
+#ifndef STBI_WRITE_NO_STDIO
+STBIWDEF stbi_write_hdr_stream *stbi_write_hdr_begin(char const *filename, int w, int h, int comp)
+{
+   stbi__write_context s;
+   stbi_write_hdr_stream *stream;
+   if (w <= 0 || h <= 0 || !stbi__start_write_file(&s, filename))
+      return NULL;
+   stream = stbiw__begin_hdr_stream(&s, w, h, comp, 1);
+   if (!stream)
+      stbi__end_write_file(&s);
+   return stream;
+}
+#endif // STBI_WRITE_NO_STDIO
+
+STBIWDEF int stbi_write_hdr_rows(stbi_write_hdr_stream *stream, const float *rows, int num_rows)
+{
+   if (!stream || !rows || num_rows < 0 || stream->rows_written + num_rows > stream->y)
+      return 0;
+   stbiw__write_hdr_rows(&stream->s, stream->x, stream->comp, rows, stream->comp*stream->x, num_rows,
+                         stream->buffer, stream->lengths);
+   stream->rows_written += num_rows;
+   return 1;
+}
+
+STBIWDEF int stbi_write_hdr_end(stbi_write_hdr_stream *stream)
+{
+   int complete;
+   if (!stream)
+      return 0;
+   complete = stream->rows_written == stream->y;
+#ifndef STBI_WRITE_NO_STDIO
+   if (stream->owns_file)
+      stbi__end_write_file(&stream->s);
+#endif
+   STBIW_FREE(stream->buffer);
+   STBIW_FREE(stream);
+   return complete;
+}
+
 
 //////////////////////////////////////////////////////////////////////////////
 //
@@ -855,12 +1102,12 @@ static unsigned int stbiw__zhash(unsigned char *data)
 
 #endif // STBIW_ZLIB_COMPRESS
 
-STBIWDEF unsigned char * stbi_zlib_compress(unsigned char *data, int data_len, int *out_len, int quality)
+#ifndef STBIW_ZLIB_COMPRESS
+// deflates data as fixed huffman block(s) without zlib header and checksum, returns a stretchy buffer
+// matches never reach in front of data, so independent parts can be deflated separately;
+// a part that is not final ends with an empty stored block, which leaves the output byte aligned
+static unsigned char *stbiw__zlib_deflate(unsigned char *data, int data_len, int quality, int final)
 {
-#ifdef STBIW_ZLIB_COMPRESS
-   // user provided a zlib compress implementation, use that
-   return STBIW_ZLIB_COMPRESS(data, data_len, out_len, quality);
-#else // use builtin
    static unsigned short lengthc[] = { 3,4,5,6,7,8,9,10,11,13,15,17,19,23,27,31,35,43,51,59,67,83,99,115,131,163,195,227,258, 259 };
    static unsigned char  lengtheb[]= { 0,0,0,0,0,0,0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4,  4,  5,  5,  5,  5,  0 };
    static unsigned short distc[]   = { 1,2,3,4,5,7,9,13,17,25,33,49,65,97,129,193,257,385,513,769,1025,1537,2049,3073,4097,6145,8193,12289,16385,24577, 32768 };
@@ -873,9 +1120,7 @@ STBIWDEF unsigned char * stbi_zlib_compress(unsigned char *data, int data_len, i
       return NULL;
    if (quality < 5) quality = 5;
 
-   stbiw__sbpush(out, 0x78);   // DEFLATE 32K window
-   stbiw__sbpush(out, 0x5e);   // FLEVEL = 1
-   stbiw__zlib_add(1,1);  // BFINAL = 1
+   stbiw__zlib_add(final ? 1 : 0,1);  // BFINAL
    stbiw__zlib_add(1,2);  // BTYPE = 1 -- fixed huffman
 
    for (i=0; i < stbiw__ZHASH; ++i)
@@ -936,6 +1181,16 @@ STBIWDEF unsigned char * stbi_zlib_compress(unsigned char *data, int data_len, i
    for (;i < data_len; ++i)
       stbiw__zlib_huffb(data[i]);
    stbiw__zlib_huff(256); // end of block
+   if (!final) {
+      // empty stored block: BFINAL = 0, BTYPE = 0, padding, LEN = 0, NLEN = 0xffff
+      stbiw__zlib_add(0,3);
+      while (bitcount)
+         stbiw__zlib_add(0,1);
+      stbiw__sbpush(out, 0);
+      stbiw__sbpush(out, 0);
+      stbiw__sbpush(out, 0xff);
+      stbiw__sbpush(out, 0xff);
+   }
    // pad with 0 bits to byte boundary
    while (bitcount)
       stbiw__zlib_add(0,1);
@@ -943,23 +1198,68 @@ STBIWDEF unsigned char * stbi_zlib_compress(unsigned char *data, int data_len, i
    for (i=0; i < stbiw__ZHASH; ++i)
       (void) stbiw__sbfree(hash_table[i]);
    STBIW_FREE(hash_table);
+   return out;
+}
+#endif // STBIW_ZLIB_COMPRESS
 
-   {
-      // compute adler32 on input
-      unsigned int s1=1, s2=0;
-      int blocklen = (int) (data_len % 5552);
-      j=0;
-      while (j < data_len) {
-         for (i=0; i < blocklen; ++i) { s1 += data[j+i]; s2 += s1; }
-         s1 %= 65521; s2 %= 65521;
-         j += blocklen;
-         blocklen = 5552;
-      }
-      stbiw__sbpush(out, STBIW_UCHAR(s2 >> 8));
-      stbiw__sbpush(out, STBIW_UCHAR(s2));
-      stbiw__sbpush(out, STBIW_UCHAR(s1 >> 8));
-      stbiw__sbpush(out, STBIW_UCHAR(s1));
+static unsigned int stbiw__adler32(unsigned char *data, int data_len)
+{
+   unsigned int s1=1, s2=0;
+   int i, j=0;
+   int blocklen = (int) (data_len % 5552);
+   while (j < data_len) {
+      for (i=0; i < blocklen; ++i) { s1 += data[j+i]; s2 += s1; }
+      s1 %= 65521; s2 %= 65521;
+      j += blocklen;
+      blocklen = 5552;
    }
+   return (s2 << 16) | s1;
+}
+
+// checksum of two concatenated parts from the checksums of both, len2 is the length of the second part
+static unsigned int stbiw__adler32_combine(unsigned int adler1, unsigned int adler2, int len2)
+{
+   unsigned int rem = (unsigned int) (len2 % 65521);
+   unsigned int sum1 = adler1 & 0xffff;
+   unsigned int sum2 = (unsigned int) (((unsigned long long) rem * sum1) % 65521);
+   sum1 += (adler2 & 0xffff) + 65521 - 1;
+   sum2 += (adler1 >> 16) + (adler2 >> 16) + 65521 - rem;
+   if (sum1 >= 65521) sum1 -= 65521;
+   if (sum1 >= 65521) sum1 -= 65521;
+   if (sum2 >= 65521*2) sum2 -= 65521*2;
+   if (sum2 >= 65521) sum2 -= 65521;
+   return (sum2 << 16) | sum1;
+}
+
+STBIWDEF unsigned char * stbi_zlib_compress(unsigned char *data, int data_len, int *out_len, int quality)
+{
+#ifdef STBIW_ZLIB_COMPRESS
+   // user provided a zlib compress implementation, use that
+   return STBIW_ZLIB_COMPRESS(data, data_len, out_len, quality);
+#else // use builtin
+   unsigned char *out = NULL, *deflated;
+   unsigned int adler;
+   int i, n;
+
+   stbiw__sbpush(out, 0x78);   // DEFLATE 32K window
+   stbiw__sbpush(out, 0x5e);   // FLEVEL = 1
+
+   deflated = stbiw__zlib_deflate(data, data_len, quality, 1);
+   if (deflated == NULL) {
+      (void) stbiw__sbfree(out);
+      return NULL;
+   }
+   n = stbiw__sbcount(deflated);
+   for (i=0; i < n; ++i)
+      stbiw__sbpush(out, deflated[i]);
+   (void) stbiw__sbfree(deflated);
+
+   // adler32 on input
+   adler = stbiw__adler32(data, data_len);
+   stbiw__sbpush(out, STBIW_UCHAR(adler >> 24));
+   stbiw__sbpush(out, STBIW_UCHAR(adler >> 16));
+   stbiw__sbpush(out, STBIW_UCHAR(adler >> 8));
+   stbiw__sbpush(out, STBIW_UCHAR(adler));
    *out_len = stbiw__sbn(out);
    // make returned pointer freeable
    STBIW_MEMMOVE(stbiw__sbraw(out), out, *out_len);
@@ -967,6 +1267,89 @@ STBIWDEF unsigned char * stbi_zlib_compress(unsigned char *data, int data_len, i
 #endif // STBIW_ZLIB_COMPRESS
 }
 
+#ifndef STBIW_ZLIB_COMPRESS
+// one part of a banded deflate
+typedef struct
+{
+   unsigned char *data;
+   int data_len, band_len, num_bands, quality;
+   unsigned char **deflated;
+   unsigned int *adler;
+} stbiw__zlib_bands;
+
+static void stbiw__deflate_band(void *context, int band)
+{
+   stbiw__zlib_bands *bands = (stbiw__zlib_bands *) context;
+   unsigned char *start = bands->data + (size_t) band * bands->band_len;
+   int len = band == bands->num_bands-1 ? bands->data_len - band * bands->band_len : bands->band_len;
+   bands->deflated[band] = stbiw__zlib_deflate(start, len, bands->quality, band == bands->num_bands-1);
+   bands->adler[band] = stbiw__adler32(start, len);
+}
+#endif // STBIW_ZLIB_COMPRESS
+
+// like stbi_zlib_compress, but data is split into parts of band_len bytes that are deflated
+// independently through STBIW_PARALLEL_FOR and joined into one zlib stream
+static unsigned char *stbiw__zlib_compress_bands(unsigned char *data, int data_len, int band_len, int *out_len, int quality)
+{
+#ifdef STBIW_ZLIB_COMPRESS
+   (void) band_len;
+   return STBIW_ZLIB_COMPRESS(data, data_len, out_len, quality);
+#else
+   stbiw__zlib_bands bands;
+   unsigned char *out, *o;
+   unsigned int adler;
+   int i, len = 2 + 4, failed = 0;
+
+   if (band_len <= 0 || band_len >= data_len)
+      return stbi_zlib_compress(data, data_len, out_len, quality);
+
+   bands.data = data;
+   bands.data_len = data_len;
+   bands.band_len = band_len;
+   bands.num_bands = (data_len + band_len - 1) / band_len;
+   bands.quality = quality;
+   bands.deflated = (unsigned char **) STBIW_MALLOC(bands.num_bands * sizeof(unsigned char *));
+   bands.adler = (unsigned int *) STBIW_MALLOC(bands.num_bands * sizeof(unsigned int));
+   if (!bands.deflated || !bands.adler) {
+      STBIW_FREE(bands.deflated);
+      STBIW_FREE(bands.adler);
+      return NULL;
+   }
+
+   STBIW_PARALLEL_FOR(bands.num_bands, stbiw__deflate_band, &bands);
+
+   adler = bands.adler[0];
+   for (i=0; i < bands.num_bands; ++i) {
+      if (!bands.deflated[i]) failed = 1;
+      len += stbiw__sbcount(bands.deflated[i]);
+      if (i > 0)
+         adler = stbiw__adler32_combine(adler, bands.adler[i], i == bands.num_bands-1 ? data_len - i*band_len : band_len);
+   }
+
+   out = failed ? NULL : (unsigned char *) STBIW_MALLOC(len);
+   if (out) {
+      o = out;
+      *o++ = 0x78;   // DEFLATE 32K window
+      *o++ = 0x5e;   // FLEVEL = 1
+      for (i=0; i < bands.num_bands; ++i) {
+         STBIW_MEMMOVE(o, bands.deflated[i], stbiw__sbcount(bands.deflated[i]));
+         o += stbiw__sbcount(bands.deflated[i]);
+      }
+      *o++ = STBIW_UCHAR(adler >> 24);
+      *o++ = STBIW_UCHAR(adler >> 16);
+      *o++ = STBIW_UCHAR(adler >> 8);
+      *o++ = STBIW_UCHAR(adler);
+      *out_len = len;
+   }
+
+   for (i=0; i < bands.num_bands; ++i)
+      (void) stbiw__sbfree(bands.deflated[i]);
+   STBIW_FREE(bands.deflated);
+   STBIW_FREE(bands.adler);
+   return out;
+#endif // STBIW_ZLIB_COMPRESS
+}
+
 static unsigned int stbiw__crc32(unsigned char *buffer, int len)
 {
 #ifdef STBIW_CRC32
@@ -1071,33 +1454,34 @@ static void stbiw__encode_png_line(unsigned char *pixels, int stride_bytes, int
    }
 }
 
-STBIWDEF unsigned char *stbi_write_png_to_mem(const unsigned char *pixels, int stride_bytes, int x, int y, int n, int *out_len)
-{
-   int force_filter = stbi_write_force_png_filter;
-   int ctype[5] = { -1, 0, 4, 2, 6 };
-   unsigned char sig[8] = { 137,80,78,71,13,10,26,10 };
-   unsigned char *out,*o, *filt, *zlib;
-   signed char *line_buffer;
-   int j,zlen;
+// rows per job of the parallel filter selection
+#define STBIW__PNG_FILTER_ROWS 16
 
-   if (stride_bytes == 0)
-      stride_bytes = x * n;
-
-   if (force_filter >= 5) {
-      force_filter = -1;
-   }
+typedef struct
+{
+   unsigned char *pixels;
+   int stride_bytes, x, y, n, force_filter;
+   unsigned char *filt;
+} stbiw__png_filter_job;
 
-   filt = (unsigned char *) STBIW_MALLOC((x*n+1) * y); if (!filt) return 0;
-   line_buffer = (signed char *) STBIW_MALLOC(x * n); if (!line_buffer) { STBIW_FREE(filt); return 0; }
-   for (j=0; j < y; ++j) {
+// filters rows chunk*STBIW__PNG_FILTER_ROWS onward into filt, every row is encoded into its own place in filt
+static void stbiw__filter_png_rows(void *context, int chunk)
+{
+   stbiw__png_filter_job *job = (stbiw__png_filter_job *) context;
+   int x = job->x, n = job->n;
+   int j = chunk * STBIW__PNG_FILTER_ROWS;
+   int last = j + STBIW__PNG_FILTER_ROWS < job->y ? j + STBIW__PNG_FILTER_ROWS : job->y;
+   for (; j < last; ++j) {
+      unsigned char *row = job->filt + (size_t) j*(x*n+1);
+      signed char *line_buffer = (signed char *) (row + 1);
       int filter_type;
-      if (force_filter > -1) {
-         filter_type = force_filter;
-         stbiw__encode_png_line((unsigned char*)(pixels), stride_bytes, x, y, j, n, force_filter, line_buffer);
+      if (job->force_filter > -1) {
+         filter_type = job->force_filter;
+         stbiw__encode_png_line(job->pixels, job->stride_bytes, x, job->y, j, n, job->force_filter, line_buffer);
       } else { // Estimate the best filter by running through all of them:
          int best_filter = 0, best_filter_val = 0x7fffffff, est, i;
          for (filter_type = 0; filter_type < 5; filter_type++) {
-            stbiw__encode_png_line((unsigned char*)(pixels), stride_bytes, x, y, j, n, filter_type, line_buffer);
+            stbiw__encode_png_line(job->pixels, job->stride_bytes, x, job->y, j, n, filter_type, line_buffer);
 
             // Estimate the entropy of the line using this filter; the less, the better.
             est = 0;
@@ -1109,17 +1493,46 @@ STBIWDEF unsigned char *stbi_write_png_to_mem(const unsigned char *pixels, int s
                best_filter = filter_type;
             }
          }
-         if (filter_type != best_filter) {  // If the last iteration already got us the best filter, don't redo it
-            stbiw__encode_png_line((unsigned char*)(pixels), stride_bytes, x, y, j, n, best_filter, line_buffer);
-            filter_type = best_filter;
+         if (best_filter != 4) {  // If the last iteration already got us the best filter, don't redo it
+            stbiw__encode_png_line(job->pixels, job->stride_bytes, x, job->y, j, n, best_filter, line_buffer);
          }
+         filter_type = best_filter;
       }
-      // when we get here, filter_type contains the filter type, and line_buffer contains the data
-      filt[j*(x*n+1)] = (unsigned char) filter_type;
-      STBIW_MEMMOVE(filt+j*(x*n+1)+1, line_buffer, x*n);
+      // when we get here, filter_type contains the filter type, and the row contains the data
+      row[0] = (unsigned char) filter_type;
    }
-   STBIW_FREE(line_buffer);
-   zlib = stbi_zlib_compress(filt, y*( x*n+1), &zlen, stbi_write_png_compression_level);
+}
+
+STBIWDEF unsigned char *stbi_write_png_to_mem(const unsigned char *pixels, int stride_bytes, int x, int y, int n, int *out_len)
+{
+   int force_filter = stbi_write_force_png_filter;
+   int ctype[5] = { -1, 0, 4, 2, 6 };
+   unsigned char sig[8] = { 137,80,78,71,13,10,26,10 };
+   unsigned char *out,*o, *filt, *zlib;
+   stbiw__png_filter_job job;
+   int zlen;
+
+   if (stride_bytes == 0)
+      stride_bytes = x * n;
+
+   if (force_filter >= 5) {
+      force_filter = -1;
+   }
+
+   filt = (unsigned char *) STBIW_MALLOC((x*n+1) * y); if (!filt) return 0;
+   job.pixels = (unsigned char *) pixels;
+   job.stride_bytes = stride_bytes;
+   job.x = x;
+   job.y = y;
+   job.n = n;
+   job.force_filter = force_filter;
+   job.filt = filt;
+   STBIW_PARALLEL_FOR((y + STBIW__PNG_FILTER_ROWS-1) / STBIW__PNG_FILTER_ROWS, stbiw__filter_png_rows, &job);
+
+   if (stbi_write_png_band_rows > 0 && stbi_write_png_band_rows < y)
+      zlib = stbiw__zlib_compress_bands(filt, y*(x*n+1), stbi_write_png_band_rows*(x*n+1), &zlen, stbi_write_png_compression_level);
+   else
+      zlib = stbi_zlib_compress(filt, y*( x*n+1), &zlen, stbi_write_png_compression_level);
    STBIW_FREE(filt);
    if (!zlib) return 0;
 
@@ -1,15 +1,50 @@
 #version 400 core
+#ifdef COMPACT_MESH
+//octahedral encoded normal, the position is the normal scaled by SPHERE_RADIUS, see SphereMesh.h
+layout(location = 0) in vec2 aOctahedral;
+#else
 layout(location = 0) in vec3 aPos;
 layout(location = 1) in vec3 aNormal;
+#endif
+
+#ifdef INSTANCED
+//one sphere of the preview grid, see SphereInstance in SphereMesh.h
+layout(location = 2) in mat4 aInstanceTransform;
+layout(location = 6) in vec2 aInstanceMaterial;
+
+flat out vec2 instanceMaterial;
+#endif
 
 out vec3 cubeMapCoords;
 
-uniform mat4 transMat;
-uniform mat4 projMatrix;
-uniform mat4 viewMatrix;
+#include "frameData.glsl"
+
+#ifdef COMPACT_MESH
+//unfolds the lower half of the sphere from the corners of the square again
+vec3 decodeOctahedral(vec2 encoded)
+{
+	vec3 normal = vec3(encoded, 1.0 - abs(encoded.x) - abs(encoded.y));
+	float fold = max(-normal.z, 0.0);
+	normal.x += normal.x >= 0.0 ? -fold : fold;
+	normal.y += normal.y >= 0.0 ? -fold : fold;
+	return normalize(normal);
+}
+#endif
 
 void main()
 {
-	cubeMapCoords = aNormal;
-	gl_Position =  projMatrix * viewMatrix * transMat * vec4(aPos, 1);	
+#ifdef COMPACT_MESH
+	vec3 normal = decodeOctahedral(aOctahedral);
+	vec3 position = normal * SPHERE_RADIUS;
+#else
+	vec3 normal = aNormal;
+	vec3 position = aPos;
+#endif
+	cubeMapCoords = normal;
+#ifdef INSTANCED
+	instanceMaterial = aInstanceMaterial;
+	gl_Position = projMatrix * viewMatrix * aInstanceTransform * transMat * vec4(position, 1);
+#else
+	gl_Position =  projMatrix * viewMatrix * transMat * vec4(position, 1);	
+#endif
 }
\ No newline at end of file